@@ -0,0 +1,91 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+using Seconds = std::chrono::duration<double, std::ratio<1, 1>>;
+
+// best of n runs
+inline double
+Measure(int n, const std::function<void()>& f)
+{
+  double best = 0;
+  for (int i = 0; i < n; ++i) {
+    auto start = Clock::now();
+    f();
+    auto elapsed = std::chrono::duration_cast<Seconds>(Clock::now() - start);
+    if (i == 0 || elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+  return best;
+}
+
+inline void
+Report(std::string_view name, double seconds, double count, std::string_view unit)
+{
+  std::cout << name << ": " << seconds * 1000 << "ms, " << (count / seconds)
+            << " " << unit << "/sec" << std::endl;
+}
+
+///
+/// synthetic bvh. chain of joints with the common channel layout
+/// (root: 6ch, joint: 3ch ZXY) and random fixed precision values.
+///
+inline std::string
+MakeBvh(int jointCount, int frameCount, uint32_t seed = 0)
+{
+  std::ostringstream ss;
+  ss << "HIERARCHY\n";
+  ss << "ROOT Hips\n{\n";
+  ss << "\tOFFSET 0.00 90.00 0.00\n";
+  ss << "\tCHANNELS 6 Xposition Yposition Zposition Zrotation Xrotation "
+        "Yrotation\n";
+  for (int i = 1; i < jointCount; ++i) {
+    ss << "\tJOINT Joint" << i << "\n\t{\n";
+    ss << "\t\tOFFSET 0.00 5.00 0.00\n";
+    ss << "\t\tCHANNELS 3 Zrotation Xrotation Yrotation\n";
+  }
+  ss << "\t\tEnd Site\n\t\t{\n\t\t\tOFFSET 0.00 5.00 0.00\n\t\t}\n";
+  for (int i = 1; i < jointCount; ++i) {
+    ss << "\t}\n";
+  }
+  ss << "}\n";
+  ss << "MOTION\n";
+  ss << "Frames: " << frameCount << "\n";
+  ss << "Frame Time: 0.033333\n";
+
+  std::mt19937 rand(seed);
+  std::uniform_real_distribution<float> dist(-180.0f, 180.0f);
+  char buf[32];
+  auto channels = 6 + (jointCount - 1) * 3;
+  for (int f = 0; f < frameCount; ++f) {
+    for (int c = 0; c < channels; ++c) {
+      snprintf(buf, sizeof(buf), "%.4f ", dist(rand));
+      ss << buf;
+    }
+    ss << "\n";
+  }
+  return ss.str();
+}
+
+// write synthetic bvh to path and return it
+inline std::string
+WriteBvh(const std::string& path, int jointCount, int frameCount)
+{
+  std::ofstream os(path, std::ios::binary);
+  auto src = MakeBvh(jointCount, frameCount);
+  os.write(src.data(), src.size());
+  return path;
+}
+
+} // namespace bench
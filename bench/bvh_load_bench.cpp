@@ -0,0 +1,68 @@
+//
+// ReadAllBytes + Bvh::Parse vs MappedFile + Bvh::Parse
+// single thread vs parallel MOTION
+// text vs .bvhc cache
+//
+// usage: bvh_load_bench [file.bvh]
+//
+#include "Bvh.h"
+#include "BvhCache.h"
+#include "MappedFile.h"
+#include "ReadAllBytes.h"
+#include "bench_util.h"
+#include <filesystem>
+
+int
+main(int argc, char** argv)
+{
+  std::string path;
+  if (argc > 1) {
+    path = argv[1];
+  } else {
+    path = (std::filesystem::temp_directory_path() / "bvh_load_bench.bvh")
+             .string();
+    bench::WriteBvh(path, 60, 20000);
+  }
+  auto size = std::filesystem::file_size(path);
+  std::cout << path << ": " << size << "bytes" << std::endl;
+
+  auto stream = bench::Measure(5, [&path]() {
+    auto bytes = ReadAllBytes<char>(path);
+    Bvh bvh;
+    if (!bvh.Parse({ bytes.begin(), bytes.end() }, 1)) {
+      throw std::runtime_error("parse");
+    }
+  });
+  bench::Report("ifstream", stream, size / (1024.0 * 1024.0), "MB");
+
+  auto mapped = bench::Measure(5, [&path]() {
+    MappedFile mapping;
+    Bvh bvh;
+    if (!mapping.Open(path) || !bvh.Parse(mapping.view(), 1)) {
+      throw std::runtime_error("parse");
+    }
+  });
+  bench::Report("mmap", mapped, size / (1024.0 * 1024.0), "MB");
+
+  auto parallel = bench::Measure(5, [&path]() {
+    MappedFile mapping;
+    Bvh bvh;
+    if (!mapping.Open(path) || !bvh.Parse(mapping.view(), 0)) {
+      throw std::runtime_error("parse");
+    }
+  });
+  bench::Report("mmap parallel", parallel, size / (1024.0 * 1024.0), "MB");
+
+  // first call writes the cache. decoded whatever the size
+  std::filesystem::remove(BvhCachePath(path));
+  Bvh::ParseFile(path, 0, UINT64_MAX);
+  auto cached = bench::Measure(5, [&path]() {
+    auto bvh = Bvh::ParseFile(path, 0, UINT64_MAX);
+    if (!bvh || !bvh->frame_mapping) {
+      throw std::runtime_error("cache");
+    }
+  });
+  bench::Report("bvhc", cached, size / (1024.0 * 1024.0), "MB");
+
+  return 0;
+}
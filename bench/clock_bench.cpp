@@ -0,0 +1,85 @@
+//
+// N animations at 30/60/120Hz on one io_context for 2 seconds.
+// a steady_timer per Animation vs one shared AnimationClock at 1ms and
+// 100us resolution
+//
+// usage: clock_bench [file.bvh]
+//
+#include <DirectXMath.h>
+
+#include "Animation.h"
+#include "AnimationClock.h"
+#include "bench_util.h"
+#include <ctime>
+
+int
+main(int argc, char** argv)
+{
+  std::shared_ptr<Bvh> bvh;
+  if (argc > 1) {
+    bvh = Bvh::ParseFile(argv[1]);
+  } else {
+    bvh = std::make_shared<Bvh>();
+    if (!bvh->Parse(bench::MakeBvh(30, 300))) {
+      bvh.reset();
+    }
+  }
+  if (!bvh || !bvh->BuildTracks()) {
+    std::cerr << "parse" << std::endl;
+    return 1;
+  }
+
+  const float RATES[] = { 30, 60, 120 };
+  const auto DURATION = std::chrono::seconds(2);
+  for (int count : { 100, 500, 2000 }) {
+    // 0: own timers
+    for (int resolution_us : { 0, 1000, 100 }) {
+      bool shared = resolution_us > 0;
+      asio::io_context io;
+      std::shared_ptr<AnimationClock> clock;
+      if (shared) {
+        clock = std::make_shared<AnimationClock>(
+          io, std::chrono::microseconds(resolution_us));
+      }
+      uint64_t frames = 0;
+      std::vector<std::unique_ptr<Animation>> animations;
+      for (int i = 0; i < count; ++i) {
+        auto animation = std::make_unique<Animation>(io, clock);
+        animation->OnFrame([&frames](const BvhFrame& frame) { ++frames; });
+        animation->SetBvh(bvh);
+        animation->SetOutputRate(RATES[i % std::size(RATES)]);
+        animations.push_back(std::move(animation));
+      }
+
+      auto cpu = std::clock();
+      io.run_for(DURATION);
+      auto cpu_seconds = double(std::clock() - cpu) / CLOCKS_PER_SEC;
+
+      uint64_t wakeups = 0;
+      uint64_t late = 0;
+      uint64_t ticks = 0;
+      for (auto& animation : animations) {
+        auto stats = animation->GetStats();
+        ticks += stats.ticks;
+        // over 1ms
+        for (size_t b = 5; b < AnimationStats::LATE_BUCKETS; ++b) {
+          late += stats.late[b];
+        }
+        if (!shared) {
+          wakeups += stats.ticks - stats.caughtUp;
+        }
+        animation->Stop();
+      }
+      if (shared) {
+        wakeups = clock->GetStats().wakeups;
+      }
+      std::cout << (shared ? "shared clock " + std::to_string(resolution_us) +
+                               "us "
+                           : std::string("own timers "))
+                << count << " animations: " << frames << " frames, " << wakeups
+                << " wakeups, cpu " << cpu_seconds * 1000 << "ms, late>1ms "
+                << (ticks ? 100.0 * late / ticks : 0) << "%" << std::endl;
+    }
+  }
+  return 0;
+}
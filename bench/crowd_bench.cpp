@@ -0,0 +1,74 @@
+//
+// BvhCrowd::Update for 1k, 10k, 50k characters
+// single thread vs WorkStealingPool on all cores
+//
+// usage: crowd_bench [file.bvh]
+//
+#include <DirectXMath.h>
+
+#include "BvhCrowd.h"
+#include "bench_util.h"
+#include <random>
+#include <thread>
+
+int
+main(int argc, char** argv)
+{
+  // a handful of shared clips
+  std::vector<std::shared_ptr<Bvh>> clips;
+  if (argc > 1) {
+    auto bvh = Bvh::ParseFile(argv[1]);
+    if (!bvh) {
+      std::cerr << "parse: " << argv[1] << std::endl;
+      return 1;
+    }
+    clips.push_back(bvh);
+  } else {
+    for (uint32_t seed = 0; seed < 4; ++seed) {
+      auto bvh = std::make_shared<Bvh>();
+      if (!bvh->Parse(bench::MakeBvh(30, 300, seed))) {
+        std::cerr << "parse" << std::endl;
+        return 1;
+      }
+      clips.push_back(bvh);
+    }
+  }
+
+  std::vector<uint32_t> thread_counts = { 1 };
+  if (std::thread::hardware_concurrency() > 1) {
+    thread_counts.push_back(std::thread::hardware_concurrency());
+  }
+  for (auto threads : thread_counts) {
+    for (int count : { 1000, 10000, 50000 }) {
+      BvhCrowd crowd(threads);
+      for (auto& clip : clips) {
+        crowd.AddClip(clip);
+      }
+      std::mt19937 rand(count);
+      std::uniform_real_distribution<float> offset(0, 10);
+      for (int i = 0; i < count; ++i) {
+        BvhCrowdCharacter character{
+          .clip = static_cast<uint32_t>(i % clips.size()),
+          .offset = BvhTime(offset(rand)),
+        };
+        character.root.m[3][0] = float(i % 100);
+        character.root.m[3][2] = float(i / 100);
+        crowd.AddCharacter(character);
+      }
+      // layout
+      auto instances = crowd.Update({}).size();
+
+      int tick = 0;
+      auto time = bench::Measure(5, [&crowd, &tick]() {
+        crowd.Update(BvhTime(tick++ / 60.0f));
+      });
+      bench::Report("x" + std::to_string(threads) + " " +
+                      std::to_string(count) + "characters(" +
+                      std::to_string(instances) + "cubes)",
+                    time,
+                    count,
+                    "characters");
+    }
+  }
+  return 0;
+}
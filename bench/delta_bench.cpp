@@ -0,0 +1,163 @@
+//
+// bytes per frame of float4, quat32 and FrameFlags::DELTA frames
+// (keyframe every 30 frames, threshold 0 / 1 / 2 / 4 quat32 steps) and
+// the encode / decode cost per skeleton.
+//
+// without a file: 55 joints, 1 minute at 30fps of slow sines. a third of
+// the joints swing, a third sway and a third are almost still, roughly
+// like a standing or walking take with fingers.
+//
+// usage: delta_bench [file.bvh]
+//
+#include <DirectXMath.h>
+
+#include "Bvh.h"
+#include "Quat32Batch.h"
+#include "SrhtDelta.h"
+#include "bench_util.h"
+#include <cmath>
+
+static std::string
+MakeTake(int jointCount, int frameCount)
+{
+  std::ostringstream ss;
+  ss << "HIERARCHY\nROOT Hips\n{\n\tOFFSET 0.00 90.00 0.00\n";
+  ss << "\tCHANNELS 6 Xposition Yposition Zposition Zrotation Xrotation "
+        "Yrotation\n";
+  for (int i = 1; i < jointCount; ++i) {
+    ss << "\tJOINT Joint" << i << "\n\t{\n\t\tOFFSET 0.00 5.00 0.00\n";
+    ss << "\t\tCHANNELS 3 Zrotation Xrotation Yrotation\n";
+  }
+  ss << "\t\tEnd Site\n\t\t{\n\t\t\tOFFSET 0.00 5.00 0.00\n\t\t}\n";
+  for (int i = 1; i < jointCount; ++i) {
+    ss << "\t}\n";
+  }
+  ss << "}\nMOTION\nFrames: " << frameCount << "\nFrame Time: 0.033333\n";
+
+  const float AMPLITUDES[] = { 30.0f, 3.0f, 0.1f };
+  char buf[32];
+  for (int f = 0; f < frameCount; ++f) {
+    float t = f / 30.0f;
+    ss << std::sin(t) * 50 << " 90 " << std::cos(t) * 50;
+    for (int i = 0; i < jointCount; ++i) {
+      auto amplitude = AMPLITUDES[i % 3];
+      for (int c = 0; c < 3; ++c) {
+        auto v =
+          10.0f * c + amplitude * std::sin(t * (1.0f + 0.1f * c) + i * 0.7f);
+        snprintf(buf, sizeof(buf), " %.4f", v);
+        ss << buf;
+      }
+    }
+    ss << "\n";
+  }
+  return ss.str();
+}
+
+int
+main(int argc, char** argv)
+{
+  auto bvh = std::make_shared<Bvh>();
+  if (argc > 1) {
+    bvh = Bvh::ParseFile(argv[1]);
+    if (!bvh) {
+      std::cerr << "parse: " << argv[1] << std::endl;
+      return 1;
+    }
+  } else if (!bvh->Parse(MakeTake(55, 1800))) {
+    std::cerr << "parse" << std::endl;
+    return 1;
+  }
+  auto joints = bvh->joints.size();
+  auto frames = bvh->FrameCount();
+  std::cout << joints << "joints x " << frames << "frames" << std::endl;
+
+  // quat32 of every frame
+  std::vector<uint32_t> packed(joints * frames);
+  std::vector<DirectX::XMFLOAT4> rotations(joints);
+  for (uint32_t f = 0; f < frames; ++f) {
+    auto frame = bvh->GetFrame(f);
+    for (auto& joint : bvh->joints) {
+      auto [pos, q] = frame.ResolveQuaternion(joint.index, joint.channels);
+      DirectX::XMStoreFloat4(&rotations[joint.index], q);
+    }
+    quat_packer::PackBatch({ &rotations[0].x, joints * 4 },
+                           { packed.data() + f * joints, joints });
+  }
+  auto current = [&](uint32_t f) {
+    return std::span<const uint32_t>(packed.data() + f * joints, joints);
+  };
+
+  auto header = sizeof(srht::FrameHeader);
+  std::cout << "float4: " << header + 16 * joints << "bytes/frame" << std::endl;
+  std::cout << "quat32: " << header + 4 * joints << "bytes/frame" << std::endl;
+
+  const uint32_t KEYFRAME_INTERVAL = 30;
+  std::vector<uint8_t> body(srht::DeltaBound(joints));
+  for (uint32_t threshold : { 0, 1, 2, 4 }) {
+    // the UdpSender::WriteDelta rules
+    size_t bytes = 0;
+    size_t deltas = 0;
+    uint32_t keyframe = 0;
+    auto encode_time = bench::Measure(5, [&]() {
+      bytes = 0;
+      deltas = 0;
+      for (uint32_t f = 0; f < frames; ++f) {
+        if (f > 0 && f - keyframe < KEYFRAME_INTERVAL) {
+          auto size = srht::EncodeDelta(
+            keyframe, current(keyframe), current(f), threshold, body.data());
+          if (size < 4 * joints) {
+            bytes += header + size;
+            ++deltas;
+            continue;
+          }
+        }
+        keyframe = f;
+        bytes += header + 4 * joints;
+      }
+    });
+
+    // decode a delta per keyframe interval position, like the receiver
+    std::vector<std::vector<uint8_t>> encoded(frames);
+    keyframe = 0;
+    for (uint32_t f = 0; f < frames; ++f) {
+      if (f % KEYFRAME_INTERVAL == 0) {
+        keyframe = f;
+        continue;
+      }
+      encoded[f].resize(srht::DeltaBound(joints));
+      encoded[f].resize(srht::EncodeDelta(keyframe,
+                                          current(keyframe),
+                                          current(f),
+                                          threshold,
+                                          encoded[f].data()));
+    }
+    std::vector<uint32_t> decoded(joints);
+    size_t errors = 0;
+    auto decode_time = bench::Measure(5, [&]() {
+      for (uint32_t f = 0; f < frames; ++f) {
+        if (encoded[f].empty()) {
+          quat_packer::UnpackBatch(current(f), { &rotations[0].x, joints * 4 });
+          continue;
+        }
+        auto key = f - f % KEYFRAME_INTERVAL;
+        if (!srht::DecodeDelta(encoded[f], current(key), decoded)) {
+          ++errors;
+        }
+        quat_packer::UnpackBatch(decoded, { &rotations[0].x, joints * 4 });
+      }
+    });
+    if (errors) {
+      std::cerr << "decode" << std::endl;
+      return 1;
+    }
+
+    std::cout << "delta threshold " << threshold << ": "
+              << double(bytes) / frames << "bytes/frame ("
+              << 100.0 * bytes / (frames * (header + 4 * joints))
+              << "% of quat32), " << deltas << "/" << frames << " deltas, "
+              << "encode " << encode_time * 1e9 / frames << "ns, "
+              << "decode+unpack " << decode_time * 1e9 / frames
+              << "ns per skeleton" << std::endl;
+  }
+  return 0;
+}
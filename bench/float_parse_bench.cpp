@@ -0,0 +1,47 @@
+//
+// bvh_number::parse vs strtod on MOTION like numbers
+//
+#include "BvhNumber.h"
+#include "bench_util.h"
+#include <vector>
+
+int
+main(int argc, char** argv)
+{
+  const int N = 4000000;
+  std::mt19937 rand(0);
+  std::uniform_real_distribution<float> dist(-180.0f, 180.0f);
+  std::string src;
+  char buf[32];
+  for (int i = 0; i < N; ++i) {
+    snprintf(buf, sizeof(buf), "%.6f ", dist(rand));
+    src += buf;
+  }
+
+  std::vector<float> values(N);
+  auto strtod_time = bench::Measure(5, [&src, &values]() {
+    auto p = src.c_str();
+    for (auto& v : values) {
+      char* end;
+      v = (float)strtod(p, &end);
+      p = end + 1;
+    }
+  });
+  bench::Report("strtod", strtod_time, N, "floats");
+
+  std::vector<float> fast(N);
+  auto fast_time = bench::Measure(5, [&src, &fast]() {
+    const char* p = src.data();
+    const char* end = src.data() + src.size();
+    for (auto& v : fast) {
+      p = bvh_number::parse(p, end, v) + 1;
+    }
+  });
+  bench::Report("bvh_number", fast_time, N, "floats");
+
+  if (fast != values) {
+    std::cout << "mismatch !" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+//
+// quat_packer::Pack / Unpack one at a time vs PackBatch / UnpackBatch.
+// 55 joint skeletons (humanoid + fingers), 100000 frames
+//
+#include "Quat32Batch.h"
+#include "bench_util.h"
+#include <cmath>
+#include <vector>
+
+int
+main(int argc, char** argv)
+{
+  const int JOINTS = 55;
+  const int FRAMES = 100000;
+  const size_t N = JOINTS * FRAMES;
+  std::mt19937 rand(0);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> xyzw(N * 4);
+  for (size_t i = 0; i < N; ++i) {
+    auto q = &xyzw[i * 4];
+    float len = 0;
+    for (int c = 0; c < 4; ++c) {
+      q[c] = dist(rand);
+      len += q[c] * q[c];
+    }
+    len = std::sqrt(len);
+    for (int c = 0; c < 4; ++c) {
+      q[c] /= len;
+    }
+  }
+
+  std::vector<uint32_t> scalar(N);
+  auto pack_time = bench::Measure(5, [&]() {
+    for (size_t i = 0; i < N; ++i) {
+      auto q = &xyzw[i * 4];
+      scalar[i] = quat_packer::Pack(q[0], q[1], q[2], q[3]);
+    }
+  });
+  bench::Report("Pack", pack_time, N, "quats");
+
+  std::vector<uint32_t> batch(N);
+  auto pack_batch_time = bench::Measure(5, [&]() {
+    for (size_t f = 0; f < FRAMES; ++f) {
+      quat_packer::PackBatch(
+        { xyzw.data() + f * JOINTS * 4, JOINTS * 4 },
+        { batch.data() + f * JOINTS, JOINTS });
+    }
+  });
+  bench::Report("PackBatch", pack_batch_time, N, "quats");
+  if (batch != scalar) {
+    std::cerr << "PackBatch differs" << std::endl;
+    return 1;
+  }
+
+  std::vector<float> unpacked(N * 4);
+  auto unpack_time = bench::Measure(5, [&]() {
+    for (size_t i = 0; i < N; ++i) {
+      quat_packer::Unpack(scalar[i], &unpacked[i * 4]);
+    }
+  });
+  bench::Report("Unpack", unpack_time, N, "quats");
+
+  std::vector<float> unpacked_batch(N * 4);
+  auto unpack_batch_time = bench::Measure(5, [&]() {
+    for (size_t f = 0; f < FRAMES; ++f) {
+      quat_packer::UnpackBatch(
+        { scalar.data() + f * JOINTS, JOINTS },
+        { unpacked_batch.data() + f * JOINTS * 4, JOINTS * 4 });
+    }
+  });
+  bench::Report("UnpackBatch", unpack_batch_time, N, "quats");
+  if (memcmp(unpacked.data(), unpacked_batch.data(), N * 16) != 0) {
+    std::cerr << "UnpackBatch differs" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,185 @@
+//
+// SRHT frames to a reader on the same host: loopback UDP vs shared memory.
+//
+// throughput: QueueFrame + Flush + the reader's Poll into a SrhtReceiver
+// on one thread, 20000 ticks.
+// latency: a writer thread stamps a frame packet every 200us, the reader
+// (a blocking socket / ReadLatest spinning with yield) records the delay.
+//
+// usage: shm_bench [file.bvh]
+//
+#include <DirectXMath.h>
+
+#include "SrhtShm.h"
+#include "UdpSender.h"
+#include "bench_util.h"
+#include <algorithm>
+#include <thread>
+
+static int64_t
+Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           bench::Clock::now().time_since_epoch())
+    .count();
+}
+
+static void
+ReportLatency(std::string_view name, std::vector<int64_t>& samples)
+{
+  if (samples.empty()) {
+    std::cout << name << ": no samples" << std::endl;
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto at = [&samples](double p) {
+    return samples[std::min(samples.size() - 1, size_t(samples.size() * p))] /
+           1000.0;
+  };
+  std::cout << name << ": p50 " << at(0.5) << "us, p99 " << at(0.99)
+            << "us, max " << samples.back() / 1000.0 << "us ("
+            << samples.size() << " samples)" << std::endl;
+}
+
+int
+main(int argc, char** argv)
+{
+  std::shared_ptr<Bvh> bvh;
+  if (argc > 1) {
+    bvh = Bvh::ParseFile(argv[1]);
+  } else {
+    bvh = std::make_shared<Bvh>();
+    if (!bvh->Parse(bench::MakeBvh(55, 10))) {
+      bvh.reset();
+    }
+  }
+  if (!bvh || !bvh->BuildTracks()) {
+    std::cerr << "parse" << std::endl;
+    return 1;
+  }
+  auto frame = bvh->GetFrame(0);
+  auto name = "shm_bench_" + std::to_string(getpid());
+
+  const int TICKS = 20000;
+  for (bool pack : { false, true }) {
+    auto suffix = pack ? " quat32" : " float";
+    {
+      asio::io_context io;
+      SrhtUdpReceiver udp(
+        io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+      SrhtReceiver receiver(16);
+      UdpSender sender(io);
+      sender.AddEndpoint(udp.LocalEndpoint());
+      sender.QueueSkeleton(*bvh);
+      sender.Flush();
+      size_t received = 0;
+      auto time = bench::Measure(1, [&]() {
+        for (int tick = 0; tick < TICKS; ++tick) {
+          sender.QueueFrame(*bvh, frame, pack);
+          sender.Flush();
+          received += udp.Poll(receiver);
+        }
+      });
+      bench::Report(std::string("udp") + suffix, time, received, "frames");
+    }
+    {
+      asio::io_context io;
+      auto shm = std::make_shared<SrhtShmWriter>();
+      SrhtShmReader reader;
+      if (!shm->Create(name) || !reader.Open(name)) {
+        std::cerr << "shm" << std::endl;
+        return 1;
+      }
+      SrhtReceiver receiver(16);
+      UdpSender sender(io);
+      sender.SetShm(shm);
+      sender.QueueSkeleton(*bvh);
+      sender.Flush();
+      size_t received = 0;
+      auto time = bench::Measure(1, [&]() {
+        for (int tick = 0; tick < TICKS; ++tick) {
+          sender.QueueFrame(*bvh, frame, pack);
+          sender.Flush();
+          received += reader.Poll(receiver);
+        }
+      });
+      bench::Report(std::string("shm") + suffix, time, received, "frames");
+    }
+  }
+
+  // a frame packet of the quat32 size with the send time in FrameHeader
+  const int SAMPLES = 5000;
+  std::vector<uint8_t> packet(
+    sizeof(srht::FrameHeader) + 4 * bvh->joints.size() + 12);
+  auto stamp = [&packet]() {
+    srht::FrameHeader header;
+    header.time = Now();
+    memcpy(packet.data(), &header, sizeof(header));
+  };
+  auto pace = []() {
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  };
+  {
+    asio::io_context io;
+    asio::ip::udp::socket socket(
+      io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+    auto endpoint = socket.local_endpoint();
+    std::vector<int64_t> samples;
+    samples.reserve(SAMPLES);
+    std::thread reader([&]() {
+      std::vector<uint8_t> buffer(65536);
+      asio::ip::udp::endpoint from;
+      for (int i = 0; i < SAMPLES; ++i) {
+        socket.receive_from(asio::buffer(buffer), from);
+        srht::FrameHeader header;
+        memcpy(&header, buffer.data(), sizeof(header));
+        samples.push_back(Now() - header.time);
+      }
+    });
+    asio::ip::udp::socket sender(io, asio::ip::udp::v4());
+    for (int i = 0; i < SAMPLES; ++i) {
+      stamp();
+      sender.send_to(asio::buffer(packet), endpoint);
+      pace();
+    }
+    reader.join();
+    ReportLatency("udp latency", samples);
+  }
+  {
+    SrhtShmWriter writer;
+    SrhtShmReader reader;
+    if (!writer.Create(name) || !reader.Open(name)) {
+      std::cerr << "shm" << std::endl;
+      return 1;
+    }
+    std::vector<int64_t> samples;
+    samples.reserve(SAMPLES);
+    std::atomic<bool> done = false;
+    std::thread thread([&]() {
+      int64_t last = 0;
+      while (!done) {
+        int64_t time = 0;
+        reader.ReadLatest(0, [&time](std::span<const uint8_t> bytes) {
+          srht::FrameHeader header;
+          memcpy(&header, bytes.data(), sizeof(header));
+          time = header.time;
+        });
+        if (time != last) {
+          samples.push_back(Now() - time);
+          last = time;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+    for (int i = 0; i < SAMPLES; ++i) {
+      stamp();
+      writer.Write(packet);
+      pace();
+    }
+    done = true;
+    thread.join();
+    ReportLatency("shm latency", samples);
+  }
+  return 0;
+}
@@ -0,0 +1,117 @@
+//
+// BvhSolver (node tree) vs BvhFlatSolver (parent first arrays)
+// BvhFrame::Resolve kernels vs the generic channel loop
+// BvhFlatSolver::Bake on 1..hardware_concurrency threads
+// BvhTracks (precomputed quaternions) vs euler channels
+//
+// usage: solver_bench [file.bvh]
+//
+#include <DirectXMath.h>
+
+#include "Bvh.h"
+#include "BvhFlatSolver.h"
+#include "BvhSolver.h"
+#include "bench_util.h"
+#include <string.h>
+#include <thread>
+
+int
+main(int argc, char** argv)
+{
+  auto bvh = std::make_shared<Bvh>();
+  if (argc > 1) {
+    bvh = Bvh::ParseFile(argv[1]);
+    if (!bvh) {
+      std::cerr << "parse: " << argv[1] << std::endl;
+      return 1;
+    }
+  } else if (!bvh->Parse(bench::MakeBvh(60, 2000))) {
+    std::cerr << "parse" << std::endl;
+    return 1;
+  }
+  auto joints = double(bvh->joints.size()) * bvh->FrameCount();
+  std::cout << bvh->joints.size() << "joints x " << bvh->FrameCount()
+            << "frames" << std::endl;
+
+  BvhSolver tree;
+  tree.Initialize(bvh);
+  BvhFlatSolver flat;
+  flat.Initialize(bvh);
+
+  for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+    auto frame = bvh->GetFrame(i);
+    std::vector<DirectX::XMFLOAT4X4> expected;
+    for (auto& m : tree.ResolveFrame(frame)) {
+      expected.push_back(m);
+    }
+    auto actual = flat.ResolveFrame(frame);
+    if (memcmp(actual.data(),
+               expected.data(),
+               expected.size() * sizeof(expected[0])) != 0) {
+      std::cerr << "mismatch: frame " << i << std::endl;
+      return 1;
+    }
+  }
+
+  auto treeTime = bench::Measure(5, [&bvh, &tree]() {
+    for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+      tree.ResolveFrame(bvh->GetFrame(i));
+    }
+  });
+  bench::Report("tree", treeTime, joints, "joints");
+
+  auto flatTime = bench::Measure(5, [&bvh, &flat]() {
+    for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+      flat.ResolveFrame(bvh->GetFrame(i));
+    }
+  });
+  bench::Report("flat", flatTime, joints, "joints");
+
+  auto resolve = [&bvh](const std::vector<BvhChannels>& channels) {
+    float sum = 0;
+    for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+      auto frame = bvh->GetFrame(i);
+      for (auto& ch : channels) {
+        auto [pos, rot] = frame.Resolve(ch);
+        sum += DirectX::XMVectorGetX(rot.r[0]);
+      }
+    }
+    return sum;
+  };
+  std::vector<BvhChannels> kernels;
+  for (auto& joint : bvh->joints) {
+    kernels.push_back(joint.channels);
+  }
+  auto generic = kernels;
+  for (auto& ch : generic) {
+    ch.kernel = nullptr;
+  }
+  volatile float sink = 0;
+  auto genericTime =
+    bench::Measure(5, [&]() { sink = sink + resolve(generic); });
+  bench::Report("Resolve generic", genericTime, joints, "joints");
+  auto kernelTime =
+    bench::Measure(5, [&]() { sink = sink + resolve(kernels); });
+  bench::Report("Resolve kernel", kernelTime, joints, "joints");
+
+  // quaternion tracks instead of euler angles
+  bvh->BuildTracks();
+  auto tracksTime = bench::Measure(5, [&bvh, &flat]() {
+    for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+      flat.ResolveFrame(bvh->GetFrame(i));
+    }
+  });
+  bench::Report("flat tracks", tracksTime, joints, "joints");
+
+  std::vector<DirectX::XMFLOAT4X4> baked(static_cast<size_t>(joints));
+  auto hardware = std::max(1u, std::thread::hardware_concurrency());
+  for (uint32_t threads = 1; threads <= hardware; threads *= 2) {
+    auto bakeTime = bench::Measure(5, [&bvh, &flat, &baked, threads]() {
+      flat.Bake(*bvh, 0, bvh->FrameCount(), baked, true, threads);
+    });
+    bench::Report(
+      "bake x" + std::to_string(threads), bakeTime, joints, "joints");
+  }
+
+  return 0;
+}
@@ -0,0 +1,92 @@
+//
+// fan out of SRHT frames over loopback.
+// E endpoints x S skeletons per tick, 2000 ticks:
+// async SendFrame each, Flush with a send_to each, Flush with sendmmsg
+//
+// usage: udp_bench [file.bvh]
+//
+#include <DirectXMath.h>
+
+#include "UdpSender.h"
+#include "bench_util.h"
+
+int
+main(int argc, char** argv)
+{
+  std::shared_ptr<Bvh> bvh;
+  if (argc > 1) {
+    bvh = Bvh::ParseFile(argv[1]);
+  } else {
+    bvh = std::make_shared<Bvh>();
+    if (!bvh->Parse(bench::MakeBvh(55, 10))) {
+      bvh.reset();
+    }
+  }
+  if (!bvh || !bvh->BuildTracks()) {
+    std::cerr << "parse" << std::endl;
+    return 1;
+  }
+  auto frame = bvh->GetFrame(0);
+
+  const int TICKS = 2000;
+  for (int endpoints : { 1, 8, 32 }) {
+    for (int skeletons : { 1, 4 }) {
+      asio::io_context io;
+      // nobody reads. the kernel drops at the receiver, not at the sender
+      std::vector<std::unique_ptr<asio::ip::udp::socket>> receivers;
+      std::vector<asio::ip::udp::endpoint> eps;
+      for (int i = 0; i < endpoints; ++i) {
+        receivers.push_back(std::make_unique<asio::ip::udp::socket>(
+          io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0)));
+        eps.push_back(receivers.back()->local_endpoint());
+      }
+      auto name = std::to_string(endpoints) + "endpoints x " +
+                  std::to_string(skeletons) + "skeletons ";
+
+      {
+        UdpSender sender(io);
+        auto time = bench::Measure(1, [&]() {
+          for (int tick = 0; tick < TICKS; ++tick) {
+            for (auto& ep : eps) {
+              for (int s = 0; s < skeletons; ++s) {
+                sender.SendFrame(ep, bvh, frame, true);
+              }
+            }
+            io.poll();
+            io.restart();
+          }
+        });
+        // more than UdpSender::POOL_SIZE in flight are dropped
+        bench::Report(name + "async",
+                      time,
+                      double(TICKS) * endpoints * skeletons - sender.Dropped(),
+                      "datagrams");
+        std::cout << "  syscalls/tick: " << endpoints * skeletons
+                  << ", dropped: " << sender.Dropped() << std::endl;
+      }
+
+      for (bool batch : { false, true }) {
+        UdpSender sender(io);
+        sender.SetBatchSend(batch);
+        for (auto& ep : eps) {
+          sender.AddEndpoint(ep);
+        }
+        auto time = bench::Measure(1, [&]() {
+          for (int tick = 0; tick < TICKS; ++tick) {
+            for (int s = 0; s < skeletons; ++s) {
+              sender.QueueFrame(*bvh, frame, true, s);
+            }
+            sender.Flush();
+          }
+        });
+        auto& stats = sender.Stats();
+        bench::Report(name + (batch ? "sendmmsg" : "send_to"), time,
+                      double(stats.datagrams), "datagrams");
+        std::cout << "  syscalls/tick: "
+                  << double(stats.syscalls) / stats.flushes
+                  << ", dropped: " << sender.Dropped() << std::endl;
+      }
+    }
+  }
+  return 0;
+}
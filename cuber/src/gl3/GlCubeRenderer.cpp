@@ -1,5 +1,6 @@
 #include <DirectXMath.h>
 #include <GL/glew.h>
+#include <algorithm>
 #include <cuber/gl3/GlCubeRenderer.h>
 #include <cuber/mesh.h>
 #include <grapho/gl3/error_check.h>
@@ -11,6 +12,9 @@ using namespace grapho::gl3;
 
 namespace cuber::gl3 {
 
+// instance vbo capacity. Render draws larger arrays in batches of this
+const uint32_t INSTANCE_BATCH = 65535;
+
 static auto vertex_m_shadertext = u8R"(
 uniform mat4 VP;
 in vec4 vPosFace;
@@ -157,7 +161,7 @@ GlCubeRenderer::GlCubeRenderer()
     throw std::runtime_error("cuber::Vbo::Create");
   }
 
-  m_instance_vbo = Vbo::Create(sizeof(float) * 16 * 65535, nullptr);
+  m_instance_vbo = Vbo::Create(sizeof(Instance) * INSTANCE_BATCH, nullptr);
   if (!m_instance_vbo) {
     throw std::runtime_error("cuber::Vbo::Create: m_instance_vbo");
   }
@@ -212,8 +216,11 @@ GlCubeRenderer::Render(const float projection[16],
   m_shader->UboBind(*block_index, 1);
   m_ubo->SetBindingPoint(1);
 
-  m_instance_vbo->Upload(sizeof(Instance) * instanceCount, data);
-  m_vao->DrawInstance(instanceCount, CUBE_INDEX_COUNT, 0);
+  for (uint32_t i = 0; i < instanceCount; i += INSTANCE_BATCH) {
+    auto count = std::min(INSTANCE_BATCH, instanceCount - i);
+    m_instance_vbo->Upload(sizeof(Instance) * count, data + i);
+    m_vao->DrawInstance(count, CUBE_INDEX_COUNT, 0);
+  }
 }
 
 } // namespace cuber::gl3
@@ -1,40 +1,118 @@
 #include "Animation.h"
+#include "AnimationClock.h"
+#include "BvhTracks.h"
+#include <algorithm>
 #include <asio.hpp>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <list>
+#include <mutex>
 
+// back to back ticks after a stall. older deadlines are dropped
+const uint64_t MAX_CATCH_UP = 4;
+
+///
+/// the timer (own steady_timer or a shared AnimationClock) fires at absolute
+/// deadlines startTime_ + n * interval_, so
+/// callback time and wakeup latency do not add up as drift. a tick plays
+/// the clip at its scheduled time, not at the wakeup time.
+///
 struct AnimationImpl {
+  using Clock = std::chrono::steady_clock;
   asio::io_context &io_;
   std::shared_ptr<asio::steady_timer> timer_;
+  // instead of timer_ when shared
+  std::shared_ptr<AnimationClock> clock_;
+  uint32_t clockId_ = 0;
+  // Stop runs on the gui thread, the ticks on the io thread
+  std::atomic<bool> running_ = false;
+  // false once destroyed. a clock func or posted handler that still runs
+  // (AnimationClock::Remove lets a collected func run once) checks it
+  // before touching this
+  std::shared_ptr<std::atomic<bool>> alive_ =
+      std::make_shared<std::atomic<bool>>(true);
 
-  std::chrono::steady_clock::time_point startTime_;
+  Clock::time_point startTime_;
+  std::chrono::nanoseconds interval_ = {};
+  // index of the next deadline
+  uint64_t tick_ = 0;
+  AnimationLatePolicy latePolicy_ = AnimationLatePolicy::CatchUp;
+  mutable std::mutex statsMutex_;
+  AnimationStats stats_;
   std::shared_ptr<Bvh> bvh_;
   std::list<Animation::OnFrameFunc> onFrameCallbacks_;
+  // 0: clip rate, nearest frame
+  float outputRate_ = 0;
+  std::shared_ptr<BvhPose> pose_;
+
+  AnimationImpl(asio::io_context &io,
+                const std::shared_ptr<AnimationClock> &clock)
+      : io_(io), clock_(clock) {
+    if (clock_) {
+      clockId_ = clock_->Add([self = this, alive = alive_]() {
+        if (!alive->load() || !self->running_) {
+          return;
+        }
+        self->OnTimer();
+        self->AsyncWait();
+      });
+    }
+  }
 
-  AnimationImpl(asio::io_context &io) : io_(io) {}
+  ~AnimationImpl() {
+    alive_->store(false);
+    Stop();
+    if (clock_) {
+      clock_->Remove(clockId_);
+    }
+  }
 
   void Stop() {
+    running_ = false;
+    if (clock_) {
+      clock_->Cancel(clockId_);
+    }
     if (timer_) {
       timer_->cancel();
       timer_.reset();
     }
   }
 
-  void BeginTimer(std::chrono::nanoseconds interval) {
-    startTime_ = std::chrono::steady_clock::now();
-    timer_ = std::shared_ptr<asio::steady_timer>(new asio::steady_timer(io_));
-    AsyncWait(interval);
+  // start: time of tick 0. tick: the first one to play
+  void BeginTimer(std::chrono::nanoseconds interval, Clock::time_point start,
+                  uint64_t tick) {
+    startTime_ = start;
+    interval_ = std::max(interval, std::chrono::nanoseconds(1));
+    tick_ = tick;
+    running_ = true;
+    if (!clock_) {
+      timer_ = std::shared_ptr<asio::steady_timer>(new asio::steady_timer(io_));
+    }
+    AsyncWait();
+  }
+
+  Clock::time_point Deadline(uint64_t tick) const {
+    return startTime_ + interval_ * static_cast<int64_t>(tick);
   }
 
-  void AsyncWait(std::chrono::nanoseconds interval) {
-    if (auto timer = timer_) {
+  void AsyncWait() {
+    if (clock_) {
+      if (running_) {
+        clock_->Schedule(clockId_, Deadline(tick_));
+      }
+    } else if (auto timer = timer_) {
       try {
-        timer->expires_after(interval);
-        timer->async_wait([self = this, interval](const std::error_code &) {
-          self->Update();
-          self->AsyncWait(interval);
+        timer->expires_at(Deadline(tick_));
+        timer->async_wait([self = this, timer,
+                           alive = alive_](const std::error_code &ec) {
+          if (ec || !alive->load() || self->timer_ != timer) {
+            // canceled
+            return;
+          }
+          self->OnTimer();
+          self->AsyncWait();
         });
       } catch (std::exception const &e) {
         std::cout << "AsyncWait catch: " << e.what() << std::endl;
@@ -42,13 +120,88 @@ struct AnimationImpl {
     }
   }
 
-  void Update() {
-    auto elapsed = std::chrono::steady_clock::now() - startTime_;
-    auto index = bvh_->TimeToIndex(elapsed);
-    auto frame = bvh_->GetFrame(index);
+  void OnTimer() {
+    auto now = Clock::now();
+    // the last deadline that has passed
+    auto due = static_cast<uint64_t>((now - startTime_) / interval_);
+    if (due < tick_) {
+      // woke up early
+      due = tick_;
+    }
+    auto behind = due - tick_;
+    uint64_t run = 1;
+    if (latePolicy_ == AnimationLatePolicy::CatchUp) {
+      run += std::min(behind, MAX_CATCH_UP);
+    }
+    auto first = due + 1 - run;
+    {
+      std::lock_guard<std::mutex> lock(statsMutex_);
+      stats_.missed += first - tick_;
+      stats_.caughtUp += run - 1;
+    }
+
+    for (auto tick = first; tick <= due; ++tick) {
+      auto begin = Clock::now();
+      Update(tick);
+      auto end = Clock::now();
+
+      std::lock_guard<std::mutex> lock(statsMutex_);
+      ++stats_.ticks;
+      auto late = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          begin - Deadline(tick));
+      stats_.lateMax = std::max(stats_.lateMax, late);
+      size_t bucket = 0;
+      while (bucket < std::size(AnimationStats::LATE_BOUNDS_US) &&
+             late >= std::chrono::microseconds(
+                         AnimationStats::LATE_BOUNDS_US[bucket])) {
+        ++bucket;
+      }
+      ++stats_.late[bucket];
+      auto duration =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+      stats_.callbackTotal += duration;
+      stats_.callbackMax = std::max(stats_.callbackMax, duration);
+    }
+    tick_ = due + 1;
+  }
+
+  std::chrono::nanoseconds Interval() const {
+    if (outputRate_ > 0) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::duration<double>(1.0 / outputRate_));
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        bvh_->frame_time);
+  }
+
+  // the frame of a tick. at clip rate tick n is frame n: float time and the
+  // ns rounding of interval_ would land next to the frame boundary and
+  // repeat or skip frames
+  int FrameIndex(uint64_t tick) const {
+    if (outputRate_ > 0) {
+      return bvh_->TimeToIndex(interval_ * static_cast<int64_t>(tick));
+    }
+    return static_cast<int>(tick % bvh_->FrameCount());
+  }
+
+  void Update(uint64_t tick) {
+    if (bvh_->FrameCount() == 0) {
+      return;
+    }
+    BvhFrame frame;
+    if (outputRate_ > 0) {
+      frame = bvh_->Sample(interval_ * static_cast<int64_t>(tick), pose_);
+    } else {
+      frame = bvh_->GetFrame(FrameIndex(tick));
+      frame.time = bvh_->frame_time * static_cast<float>(tick);
+    }
     for (auto &callback : onFrameCallbacks_) {
       callback(frame);
     }
+    if (bvh_->lazy_frames) {
+      // decode the next ticks now, after this one went out
+      bvh_->ReadAhead(FrameIndex(tick + 1));
+    }
   }
 
   void SetBvh(const std::shared_ptr<Bvh> &bvh) {
@@ -57,15 +210,72 @@ struct AnimationImpl {
       return;
     }
 
-    BeginTimer(
-        std::chrono::duration_cast<std::chrono::nanoseconds>(bvh_->frame_time));
+    // frame 0 plays now
+    BeginTimer(Interval(), Clock::now(), 0);
+  }
+
+  void SetOutputRate(float hz) {
+    outputRate_ = std::max(0.0f, hz);
+    if (bvh_ && running_) {
+      // keep the playback position. the next deadline of the new rate
+      auto start = startTime_;
+      auto interval = std::max(Interval(), std::chrono::nanoseconds(1));
+      auto tick = (Clock::now() - start) / interval + 1;
+      Stop();
+      BeginTimer(interval, start, static_cast<uint64_t>(tick));
+    }
+  }
+
+  void SetLiveBvh(const std::shared_ptr<Bvh> &bvh) {
+    Stop();
+    bvh_ = bvh;
+  }
+
+  void PushFrame(const BvhFrame &frame) {
+    // frame.storage keeps the values alive until the callbacks ran
+    asio::post(io_, [self = this, alive = alive_, frame]() {
+      if (!alive->load()) {
+        return;
+      }
+      for (auto &callback : self->onFrameCallbacks_) {
+        callback(frame);
+      }
+    });
   }
 };
 
-Animation::Animation(asio::io_context &io) : impl_(new AnimationImpl(io)) {}
+Animation::Animation(asio::io_context &io,
+                     const std::shared_ptr<AnimationClock> &clock)
+    : impl_(new AnimationImpl(io, clock)) {}
 Animation::~Animation() { delete (impl_); }
 void Animation::SetBvh(const std::shared_ptr<Bvh> &bvh) { impl_->SetBvh(bvh); }
+void Animation::SetLiveBvh(const std::shared_ptr<Bvh> &bvh) {
+  impl_->SetLiveBvh(bvh);
+}
+void Animation::PushFrame(const BvhFrame &frame) { impl_->PushFrame(frame); }
 void Animation::OnFrame(const OnFrameFunc &onFrame) {
   impl_->onFrameCallbacks_.push_back(onFrame);
 }
 void Animation::Stop() { impl_->Stop(); }
+void Animation::SetOutputRate(float hz) {
+  asio::post(impl_->io_, [impl = impl_, alive = impl_->alive_, hz]() {
+    if (alive->load()) {
+      impl->SetOutputRate(hz);
+    }
+  });
+}
+void Animation::SetLatePolicy(AnimationLatePolicy policy) {
+  asio::post(impl_->io_, [impl = impl_, alive = impl_->alive_, policy]() {
+    if (alive->load()) {
+      impl->latePolicy_ = policy;
+    }
+  });
+}
+AnimationStats Animation::GetStats() const {
+  std::lock_guard<std::mutex> lock(impl_->statsMutex_);
+  return impl_->stats_;
+}
+void Animation::ResetStats() {
+  std::lock_guard<std::mutex> lock(impl_->statsMutex_);
+  impl_->stats_ = {};
+}
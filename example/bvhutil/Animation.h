@@ -3,12 +3,45 @@
 #include <grapho/dxmath_stub.h>
 #include <chrono>
 #include <functional>
+#include <iterator>
+#include <stdint.h>
 #include <span>
 #include <string_view>
 
 namespace asio {
 class io_context;
 } // namespace asio
+class AnimationClock;
+
+// what the timer does when it wakes up after one or more later deadlines
+enum class AnimationLatePolicy {
+  // run the missed ticks back to back (at most 4 extra), drop the rest
+  CatchUp,
+  // run one tick and skip to the next deadline in the future
+  Drop,
+};
+
+struct AnimationStats {
+  // tick lateness (actual - scheduled) histogram. upper bounds in
+  // microseconds, the last bucket holds everything later
+  static constexpr int64_t LATE_BOUNDS_US[] = {50,   100,  250,  500,
+                                               1000, 2000, 4000, 8000};
+  static constexpr size_t LATE_BUCKETS = std::size(LATE_BOUNDS_US) + 1;
+  uint64_t late[LATE_BUCKETS] = {};
+  std::chrono::nanoseconds lateMax = {};
+  uint64_t ticks = 0;
+  // ticks run behind schedule, back to back
+  uint64_t caughtUp = 0;
+  // deadlines skipped
+  uint64_t missed = 0;
+  std::chrono::nanoseconds callbackTotal = {};
+  std::chrono::nanoseconds callbackMax = {};
+
+  std::chrono::nanoseconds CallbackMean() const {
+    return ticks ? callbackTotal / static_cast<int64_t>(ticks)
+                 : std::chrono::nanoseconds{};
+  }
+};
 
 class Animation {
   struct AnimationImpl *impl_ = nullptr;
@@ -16,9 +49,27 @@ class Animation {
 public:
   using OnFrameFunc = std::function<void(const BvhFrame &frame)>;
 
-  Animation(asio::io_context &io);
+  // clock: share one timer wheel with other animations. null for an own
+  // steady_timer
+  Animation(asio::io_context &io,
+            const std::shared_ptr<AnimationClock> &clock = {});
   ~Animation();
   void SetBvh(const std::shared_ptr<Bvh> &bvh);
+  // no timer. frames come from PushFrame (BvhStreamParser)
+  void SetLiveBvh(const std::shared_ptr<Bvh> &bvh);
+  // thread safe. OnFrame callbacks run on the io_context
+  void PushFrame(const BvhFrame &frame);
   void OnFrame(const OnFrameFunc &onFrame);
+  // frames per second sent to OnFrame. 0 (default) ticks at the clip
+  // frame_time, tick n plays frame n % FrameCount from frame 0 on (time:
+  // frame_time * n). any other rate interpolates between
+  // frames (Bvh::Sample), which needs Bvh::BuildTracks. a lazy clip has no
+  // tracks and plays the frame at each tick.
+  void SetOutputRate(float hz);
+  // default CatchUp
+  void SetLatePolicy(AnimationLatePolicy policy);
+  // thread safe copy
+  AnimationStats GetStats() const;
+  void ResetStats();
   void Stop();
 };
@@ -0,0 +1,242 @@
+#include "AnimationClock.h"
+#include <algorithm>
+#include <bit>
+
+AnimationClock::AnimationClock(asio::io_context& io,
+                               std::chrono::nanoseconds resolution)
+  : io_(io)
+  , timer_(std::make_shared<asio::steady_timer>(io))
+  , alive_(std::make_shared<std::atomic<bool>>(true))
+  , origin_(Clock::now())
+  , resolution_(std::max(resolution, std::chrono::nanoseconds(1)))
+{
+}
+
+AnimationClock::~AnimationClock()
+{
+  // a handler already queued (the timer fired, a rearm posted) sees alive
+  // false and does not touch this
+  alive_->store(false);
+  timer_->cancel();
+}
+
+uint32_t
+AnimationClock::Add(const WakeFunc& func)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint32_t id;
+  if (free_.empty()) {
+    id = static_cast<uint32_t>(entries_.size());
+    entries_.push_back({});
+  } else {
+    id = free_.back();
+    free_.pop_back();
+  }
+  auto& entry = entries_[id];
+  entry.func = func;
+  entry.used = true;
+  return id;
+}
+
+void
+AnimationClock::Remove(uint32_t id)
+{
+  Cancel(id);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& entry = entries_[id];
+  if (!entry.used) {
+    return;
+  }
+  entry.used = false;
+  entry.func = {};
+  free_.push_back(id);
+}
+
+void
+AnimationClock::Schedule(uint32_t id, Clock::time_point deadline)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& entry = entries_[id];
+  if (!entry.used) {
+    return;
+  }
+  // round up. a tick never runs before its deadline
+  auto since = deadline - origin_;
+  entry.due = since.count() > 0
+                ? static_cast<uint64_t>((since + resolution_ -
+                                         std::chrono::nanoseconds(1)) /
+                                        resolution_)
+                : 0;
+  if (!entry.armed) {
+    entry.armed = true;
+    ++armed_;
+  }
+  ++entry.seq;
+  Insert(id);
+
+  if (!dispatching_ && !rearmPosted_ && std::max(entry.due, current_) < wake_) {
+    // the timer belongs to the io_context thread
+    rearmPosted_ = true;
+    asio::post(io_, [self = this, alive = alive_]() {
+      if (!alive->load()) {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(self->mutex_);
+      self->rearmPosted_ = false;
+      self->Rearm();
+    });
+  }
+}
+
+void
+AnimationClock::Cancel(uint32_t id)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& entry = entries_[id];
+  if (!entry.armed) {
+    return;
+  }
+  // the slot item goes stale. the timer may still wake once for it
+  entry.armed = false;
+  ++entry.seq;
+  --armed_;
+}
+
+AnimationClock::Stats
+AnimationClock::GetStats()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void
+AnimationClock::Insert(uint32_t id)
+{
+  auto& entry = entries_[id];
+  auto due = std::max(entry.due, current_);
+  auto delta = due - current_;
+  uint32_t level = 0;
+  while (level + 1 < LEVELS && delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+    ++level;
+  }
+  auto shift = SLOT_BITS * level;
+  uint64_t slot;
+  if (delta >> (SLOT_BITS * LEVELS)) {
+    // beyond the wheel. park in the farthest top slot, the cascade
+    // re-inserts it
+    slot = ((current_ >> shift) + SLOTS - 1) & (SLOTS - 1);
+  } else {
+    slot = (due >> shift) & (SLOTS - 1);
+  }
+  levels_[level].slots[slot].push_back({ id, entry.seq });
+  levels_[level].occupied |= 1ull << slot;
+}
+
+uint64_t
+AnimationClock::NextTick() const
+{
+  if (armed_ == 0) {
+    return UINT64_MAX;
+  }
+  auto pos = current_ & (SLOTS - 1);
+  if (pos == 0) {
+    // cascade point
+    return current_;
+  }
+  if (auto bits = levels_[0].occupied >> pos) {
+    return current_ + std::countr_zero(bits);
+  }
+  // the rest is on the next rotation or on upper levels
+  return (current_ | (SLOTS - 1)) + 1;
+}
+
+void
+AnimationClock::Advance(uint64_t now)
+{
+  for (auto tick = NextTick(); tick <= now; tick = NextTick()) {
+    current_ = tick;
+    // upper levels first. their items land on the levels below
+    for (auto level = LEVELS - 1; level > 0; --level) {
+      auto shift = SLOT_BITS * level;
+      if (current_ & ((1ull << shift) - 1)) {
+        continue;
+      }
+      auto slot = (current_ >> shift) & (SLOTS - 1);
+      cascade_.swap(levels_[level].slots[slot]);
+      levels_[level].occupied &= ~(1ull << slot);
+      for (auto [id, seq] : cascade_) {
+        if (entries_[id].armed && entries_[id].seq == seq) {
+          Insert(id);
+        }
+      }
+      cascade_.clear();
+    }
+
+    auto slot = current_ & (SLOTS - 1);
+    cascade_.swap(levels_[0].slots[slot]);
+    levels_[0].occupied &= ~(1ull << slot);
+    for (auto [id, seq] : cascade_) {
+      auto& entry = entries_[id];
+      if (!entry.armed || entry.seq != seq) {
+        continue;
+      }
+      if (entry.due > current_) {
+        // parked beyond the wheel
+        Insert(id);
+        continue;
+      }
+      entry.armed = false;
+      --armed_;
+      batch_.push_back(entry.func);
+    }
+    cascade_.clear();
+    ++current_;
+  }
+  current_ = std::max(current_, now + 1);
+}
+
+void
+AnimationClock::Rearm()
+{
+  wake_ = NextTick();
+  if (wake_ == UINT64_MAX) {
+    timer_->cancel();
+    return;
+  }
+  timer_->expires_at(origin_ + resolution_ * static_cast<int64_t>(wake_));
+  timer_->async_wait(
+    [self = this, timer = timer_, alive = alive_](const std::error_code& ec) {
+      if (ec || !alive->load()) {
+        // canceled, re-armed or destroyed
+        return;
+      }
+      self->OnWake();
+    });
+}
+
+void
+AnimationClock::OnWake()
+{
+  std::vector<WakeFunc> batch;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = static_cast<uint64_t>((Clock::now() - origin_) / resolution_);
+    Advance(now);
+    ++stats_.wakeups;
+    stats_.dispatched += batch_.size();
+    stats_.batchMax = std::max<uint64_t>(stats_.batchMax, batch_.size());
+    batch.swap(batch_);
+    dispatching_ = true;
+  }
+  // the same wakeup for every tick due in this slot
+  for (auto& func : batch) {
+    func();
+  }
+  batch.clear();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  dispatching_ = false;
+  // keep the capacity for the next wakeup
+  batch_.swap(batch);
+  Rearm();
+}
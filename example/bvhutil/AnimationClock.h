@@ -0,0 +1,118 @@
+#pragma once
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+///
+/// one steady_timer for many animations.
+///
+/// deadlines are rounded up to resolution and kept in a hierarchical timer
+/// wheel: 4 levels of 64 slots, each level 64 times coarser than the one
+/// below. entries on the upper levels are cascaded down as time reaches
+/// their slot. everything due in the same level 0 slot is dispatched from a
+/// single wakeup, so animations at the same (or a related) rate share their
+/// ticks instead of each arming a timer.
+///
+/// entries are one-shot. a WakeFunc usually calls Schedule again for its
+/// next deadline. WakeFuncs run on the io_context, outside of the lock.
+/// destroy the clock on the io_context thread, or once it has stopped.
+///
+class AnimationClock
+{
+public:
+  using Clock = std::chrono::steady_clock;
+  using WakeFunc = std::function<void()>;
+
+  struct Stats
+  {
+    uint64_t wakeups = 0;
+    // WakeFuncs called
+    uint64_t dispatched = 0;
+    // largest number of WakeFuncs dispatched by one wakeup
+    uint64_t batchMax = 0;
+  };
+
+private:
+  static constexpr uint32_t SLOT_BITS = 6;
+  static constexpr uint32_t SLOTS = 1 << SLOT_BITS;
+  static constexpr uint32_t LEVELS = 4;
+
+  struct Entry
+  {
+    WakeFunc func;
+    // in resolution ticks since origin_
+    uint64_t due = 0;
+    // bumped by Schedule, Cancel and Remove. stale slot items are skipped
+    uint32_t seq = 0;
+    bool armed = false;
+    bool used = false;
+  };
+  struct Item
+  {
+    uint32_t id;
+    uint32_t seq;
+  };
+  struct Level
+  {
+    std::vector<Item> slots[SLOTS];
+    // non empty slots. may be stale after Cancel
+    uint64_t occupied = 0;
+  };
+
+  asio::io_context& io_;
+  std::shared_ptr<asio::steady_timer> timer_;
+  // cleared by the destructor. posted and timer handlers hold only this
+  std::shared_ptr<std::atomic<bool>> alive_;
+  Clock::time_point origin_;
+  std::chrono::nanoseconds resolution_;
+
+  std::mutex mutex_;
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> free_;
+  Level levels_[LEVELS];
+  // every tick before current_ has been dispatched
+  uint64_t current_ = 0;
+  uint32_t armed_ = 0;
+  // tick the timer waits for. UINT64_MAX when idle
+  uint64_t wake_ = UINT64_MAX;
+  bool dispatching_ = false;
+  bool rearmPosted_ = false;
+  Stats stats_;
+  // scratch for Advance
+  std::vector<Item> cascade_;
+  std::vector<WakeFunc> batch_;
+
+public:
+  AnimationClock(const AnimationClock&) = delete;
+  AnimationClock& operator=(const AnimationClock&) = delete;
+  explicit AnimationClock(
+    asio::io_context& io,
+    std::chrono::nanoseconds resolution = std::chrono::milliseconds(1));
+  ~AnimationClock();
+  std::chrono::nanoseconds Resolution() const { return resolution_; }
+  // thread safe. the returned id is not scheduled yet
+  uint32_t Add(const WakeFunc& func);
+  // thread safe. func is not called by a later wakeup. a wakeup that has
+  // already collected func still calls it: when Remove is called from
+  // another WakeFunc of the same batch or from another thread during a
+  // dispatch, func may run once after Remove returns
+  void Remove(uint32_t id);
+  // thread safe. (re)arm id to run once at or after deadline
+  void Schedule(uint32_t id, Clock::time_point deadline);
+  void Cancel(uint32_t id);
+  Stats GetStats();
+
+private:
+  void Insert(uint32_t id);
+  void Advance(uint64_t now);
+  // next tick with something to do, UINT64_MAX when the wheel is empty
+  uint64_t NextTick() const;
+  // lock held
+  void Rearm();
+  void OnWake();
+};
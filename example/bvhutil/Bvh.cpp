@@ -1,148 +1,22 @@
 #include "Bvh.h"
-#include "ReadAllBytes.h"
+#include "BvhCache.h"
+#include "BvhLazyFrames.h"
+#include "BvhMotion.h"
+#include "BvhTracks.h"
+#include "BvhTokenizer.h"
+#include "MappedFile.h"
 #include <assert.h>
-#include <cctype>
-#include <charconv>
 #include <cmath>
-#include <functional>
+#include <filesystem>
 #include <iostream>
 #include <optional>
 #include <stack>
-#include <stdlib.h>
-
-template<typename T>
-std::optional<T>
-to_num(std::string_view view)
-{
-#ifdef _MSC_VER
-  T value;
-  auto [ptr, ec] =
-    std::from_chars(view.data(), view.data() + view.size(), value);
-  if (ec == std::errc{}) {
-    return value;
-  } else {
-    return {};
-  }
-#else
-  // slow !
-  // return std::stof(view.data());
-  auto end = (char*)view.data() + view.size();
-  return (float)strtod(view.data(), &end);
-#endif
-}
-
-using It = std::string_view::iterator;
-struct Result
-{
-  It end;
-  It next;
-};
-using Delimiter = std::function<std::optional<Result>(It, It)>;
-
-class Tokenizer
-{
-  std::string_view m_data;
-  std::string_view::iterator m_pos;
-
-public:
-  Tokenizer(std::string_view data)
-    : m_data(data)
-  {
-    m_pos = m_data.begin();
-  }
-
-  std::optional<std::string_view> token(const Delimiter& delimiter)
-  {
-    auto begin = m_pos;
-
-    auto end = begin;
-
-    for (; end != m_data.end(); ++end) {
-      if (auto found = delimiter(end, m_data.end())) {
-        auto [tail, next] = *found;
-        m_pos = next;
-        return std::string_view(begin, tail);
-      }
-    }
-
-    return {};
-  }
-
-  bool expect(std::string_view expected, const Delimiter& delimiter)
-  {
-    if (auto line = token(delimiter)) {
-      if (*line == expected) {
-        return true;
-      }
-    }
-    return false;
-  }
-
-  template<typename T>
-  std::optional<T> number(const Delimiter& delimiter)
-  {
-    auto n = token(delimiter);
-    if (!n) {
-      return {};
-    }
-    if (auto value = to_num<T>(*n)) {
-      return *value;
-    } else {
-      return {};
-    }
-  }
-};
-
-static std::optional<Result>
-is_space(It it, It end)
-{
-  if (!std::isspace(*it)) {
-    return {};
-  }
-  auto tail = it;
-  ++it;
-  for (; it != end; ++it) {
-    if (!std::isspace(*it)) {
-      break;
-    }
-  }
-  return Result{ tail, it };
-}
-
-static std::optional<Result>
-get_eol(It it, It end)
-{
-  if (*it != '\n') {
-    return {};
-  }
-  auto tail = it;
-  ++it;
-  return Result{ tail, it };
-}
-
-static std::optional<Result>
-get_name(It it, It end)
-{
-  if (*it != '\n') {
-    return {};
-  }
-  auto tail = it;
-  ++it;
-  // head space
-  for (; it != end; ++it) {
-    if (!std::isspace(*it)) {
-      break;
-    }
-  }
-  return Result{ tail, it };
-}
 
 struct BvhImpl
 {
   Tokenizer token_;
   std::vector<BvhJoint>& joints_;
   std::vector<BvhJoint>& endsites_;
-  std::vector<float>& frames_;
   uint32_t frame_count_ = 0;
   BvhTime frame_time_ = {};
   uint32_t channel_count_ = 0;
@@ -150,20 +24,19 @@ struct BvhImpl
 
   BvhImpl(std::vector<BvhJoint>& joints,
           std::vector<BvhJoint>& endsites,
-          std::vector<float>& frames,
           std::string_view src)
     : token_(src)
     , joints_(joints)
     , endsites_(endsites)
-    , frames_(frames)
   {
   }
 
   std::vector<int> stack_;
 
+  // HIERARCHY and the MOTION header. token_.rest() is the frame lines.
   bool Parse()
   {
-    if (!token_.expect("HIERARCHY", is_space)) {
+    if (!token_.expect<SpaceDelimiter>("HIERARCHY")) {
       return false;
     }
 
@@ -171,49 +44,31 @@ struct BvhImpl
       return false;
     }
 
-    if (!token_.expect("Frames:", is_space)) {
+    if (!token_.expect<SpaceDelimiter>("Frames:")) {
       return false;
     }
-    auto frames = token_.number<int>(is_space);
-    if (!frames) {
+    auto frames = token_.number<int, SpaceDelimiter>();
+    if (!frames || *frames < 0) {
       return false;
     }
     frame_count_ = *frames;
 
-    if (!token_.expect("Frame", is_space)) {
+    if (!token_.expect<SpaceDelimiter>("Frame")) {
       return false;
     }
-    if (!token_.expect("Time:", is_space)) {
+    if (!token_.expect<SpaceDelimiter>("Time:")) {
       return false;
     }
-    auto frameTime = token_.number<float>(is_space);
+    auto frameTime = token_.number<float, SpaceDelimiter>();
     if (!frameTime) {
       return false;
     }
     frame_time_ = BvhTime(*frameTime);
 
-    // each frame
     channel_count_ = 0;
     for (auto& joint : joints_) {
       channel_count_ += joint.channels.size();
     }
-    frames_.reserve(frame_count_ * channel_count_);
-    for (int i = 0; i < frame_count_; ++i) {
-      auto line = token_.token(get_eol);
-      if (!line) {
-        return false;
-      }
-
-      Tokenizer line_token(*line);
-      for (int j = 0; j < channel_count_; ++j) {
-        if (auto value = line_token.number<float>(is_space)) {
-          frames_.push_back(*value);
-        } else {
-          return false;
-        }
-      }
-    }
-    assert(frames_.size() == frame_count_ * channel_count_);
 
     return true;
   }
@@ -222,7 +77,7 @@ private:
   bool ParseJoint()
   {
     while (true) {
-      auto token = token_.token(is_space);
+      auto token = token_.token<SpaceDelimiter>();
       if (!token) {
         return false;
       }
@@ -235,7 +90,7 @@ private:
         // X {
         // }
         // }
-        auto name = token_.token(get_name);
+        auto name = token_.token<NameDelimiter>();
         if (!name) {
           return false;
         }
@@ -245,7 +100,7 @@ private:
         // }
         // std::cout << *name << std::endl;
 
-        if (!token_.expect("{", is_space)) {
+        if (!token_.expect<SpaceDelimiter>("{")) {
           return false;
         }
 
@@ -292,11 +147,11 @@ private:
         // {
         // OFFSET x y z
         // }
-        if (!token_.expect("Site", get_name)) {
+        if (!token_.expect<NameDelimiter>("Site")) {
           return false;
         }
 
-        if (!token_.expect("{", is_space)) {
+        if (!token_.expect<SpaceDelimiter>("{")) {
           return false;
         }
         auto offset = ParseOffset();
@@ -309,7 +164,7 @@ private:
           .localOffset = *offset,
         });
 
-        if (!token_.expect("}", is_space)) {
+        if (!token_.expect<SpaceDelimiter>("}")) {
           return false;
         }
       } else if (*token == "}") {
@@ -327,18 +182,18 @@ private:
 
   std::optional<BvhOffset> ParseOffset()
   {
-    if (!token_.expect("OFFSET", is_space)) {
+    if (!token_.expect<SpaceDelimiter>("OFFSET")) {
       return {};
     }
-    auto x = token_.number<float>(is_space);
+    auto x = token_.number<float, SpaceDelimiter>();
     if (!x) {
       return {};
     }
-    auto y = token_.number<float>(is_space);
+    auto y = token_.number<float, SpaceDelimiter>();
     if (!y) {
       return {};
     }
-    auto z = token_.number<float>(is_space);
+    auto z = token_.number<float, SpaceDelimiter>();
     if (!z) {
       return {};
     }
@@ -348,18 +203,18 @@ private:
 
   std::optional<BvhChannels> ParseChannels()
   {
-    if (!token_.expect("CHANNELS", is_space)) {
+    if (!token_.expect<SpaceDelimiter>("CHANNELS")) {
       return {};
     }
 
-    auto n = token_.number<int>(is_space);
+    auto n = token_.number<int, SpaceDelimiter>();
     if (!n) {
       return {};
     }
     auto channel_count = *n;
     auto channels = BvhChannels{};
     for (int i = 0; i < channel_count; ++i) {
-      if (auto channel = token_.token(is_space)) {
+      if (auto channel = token_.token<SpaceDelimiter>()) {
         if (*channel == "Xposition") {
           channels[i] = BvhChannelTypes::Xposition;
         } else if (*channel == "Yposition") {
@@ -377,39 +232,203 @@ private:
         }
       }
     }
+    channels.kernel = BvhFindKernel(channels);
     return channels;
   }
 };
 
 Bvh::Bvh() {}
 Bvh::~Bvh() {}
-bool
-Bvh::Parse(std::string_view src)
+std::optional<std::string_view>
+Bvh::ParseHierarchy(std::string_view src)
 {
-  BvhImpl parser(joints, endsites, frames, src);
+  BvhImpl parser(joints, endsites, src);
   if (!parser.Parse()) {
-    return false;
+    return {};
   }
   frame_time = parser.frame_time_;
   frame_channel_count = parser.channel_count_;
+  frame_count = parser.frame_count_;
   max_height = parser.max_height_;
+  return parser.token_.rest();
+}
+
+bool
+Bvh::Parse(std::string_view src, uint32_t threads)
+{
+  auto motion = ParseHierarchy(src);
+  if (!motion) {
+    return false;
+  }
+  frame_buffer.resize(size_t(frame_count) * frame_channel_count);
+  if (!ParseMotion(
+        *motion, frame_count, frame_channel_count, frame_buffer, threads)) {
+    return false;
+  }
+  frames = frame_buffer;
   return true;
 }
 
+BvhFrame
+Bvh::GetFrame(int index) const
+{
+  if (lazy_frames) {
+    auto values = lazy_frames->Get(index);
+    if (!values) {
+      return { .index = index, .time = frame_time * index };
+    }
+    return {
+      .index = index,
+      .time = frame_time * index,
+      .values = *values,
+      .storage = values,
+    };
+  }
+  auto begin = frames.data() + size_t(index) * frame_channel_count;
+  BvhFrame frame{
+    .index = index,
+    .time = frame_time * index,
+    .values = { begin, begin + frame_channel_count },
+  };
+  if (tracks && index < (int)tracks->frame_count) {
+    frame.rotations = tracks->Rotations(index);
+    frame.translations = tracks->Translations(index);
+  }
+  return frame;
+}
+
+void
+Bvh::ReadAhead(int index) const
+{
+  if (lazy_frames && index >= 0) {
+    lazy_frames->ReadAhead(static_cast<uint32_t>(index));
+  }
+}
+
+BvhFrame
+Bvh::Sample(BvhTime time, std::shared_ptr<BvhPose>& pose) const
+{
+  if (!tracks || tracks->frame_count == 0) {
+    return GetFrame(TimeToIndex(time));
+  }
+  auto position = time / frame_time;
+  auto base = std::floor(position);
+  auto count = static_cast<int64_t>(tracks->frame_count);
+  auto a = static_cast<int64_t>(base) % count;
+  if (a < 0) {
+    a += count;
+  }
+  auto b = a + 1 < count ? a + 1 : loop ? 0 : a;
+
+  if (!pose || pose.use_count() > 1) {
+    pose = std::make_shared<BvhPose>();
+  }
+  tracks->Blend(static_cast<uint32_t>(a),
+                static_cast<uint32_t>(b),
+                static_cast<float>(position - base),
+                *pose);
+  // raw values are the earlier frame
+  auto frame = GetFrame(static_cast<int>(a));
+  frame.time = time;
+  frame.rotations = pose->rotations;
+  frame.translations = pose->translations;
+  frame.storage = pose;
+  return frame;
+}
+
+bool
+Bvh::BuildTracks(uint32_t threads)
+{
+  auto built = BvhTracks::Build(*this, threads);
+  if (!built) {
+    return false;
+  }
+  tracks = built;
+  return true;
+}
+
+static std::shared_ptr<Bvh>
+LoadLazy(std::string_view file,
+         const std::shared_ptr<MappedFile>& mapping,
+         size_t cache_frames,
+         uint32_t readahead)
+{
+  std::cout << "load(lazy): " << file << " " << mapping->size() << "bytes"
+            << std::endl;
+
+  auto bvh = std::make_shared<Bvh>();
+  auto motion = bvh->ParseHierarchy(mapping->view());
+  if (!motion) {
+    return {};
+  }
+  auto lazy = std::make_shared<BvhLazyFrames>(mapping,
+                                              *motion,
+                                              bvh->frame_count,
+                                              bvh->frame_channel_count,
+                                              cache_frames,
+                                              readahead);
+  if (!lazy->BuildIndex()) {
+    return {};
+  }
+  bvh->frame_mapping = mapping;
+  bvh->lazy_frames = lazy;
+
+  std::cout << *bvh << std::endl;
+  return bvh;
+}
+
 std::shared_ptr<Bvh>
-Bvh::ParseFile(std::string_view file)
+Bvh::ParseFile(std::string_view file, uint32_t threads, uint64_t lazy_bytes)
 {
-  auto bytes = ReadAllBytes<char>(std::string(file.begin(), file.end()));
-  if (bytes.empty()) {
+  std::string path(file.begin(), file.end());
+  if (std::filesystem::path(path).extension() == ".bvhc") {
+    return LoadBvhCache(path, nullptr);
+  }
+
+  // parse directly from the page cache. no copy of the file.
+  auto mapping = std::make_shared<MappedFile>();
+  if (!mapping->Open(path)) {
     return {};
   }
-  std::cout << "load: " << file << " " << bytes.size() << "bytes" << std::endl;
+
+  auto key = BvhSourceKey::FromFile(path, *mapping);
+  auto cache = BvhCachePath(path);
+  if (key) {
+    if (auto bvh = LoadBvhCache(cache, &*key)) {
+      std::cout << "cache: " << cache << std::endl;
+      return bvh;
+    }
+  }
+
+  if (mapping->size() >= lazy_bytes) {
+    // bounded memory. the mapping stays, decoded frames are an LRU
+    return LoadLazy(file, mapping, 256, 32);
+  }
+  std::cout << "load: " << file << " " << mapping->size() << "bytes"
+            << std::endl;
 
   auto bvh = std::make_shared<Bvh>();
-  if (!bvh->Parse({ bytes.begin(), bytes.end() })) {
+  if (!bvh->Parse(mapping->view(), threads)) {
     return {};
   }
 
+  if (key) {
+    // best effort. the source directory may be read only
+    WriteBvhCache(*bvh, cache, *key);
+  }
+
   std::cout << *bvh << std::endl;
   return bvh;
 }
+
+std::shared_ptr<Bvh>
+Bvh::ParseFileLazy(std::string_view file,
+                   size_t cache_frames,
+                   uint32_t readahead)
+{
+  auto mapping = std::make_shared<MappedFile>();
+  if (!mapping->Open(std::string(file.begin(), file.end()))) {
+    return {};
+  }
+  return LoadLazy(file, mapping, cache_frames, readahead);
+}
@@ -4,6 +4,7 @@
 #include <chrono>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <span>
 #include <vector>
@@ -23,18 +24,55 @@ struct BvhJoint {
 //   return os;
 // }
 
+class MappedFile;
+class BvhLazyFrames;
+struct BvhTracks;
+struct BvhPose;
+
 struct Bvh {
   std::vector<BvhJoint> joints;
   std::vector<BvhJoint> endsites;
   BvhTime frame_time = {};
-  std::vector<float> frames;
+  // frame_buffer(text parse) or frame_mapping(.bvhc).
+  // empty when lazy_frames decodes on demand
+  std::span<const float> frames;
+  std::vector<float> frame_buffer;
+  std::shared_ptr<MappedFile> frame_mapping;
+  std::shared_ptr<BvhLazyFrames> lazy_frames;
+  // optional. see BuildTracks
+  std::shared_ptr<const BvhTracks> tracks;
   uint32_t frame_channel_count = 0;
+  uint32_t frame_count = 0;
   float max_height = 0;
+  // the last frame leads back into the first. Sample blends across the
+  // wrap only when set, otherwise it holds the last frame
+  bool loop = false;
+  Bvh(const Bvh &) = delete;
+  Bvh &operator=(const Bvh &) = delete;
   Bvh();
   ~Bvh();
-  static std::shared_ptr<Bvh> ParseFile(std::string_view file);
-  bool Parse(std::string_view src);
-  uint32_t FrameCount() const { return frames.size() / frame_channel_count; }
+  // a text source this large is loaded lazily (decoded it would take about
+  // half its size, 7 floats per joint more with BuildTracks)
+  static constexpr uint64_t LAZY_FILE_BYTES = 256ull * 1024 * 1024;
+  // threads: MOTION parser threads. 0 for hardware_concurrency
+  // file.bvhc is used and refreshed when it matches file.bvh. without one,
+  // a source of lazy_bytes or more is loaded by ParseFileLazy and not
+  // cached. UINT64_MAX: always decode
+  static std::shared_ptr<Bvh> ParseFile(std::string_view file,
+                                        uint32_t threads = 0,
+                                        uint64_t lazy_bytes = LAZY_FILE_BYTES);
+  // record line offsets only. GetFrame decodes into an LRU of cache_frames.
+  // BuildTracks fails and Sample plays the frame at TimeToIndex
+  static std::shared_ptr<Bvh> ParseFileLazy(std::string_view file,
+                                            size_t cache_frames = 256,
+                                            uint32_t readahead = 32);
+  bool Parse(std::string_view src, uint32_t threads = 0);
+  // HIERARCHY and the MOTION header. returns the frame lines
+  std::optional<std::string_view> ParseHierarchy(std::string_view src);
+  // precompute quaternion + translation tracks (BvhTracks) for playback.
+  // false if the frames are not decoded (lazy)
+  bool BuildTracks(uint32_t threads = 0);
+  uint32_t FrameCount() const { return frame_count; }
   const BvhJoint *GetParent(int parent) const {
     for (auto &joint : joints) {
       if (joint.parent == parent) {
@@ -51,14 +89,14 @@ struct Bvh {
     }
     return index;
   }
-  BvhFrame GetFrame(int index) const {
-    auto begin = frames.data() + index * frame_channel_count;
-    return {
-        .index = index,
-        .time = frame_time * index,
-        .values = {begin, begin + frame_channel_count},
-    };
-  }
+  BvhFrame GetFrame(int index) const;
+  // lazy: decode the frames from index on before they play. no-op otherwise
+  void ReadAhead(int index) const;
+  // frame at time (looped). with tracks the two neighbouring frames are
+  // blended into pose (the last one with frame 0 only if loop), otherwise
+  // the frame at TimeToIndex.
+  // pose is reused when no earlier frame still refers to it.
+  BvhFrame Sample(BvhTime time, std::shared_ptr<BvhPose> &pose) const;
   float GuessScaling() const {
     // guess bvh scale
     float scalingFactor = 1.0f;
@@ -0,0 +1,245 @@
+#include "BvhCache.h"
+#include "MappedFile.h"
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string.h>
+
+const uint64_t FRAMES_ALIGNMENT = 64;
+const size_t HASH_BLOCK = 64 * 1024;
+
+static uint64_t
+Fnv1a(uint64_t hash, const char* p, size_t size)
+{
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<uint8_t>(p[i]);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+std::optional<BvhSourceKey>
+BvhSourceKey::FromFile(const std::string& path, const MappedFile& mapping)
+{
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return {};
+  }
+  BvhSourceKey key{
+    .size = mapping.size(),
+    .mtime = static_cast<int64_t>(mtime.time_since_epoch().count()),
+  };
+  auto hash = Fnv1a(0xcbf29ce484222325, mapping.data(),
+                    std::min(mapping.size(), HASH_BLOCK));
+  if (mapping.size() > HASH_BLOCK) {
+    auto tail = std::max(HASH_BLOCK, mapping.size() - HASH_BLOCK);
+    hash = Fnv1a(hash, mapping.data() + tail, mapping.size() - tail);
+  }
+  key.hash = hash;
+  return key;
+}
+
+std::string
+BvhCachePath(std::string_view path)
+{
+  return std::filesystem::path(path).replace_extension(".bvhc").string();
+}
+
+static BvhCacheJoint
+ToCache(const BvhJoint& joint, uint32_t name_offset)
+{
+  BvhCacheJoint c{
+    .index = joint.index,
+    .parent = joint.parent,
+    .bone = static_cast<uint16_t>(joint.bone_),
+    .start_index = static_cast<uint32_t>(joint.channels.startIndex),
+    .name_offset = name_offset,
+    .name_size = static_cast<uint32_t>(joint.name.size()),
+    .local = { joint.localOffset.x, joint.localOffset.y, joint.localOffset.z },
+    .world = { joint.worldOffset.x, joint.worldOffset.y, joint.worldOffset.z },
+    .init = { joint.channels.init.x,
+              joint.channels.init.y,
+              joint.channels.init.z },
+  };
+  for (int i = 0; i < 6; ++i) {
+    c.types[i] = static_cast<uint8_t>(joint.channels.types[i]);
+  }
+  return c;
+}
+
+// Resolve and the solvers index frames and joints by these without checks
+static bool
+IsValid(const BvhCacheJoint& c, uint32_t i, const BvhCacheHeader& header)
+{
+  if (uint64_t(c.name_offset) + c.name_size > header.names_size) {
+    return false;
+  }
+  if (i >= header.joint_count) {
+    // end site of a joint
+    return c.parent < header.joint_count;
+  }
+  if (c.index != i || (i == 0 ? c.parent != 0xffff : c.parent >= i)) {
+    return false;
+  }
+  uint32_t count = 0;
+  for (auto type : c.types) {
+    if (type > static_cast<uint8_t>(BvhChannelTypes::Zrotation)) {
+      return false;
+    }
+    if (type == static_cast<uint8_t>(BvhChannelTypes::None)) {
+      break;
+    }
+    ++count;
+  }
+  return uint64_t(c.start_index) + count <= header.channel_count;
+}
+
+static BvhJoint
+FromCache(const BvhCacheJoint& c, std::string_view names)
+{
+  BvhJoint joint{
+    .name = std::string(names.substr(c.name_offset, c.name_size)),
+    .index = c.index,
+    .parent = c.parent,
+    .localOffset = { c.local[0], c.local[1], c.local[2] },
+    .worldOffset = { c.world[0], c.world[1], c.world[2] },
+    .bone_ = static_cast<srht::HumanoidBones>(c.bone),
+  };
+  joint.channels.init = { c.init[0], c.init[1], c.init[2] };
+  joint.channels.startIndex = c.start_index;
+  for (int i = 0; i < 6; ++i) {
+    joint.channels.types[i] = static_cast<BvhChannelTypes>(c.types[i]);
+  }
+  joint.channels.kernel = BvhFindKernel(joint.channels);
+  return joint;
+}
+
+bool
+WriteBvhCache(const Bvh& bvh, const std::string& path, const BvhSourceKey& key)
+{
+  if (bvh.frames.size() != size_t(bvh.frame_count) * bvh.frame_channel_count) {
+    // not decoded (lazy)
+    return false;
+  }
+  BvhCacheHeader header{
+    .source_size = key.size,
+    .source_mtime = key.mtime,
+    .source_hash = key.hash,
+    .joint_count = static_cast<uint32_t>(bvh.joints.size()),
+    .endsite_count = static_cast<uint32_t>(bvh.endsites.size()),
+    .frame_count = bvh.FrameCount(),
+    .channel_count = bvh.frame_channel_count,
+    .frame_time = bvh.frame_time.count(),
+    .max_height = bvh.max_height,
+  };
+
+  std::vector<BvhCacheJoint> joints;
+  std::string names;
+  for (auto list : { &bvh.joints, &bvh.endsites }) {
+    for (auto& joint : *list) {
+      joints.push_back(ToCache(joint, static_cast<uint32_t>(names.size())));
+      names += joint.name;
+    }
+  }
+  header.names_offset =
+    sizeof(BvhCacheHeader) + joints.size() * sizeof(BvhCacheJoint);
+  header.names_size = names.size();
+  auto names_end = header.names_offset + header.names_size;
+  header.frames_offset = (names_end + FRAMES_ALIGNMENT - 1) /
+                         FRAMES_ALIGNMENT * FRAMES_ALIGNMENT;
+
+  // write aside and rename. a reader never sees a partial cache. the name is
+  // per writer, two processes caching the same file do not share it
+  auto tmp = path + "." + std::to_string(std::random_device{}()) + ".tmp";
+  {
+    std::ofstream os(tmp, std::ios::binary);
+    if (!os) {
+      return false;
+    }
+    os.write((const char*)&header, sizeof(header));
+    os.write((const char*)joints.data(), joints.size() * sizeof(joints[0]));
+    os.write(names.data(), names.size());
+    static const char padding[FRAMES_ALIGNMENT] = {};
+    os.write(padding, header.frames_offset - names_end);
+    os.write((const char*)bvh.frames.data(),
+             uint64_t(header.frame_count) * header.channel_count *
+               sizeof(float));
+    if (!os) {
+      os.close();
+      std::error_code ec;
+      std::filesystem::remove(tmp, ec);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<Bvh>
+LoadBvhCache(const std::string& path, const BvhSourceKey* key)
+{
+  auto mapping = std::make_shared<MappedFile>();
+  if (!mapping->Open(path, false)) {
+    return {};
+  }
+  if (mapping->size() < sizeof(BvhCacheHeader)) {
+    return {};
+  }
+  BvhCacheHeader header;
+  memcpy(&header, mapping->data(), sizeof(header));
+  BvhCacheHeader expected;
+  if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+      header.version != expected.version ||
+      header.byte_order != expected.byte_order) {
+    return {};
+  }
+  if (key && !(BvhSourceKey{ header.source_size,
+                             header.source_mtime,
+                             header.source_hash } == *key)) {
+    return {};
+  }
+  auto joints_size = (uint64_t(header.joint_count) + header.endsite_count) *
+                     sizeof(BvhCacheJoint);
+  auto frames_size =
+    uint64_t(header.frame_count) * header.channel_count * sizeof(float);
+  // subtractions, a corrupt offset does not wrap
+  if (header.joint_count == 0 || header.channel_count == 0 ||
+      sizeof(BvhCacheHeader) + joints_size > header.names_offset ||
+      header.names_offset > header.frames_offset ||
+      header.names_size > header.frames_offset - header.names_offset ||
+      header.frames_offset % FRAMES_ALIGNMENT ||
+      header.frames_offset > mapping->size() ||
+      frames_size > mapping->size() - header.frames_offset) {
+    return {};
+  }
+
+  auto bvh = std::make_shared<Bvh>();
+  auto joints = (const BvhCacheJoint*)(mapping->data() + sizeof(header));
+  std::string_view names(mapping->data() + header.names_offset,
+                         header.names_size);
+  for (uint32_t i = 0; i < header.joint_count + header.endsite_count; ++i) {
+    if (!IsValid(joints[i], i, header)) {
+      return {};
+    }
+    auto joint = FromCache(joints[i], names);
+    if (i < header.joint_count) {
+      bvh->joints.push_back(joint);
+    } else {
+      bvh->endsites.push_back(joint);
+    }
+  }
+  bvh->frame_time = BvhTime(header.frame_time);
+  bvh->frame_channel_count = header.channel_count;
+  bvh->frame_count = header.frame_count;
+  bvh->max_height = header.max_height;
+  bvh->frames = { (const float*)(mapping->data() + header.frames_offset),
+                  size_t(header.frame_count) * header.channel_count };
+  bvh->frame_mapping = mapping;
+  return bvh;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "Bvh.h"
+#include <memory>
+#include <optional>
+#include <stdint.h>
+#include <string>
+
+class MappedFile;
+
+///
+/// .bvhc: binary cache of a parsed bvh.
+///
+/// [BvhCacheHeader]
+/// [BvhCacheJoint x (joint_count + endsite_count)]
+/// [names]
+/// [padding to 64]
+/// [float x frame_count x channel_count]
+///
+/// loading is a mmap and a header check. Bvh::frames points into the
+/// mapping.
+///
+struct BvhCacheHeader
+{
+  char magic[8] = { 'B', 'V', 'H', 'C', 'A', 'C', 'H', 'E' };
+  uint32_t version = 1;
+  // 0x01020304 in the writer byte order
+  uint32_t byte_order = 0x01020304;
+  // source file key
+  uint64_t source_size = 0;
+  int64_t source_mtime = 0;
+  uint64_t source_hash = 0;
+
+  uint32_t joint_count = 0;
+  uint32_t endsite_count = 0;
+  uint32_t frame_count = 0;
+  uint32_t channel_count = 0;
+  float frame_time = 0;
+  float max_height = 0;
+  uint64_t names_offset = 0;
+  uint64_t names_size = 0;
+  uint64_t frames_offset = 0;
+};
+static_assert(sizeof(BvhCacheHeader) == 88, "BvhCacheHeader");
+
+struct BvhCacheJoint
+{
+  uint16_t index;
+  uint16_t parent;
+  uint16_t bone;
+  uint8_t types[6];
+  uint32_t start_index;
+  uint32_t name_offset;
+  uint32_t name_size;
+  float local[3];
+  float world[3];
+  float init[3];
+};
+static_assert(sizeof(BvhCacheJoint) == 60, "BvhCacheJoint");
+
+// identifies the text source a cache was built from
+struct BvhSourceKey
+{
+  uint64_t size = 0;
+  int64_t mtime = 0;
+  // fnv1a of the first and last 64KB. cheap enough to check on every load.
+  uint64_t hash = 0;
+
+  static std::optional<BvhSourceKey> FromFile(const std::string& path,
+                                              const MappedFile& mapping);
+  bool operator==(const BvhSourceKey&) const = default;
+};
+
+// take.bvh => take.bvhc
+std::string
+BvhCachePath(std::string_view path);
+
+bool
+WriteBvhCache(const Bvh& bvh, const std::string& path, const BvhSourceKey& key);
+
+// key: nullptr to skip the source check
+std::shared_ptr<Bvh>
+LoadBvhCache(const std::string& path, const BvhSourceKey* key);
@@ -0,0 +1,97 @@
+#include <DirectXMath.h>
+
+#include "BvhCrowd.h"
+#include <cmath>
+#include <stdexcept>
+
+BvhCrowd::BvhCrowd(uint32_t threads)
+  : pool_(threads)
+  , scratch_(pool_.ThreadCount())
+{
+}
+
+uint32_t
+BvhCrowd::AddClip(const std::shared_ptr<Bvh>& bvh)
+{
+  if (!bvh || bvh->joints.empty() || bvh->FrameCount() == 0) {
+    throw std::runtime_error("BvhCrowd::AddClip: no frames");
+  }
+  auto clip = std::make_unique<Clip>();
+  clip->bvh = bvh;
+  clip->solver.Initialize(bvh);
+  for (auto& scratch : scratch_) {
+    if (scratch.size() < bvh->joints.size()) {
+      scratch.resize(bvh->joints.size());
+    }
+  }
+  clips_.push_back(std::move(clip));
+  return static_cast<uint32_t>(clips_.size() - 1);
+}
+
+uint32_t
+BvhCrowd::AddCharacter(const BvhCrowdCharacter& character)
+{
+  if (character.clip >= clips_.size()) {
+    throw std::runtime_error("BvhCrowd::AddCharacter: unknown clip");
+  }
+  characters_.push_back(character);
+  layout_dirty_ = true;
+  return static_cast<uint32_t>(characters_.size() - 1);
+}
+
+void
+BvhCrowd::ClearCharacters()
+{
+  characters_.clear();
+  layout_dirty_ = true;
+}
+
+void
+BvhCrowd::UpdateLayout()
+{
+  offsets_.resize(characters_.size());
+  size_t count = 0;
+  for (size_t i = 0; i < characters_.size(); ++i) {
+    offsets_[i] = count;
+    count += clips_[characters_[i].clip]->solver.JointCount();
+  }
+  instances_.resize(count);
+  layout_dirty_ = false;
+}
+
+std::span<const cuber::Instance>
+BvhCrowd::Update(BvhTime time)
+{
+  if (layout_dirty_) {
+    UpdateLayout();
+  }
+
+  pool_.ParallelFor(
+    characters_.size(),
+    grain_,
+    [self = this, time](size_t begin, size_t end, uint32_t worker) {
+      auto world = self->scratch_[worker].data();
+      for (auto i = begin; i < end; ++i) {
+        auto& character = self->characters_[i];
+        auto& clip = *self->clips_[character.clip];
+        // loop the clip. offsets may be negative
+        auto t = (time + character.offset) / clip.bvh->frame_time;
+        auto count = static_cast<int64_t>(clip.bvh->FrameCount());
+        auto index = static_cast<int64_t>(std::floor(t)) % count;
+        if (index < 0) {
+          index += count;
+        }
+
+        auto root =
+          DirectX::XMMatrixScaling(
+            character.scale, character.scale, character.scale) *
+          DirectX::XMLoadFloat4x4(&character.root);
+        clip.solver.Solve(clip.bvh->GetFrame(static_cast<int>(index)),
+                          root,
+                          world,
+                          &self->instances_[self->offsets_[i]].Matrix,
+                          sizeof(cuber::Instance));
+      }
+    });
+  return instances_;
+}
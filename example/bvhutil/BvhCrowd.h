@@ -0,0 +1,68 @@
+#pragma once
+#include "Bvh.h"
+#include "BvhFlatSolver.h"
+#include "WorkStealingPool.h"
+#include <cuber/mesh.h>
+#include <grapho/dxmath_stub.h>
+#include <memory>
+#include <span>
+#include <vector>
+
+struct BvhCrowdCharacter
+{
+  uint32_t clip = 0;
+  // added to the crowd time
+  BvhTime offset = {};
+  float scale = 1.0f;
+  // placement of the scaled skeleton
+  DirectX::XMFLOAT4X4 root = {
+    1, 0, 0, 0, //
+    0, 1, 0, 0, //
+    0, 0, 1, 0, //
+    0, 0, 0, 1, //
+  };
+};
+
+///
+/// many skeletons sharing a few clips.
+///
+/// a clip is a Bvh and its BvhFlatSolver, read only after AddClip.
+/// Update solves every character at its own clip time on a
+/// WorkStealingPool, straight into one cuber::Instance array (the
+/// instances of a character are contiguous, in joint order). the array is
+/// drawn with a single cube renderer call.
+///
+class BvhCrowd
+{
+  struct Clip
+  {
+    std::shared_ptr<Bvh> bvh;
+    BvhFlatSolver solver;
+  };
+  std::vector<std::unique_ptr<Clip>> clips_;
+  std::vector<BvhCrowdCharacter> characters_;
+  // first instance of each character
+  std::vector<size_t> offsets_;
+  bool layout_dirty_ = false;
+  std::vector<cuber::Instance> instances_;
+  WorkStealingPool pool_;
+  // world matrix scratch per worker
+  std::vector<std::vector<DirectX::XMFLOAT4X4>> scratch_;
+
+public:
+  // characters per pool chunk
+  size_t grain_ = 64;
+
+  // threads: 0 for std::thread::hardware_concurrency
+  explicit BvhCrowd(uint32_t threads = 0);
+  uint32_t AddClip(const std::shared_ptr<Bvh>& bvh);
+  uint32_t AddCharacter(const BvhCrowdCharacter& character);
+  size_t CharacterCount() const { return characters_.size(); }
+  BvhCrowdCharacter& Character(size_t index) { return characters_[index]; }
+  void ClearCharacters();
+  // solve all characters at time. the span is valid until the next call
+  std::span<const cuber::Instance> Update(BvhTime time);
+
+private:
+  void UpdateLayout();
+};
@@ -0,0 +1,122 @@
+#include <DirectXMath.h>
+
+#include "BvhFlatSolver.h"
+#include "BvhNode.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+void
+BvhFlatSolver::Initialize(const std::shared_ptr<Bvh>& bvh)
+{
+  auto& joints = bvh->joints;
+  scaling_ = bvh->GuessScaling();
+  parents_.resize(joints.size());
+  channels_.resize(joints.size());
+  shapes_.resize(joints.size());
+  world_.resize(joints.size());
+  instances_.resize(joints.size());
+  if (joints.empty()) {
+    return;
+  }
+
+  for (size_t i = 0; i < joints.size(); ++i) {
+    auto& joint = joints[i];
+    if (i == 0 ? joint.parent != ROOT_PARENT : joint.parent >= i) {
+      throw std::runtime_error("joints are not parent first");
+    }
+    parents_[i] = joint.parent;
+    channels_[i] = joint.channels;
+  }
+
+  // same tail as BvhNode::CalcShape. the first child, or the one nearest to
+  // the center when it branches
+  std::vector<const BvhJoint*> tails(joints.size());
+  for (size_t i = 1; i < joints.size(); ++i) {
+    auto& tail = tails[joints[i].parent];
+    if (!tail ||
+        std::abs(joints[i].localOffset.x) < std::abs(tail->localOffset.x)) {
+      tail = &joints[i];
+    }
+  }
+  // root keeps the default cube
+  tails[0] = nullptr;
+  for (size_t i = 0; i < joints.size(); ++i) {
+    shapes_[i] = BvhNode::Shape(tails[i], scaling_);
+  }
+}
+
+// [x, y, z][c6][c5][c4][c3][c2][c1][parent][root]
+void
+BvhFlatSolver::Solve(const BvhFrame& frame,
+                     DirectX::FXMMATRIX root,
+                     DirectX::XMFLOAT4X4* world,
+                     DirectX::XMFLOAT4X4* instances,
+                     size_t stride) const
+{
+  for (size_t i = 0; i < parents_.size(); ++i) {
+    auto [pos, rot] = frame.Resolve(i, channels_[i]);
+    auto t = DirectX::XMMatrixTranslation(
+      pos.x * scaling_, pos.y * scaling_, pos.z * scaling_);
+    auto local = rot * t;
+
+    auto parent = parents_[i] == ROOT_PARENT
+                    ? root
+                    : DirectX::XMLoadFloat4x4(&world[parents_[i]]);
+    auto m = local * parent;
+    DirectX::XMStoreFloat4x4(&world[i], m);
+
+    if (instances) {
+      auto shape = DirectX::XMLoadFloat4x4(&shapes_[i]);
+      auto dst = (DirectX::XMFLOAT4X4*)((char*)instances + i * stride);
+      DirectX::XMStoreFloat4x4(dst, shape * m);
+    }
+  }
+}
+
+std::span<DirectX::XMFLOAT4X4>
+BvhFlatSolver::ResolveFrame(const BvhFrame& frame)
+{
+  Solve(frame, DirectX::XMMatrixIdentity(), world_.data(), instances_.data());
+  return instances_;
+}
+
+// frames are independent. contiguous ranges on the shared pool
+bool
+BvhFlatSolver::Bake(const Bvh& bvh,
+                    uint32_t begin,
+                    uint32_t end,
+                    std::span<DirectX::XMFLOAT4X4> out,
+                    bool shape,
+                    uint32_t threads) const
+{
+  auto joint_count = parents_.size();
+  if (begin > end || end > bvh.FrameCount() ||
+      bvh.joints.size() != joint_count ||
+      out.size() < size_t(end - begin) * joint_count) {
+    return false;
+  }
+
+  auto bake_range = [this, &bvh, begin, joint_count, out, shape](
+                      size_t first, size_t last) {
+    // scratch for the instance case. world matrices go straight to out
+    std::vector<DirectX::XMFLOAT4X4> world(shape ? joint_count : 0);
+    auto root = DirectX::XMMatrixIdentity();
+    for (auto i = first; i < last; ++i) {
+      auto frame = bvh.GetFrame(static_cast<int>(begin + i));
+      auto dst = out.data() + i * joint_count;
+      if (shape) {
+        Solve(frame, root, world.data(), dst);
+      } else {
+        Solve(frame, root, dst, nullptr);
+      }
+    }
+  };
+  if (threads == 1) {
+    bake_range(0, end - begin);
+  } else {
+    ParallelRanges(end - begin, threads, bake_range);
+  }
+  return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "Bvh.h"
+#include <grapho/dxmath_stub.h>
+#include <memory>
+#include <span>
+#include <vector>
+
+///
+/// BvhSolver without the node tree.
+///
+/// joints are kept in parse order, which is depth first, so a parent always
+/// comes before its children. world matrices are then one linear loop over
+/// contiguous arrays (parent index, channels with the local offset, shape).
+/// output is the same as BvhSolver::ResolveFrame.
+///
+/// Bake solves a whole frame range on several threads. the solver state is
+/// read only there, each worker keeps its own world matrix scratch.
+///
+class BvhFlatSolver
+{
+  static const uint16_t ROOT_PARENT = 0xffff;
+  std::vector<uint16_t> parents_;
+  std::vector<BvhChannels> channels_;
+  std::vector<DirectX::XMFLOAT4X4> shapes_;
+  std::vector<DirectX::XMFLOAT4X4> world_;
+  std::vector<DirectX::XMFLOAT4X4> instances_;
+
+public:
+  float scaling_ = 1.0f;
+  void Initialize(const std::shared_ptr<Bvh>& bvh);
+  size_t JointCount() const { return parents_.size(); }
+  std::span<DirectX::XMFLOAT4X4> ResolveFrame(const BvhFrame& frame);
+
+  // frames [begin, end) of bvh (the Initialize skeleton) into
+  // out[(frame - begin) * JointCount() + joint].
+  // shape: false for world matrices, true for ResolveFrame instances.
+  // threads: ranges on WorkStealingPool::Shared, 0 for one per pool thread
+  bool Bake(const Bvh& bvh,
+            uint32_t begin,
+            uint32_t end,
+            std::span<DirectX::XMFLOAT4X4> out,
+            bool shape = false,
+            uint32_t threads = 0) const;
+
+  // const solve into caller memory, for several characters sharing a clip.
+  // root: parent of the root joint. world: JointCount() matrices.
+  // instances: nullptr for world matrices only. stride: bytes between
+  // instance matrices (sizeof(cuber::Instance) to fill an instance array)
+  void Solve(const BvhFrame& frame,
+             DirectX::FXMMATRIX root,
+             DirectX::XMFLOAT4X4* world,
+             DirectX::XMFLOAT4X4* instances,
+             size_t stride = sizeof(DirectX::XMFLOAT4X4)) const;
+};
@@ -1,7 +1,9 @@
 #include <DirectXMath.h>
 
 #include "BvhFrame.h"
+#include <algorithm>
 #include <numbers>
+#include <optional>
 
 // BvhMat3 BvhMat3::operator*(const BvhMat3 &rhs) {
 //   return {
@@ -51,8 +53,123 @@
 //   };
 // }
 
+namespace {
+
+enum Axis { X, Y, Z };
+
+// m = Rotation(axis) * m. rotation about an axis mixes the other two rows.
+// same products and sums as XMMatrixMultiply without the zero terms.
+template <int A> void Rotate(DirectX::XMMATRIX &m, float s, float c) {
+  constexpr int i = (A + 1) % 3;
+  constexpr int j = (A + 2) % 3;
+  auto ri = m.r[i];
+  auto rj = m.r[j];
+  m.r[i] = DirectX::XMVectorAdd(DirectX::XMVectorScale(ri, c),
+                                DirectX::XMVectorScale(rj, s));
+  m.r[j] = DirectX::XMVectorSubtract(DirectX::XMVectorScale(rj, c),
+                                     DirectX::XMVectorScale(ri, s));
+}
+
+// [Xposition Yposition Zposition] A0rotation A1rotation A2rotation
+template <bool POSITION, int A0, int A1, int A2>
+std::tuple<BvhOffset, DirectX::XMMATRIX>
+ResolveKernel(const BvhChannels &channels, const float *values) {
+  values += channels.startIndex;
+  BvhOffset pos = channels.init;
+  if constexpr (POSITION) {
+    pos = {values[0], values[1], values[2]};
+    values += 3;
+  }
+  // one sincos for the three angles
+  DirectX::XMVECTOR s, c;
+  DirectX::XMVectorSinCos(
+      &s, &c,
+      DirectX::XMVectorScale(
+          DirectX::XMVectorSet(values[0], values[1], values[2], 0),
+          DirectX::XM_PI / 180.0f));
+  DirectX::XMFLOAT3 sin, cos;
+  DirectX::XMStoreFloat3(&sin, s);
+  DirectX::XMStoreFloat3(&cos, c);
+
+  auto rot = DirectX::XMMatrixIdentity();
+  Rotate<A0>(rot, sin.x, cos.x);
+  Rotate<A1>(rot, sin.y, cos.y);
+  Rotate<A2>(rot, sin.z, cos.z);
+  return {pos, rot};
+}
+
+struct KernelEntry {
+  Axis order[3];
+  BvhResolveKernel rotation;
+  BvhResolveKernel position_rotation;
+};
+
+template <int A0, int A1, int A2> constexpr KernelEntry Entry() {
+  return {{Axis(A0), Axis(A1), Axis(A2)},
+          &ResolveKernel<false, A0, A1, A2>,
+          &ResolveKernel<true, A0, A1, A2>};
+}
+
+const KernelEntry KERNELS[] = {
+    Entry<Z, X, Y>(), Entry<Z, Y, X>(), Entry<X, Y, Z>(),
+    Entry<X, Z, Y>(), Entry<Y, X, Z>(), Entry<Y, Z, X>(),
+};
+
+std::optional<Axis> RotationAxis(BvhChannelTypes type) {
+  switch (type) {
+  case BvhChannelTypes::Xrotation:
+    return X;
+  case BvhChannelTypes::Yrotation:
+    return Y;
+  case BvhChannelTypes::Zrotation:
+    return Z;
+  default:
+    return {};
+  }
+}
+
+} // namespace
+
+BvhResolveKernel BvhFindKernel(const BvhChannels &channels) {
+  size_t offset = 0;
+  switch (channels.size()) {
+  case 3:
+    break;
+  case 6:
+    if (channels[0] != BvhChannelTypes::Xposition ||
+        channels[1] != BvhChannelTypes::Yposition ||
+        channels[2] != BvhChannelTypes::Zposition) {
+      return nullptr;
+    }
+    offset = 3;
+    break;
+  default:
+    return nullptr;
+  }
+
+  Axis order[3];
+  for (int i = 0; i < 3; ++i) {
+    auto axis = RotationAxis(channels[offset + i]);
+    if (!axis) {
+      return nullptr;
+    }
+    order[i] = *axis;
+  }
+  for (auto &entry : KERNELS) {
+    if (std::equal(order, order + 3, entry.order)) {
+      return offset ? entry.position_rotation : entry.rotation;
+    }
+  }
+  // XXY and such
+  return nullptr;
+}
+
 std::tuple<BvhOffset, DirectX::XMMATRIX>
 BvhFrame::Resolve(const BvhChannels &channels) const {
+  if (channels.kernel) {
+    return channels.kernel(channels, values.data());
+  }
+
   BvhOffset pos = channels.init;
   auto rot = DirectX::XMMatrixIdentity();
   auto index = channels.startIndex;
@@ -88,3 +205,21 @@ BvhFrame::Resolve(const BvhChannels &channels) const {
   }
   return {pos, rot};
 }
+
+std::tuple<BvhOffset, DirectX::XMMATRIX>
+BvhFrame::Resolve(size_t joint, const BvhChannels &channels) const {
+  if (joint < rotations.size()) {
+    return {translations[joint], DirectX::XMMatrixRotationQuaternion(
+                                     DirectX::XMLoadFloat4(&rotations[joint]))};
+  }
+  return Resolve(channels);
+}
+
+std::tuple<BvhOffset, DirectX::XMVECTOR>
+BvhFrame::ResolveQuaternion(size_t joint, const BvhChannels &channels) const {
+  if (joint < rotations.size()) {
+    return {translations[joint], DirectX::XMLoadFloat4(&rotations[joint])};
+  }
+  auto [pos, rot] = Resolve(channels);
+  return {pos, DirectX::XMQuaternionRotationMatrix(rot)};
+}
@@ -1,8 +1,11 @@
 #pragma once
 #include <grapho/dxmath_stub.h>
 #include <chrono>
+#include <memory>
 #include <ostream>
 #include <span>
+#include <tuple>
+#include <vector>
 
 using BvhOffset = DirectX::XMFLOAT3;
 
@@ -49,10 +52,22 @@ inline std::string_view to_str(BvhChannelTypes channelType) {
   }
 }
 
+struct BvhChannels;
+
+// Resolve specialized for one channel layout. values: the whole frame
+using BvhResolveKernel = std::tuple<BvhOffset, DirectX::XMMATRIX> (*)(
+    const BvhChannels &channels, const float *values);
+
+// precompiled kernel for 3 rotations or 3 positions + 3 rotations (any
+// order). nullptr for the generic path
+BvhResolveKernel BvhFindKernel(const BvhChannels &channels);
+
 struct BvhChannels {
   BvhOffset init;
   size_t startIndex;
   BvhChannelTypes types[6] = {};
+  // BvhFindKernel(*this). set when the types are loaded
+  BvhResolveKernel kernel = nullptr;
   BvhChannelTypes operator[](size_t index) const { return types[index]; }
   BvhChannelTypes &operator[](size_t index) { return types[index]; }
   size_t size() const {
@@ -85,6 +100,16 @@ struct BvhFrame {
   int index;
   BvhTime time;
   std::span<const float> values;
+  // keeps lazily decoded values or an interpolated pose alive
+  std::shared_ptr<const void> storage;
+  // BvhTracks of this frame. empty without a track cache
+  std::span<const DirectX::XMFLOAT4> rotations;
+  std::span<const DirectX::XMFLOAT3> translations;
 
   std::tuple<BvhOffset, DirectX::XMMATRIX> Resolve(const BvhChannels &channels) const;
+  // joint: BvhJoint::index. reads the tracks when the frame has them
+  std::tuple<BvhOffset, DirectX::XMMATRIX>
+  Resolve(size_t joint, const BvhChannels &channels) const;
+  std::tuple<BvhOffset, DirectX::XMVECTOR>
+  ResolveQuaternion(size_t joint, const BvhChannels &channels) const;
 };
@@ -0,0 +1,131 @@
+#include "BvhLazyFrames.h"
+#include "BvhMotion.h"
+#include "MappedFile.h"
+#include <algorithm>
+
+BvhLazyFrames::BvhLazyFrames(const std::shared_ptr<MappedFile>& mapping,
+                             std::string_view motion,
+                             uint32_t frame_count,
+                             uint32_t channel_count,
+                             size_t capacity,
+                             uint32_t readahead)
+  : mapping_(mapping)
+  , motion_(motion)
+  , frame_count_(frame_count)
+  , channel_count_(channel_count)
+  , capacity_(std::max(capacity, size_t(readahead) + 1))
+  , readahead_(readahead)
+{
+}
+
+bool
+BvhLazyFrames::BuildIndex()
+{
+  index_.clear();
+  index_.reserve(frame_count_ / INDEX_STRIDE + 1);
+  auto begin = motion_.data();
+  auto end = motion_.data() + motion_.size();
+  auto p = begin;
+  for (uint32_t i = 0; i < frame_count_; ++i) {
+    if (i % INDEX_STRIDE == 0) {
+      index_.push_back(p - begin);
+    }
+    p = bvh_scan::find_eol(p, end);
+    if (p == end) {
+      return false;
+    }
+    ++p;
+  }
+  return true;
+}
+
+const char*
+BvhLazyFrames::LineBegin(uint32_t frame) const
+{
+  auto end = motion_.data() + motion_.size();
+  auto p = motion_.data() + index_[frame / INDEX_STRIDE];
+  for (uint32_t i = 0; i < frame % INDEX_STRIDE; ++i) {
+    p = bvh_scan::find_eol(p, end) + 1;
+  }
+  return p;
+}
+
+BvhLazyFrames::Values
+BvhLazyFrames::Load(uint32_t frame)
+{
+  if (auto found = map_.find(frame); found != map_.end()) {
+    lru_.splice(lru_.begin(), lru_, found->second);
+    return found->second->values;
+  }
+
+  std::shared_ptr<std::vector<float>> values;
+  if (lru_.size() >= capacity_) {
+    auto& back = lru_.back();
+    map_.erase(back.frame);
+    if (back.values.use_count() == 1) {
+      // nobody holds it. reuse the buffer
+      values = std::move(back.values);
+    }
+    lru_.pop_back();
+  }
+  if (!values) {
+    values = std::make_shared<std::vector<float>>(channel_count_);
+  }
+
+  auto p = LineBegin(frame);
+  auto eol = bvh_scan::find_eol(p, motion_.data() + motion_.size());
+  if (!ParseFrameLine(p, eol, values->data(), channel_count_)) {
+    std::fill(values->begin(), values->end(), 0.0f);
+  }
+
+  lru_.push_front({ frame, values });
+  map_[frame] = lru_.begin();
+  return values;
+}
+
+BvhLazyFrames::Values
+BvhLazyFrames::Get(uint32_t frame)
+{
+  if (frame >= frame_count_) {
+    return {};
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return Load(frame);
+}
+
+void
+BvhLazyFrames::ReadAhead(uint32_t frame)
+{
+  if (frame >= frame_count_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto last = std::min<uint64_t>(uint64_t(frame) + readahead_,
+                                 frame_count_ - 1);
+  // the window slid by a frame or two since the last call. skip what is
+  // cached
+  auto first = frame;
+  while (first <= last && map_.contains(first)) {
+    ++first;
+  }
+  if (first > last) {
+    return;
+  }
+  if (mapping_) {
+    auto ahead = LineBegin(first);
+    mapping_->Prefetch(ahead - mapping_->data(),
+                       LineBegin(static_cast<uint32_t>(last)) - ahead + 4096);
+  }
+  for (auto i = first; i <= last; ++i) {
+    if (!map_.contains(i)) {
+      Load(i);
+    }
+  }
+}
+
+size_t
+BvhLazyFrames::CachedCount()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return lru_.size();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class MappedFile;
+
+///
+/// decode MOTION lines on demand.
+///
+/// load records the offset of every INDEX_STRIDE th line. a frame is
+/// decoded when it is asked for and kept in a small LRU. memory is
+/// capacity frames plus frame_count / INDEX_STRIDE offsets, however long
+/// the take is. the text stays in the page cache, not in the process.
+///
+/// ReadAhead decodes the frames after the one about to play. Animation
+/// calls it after each tick, so sequential playback mostly hits the cache
+/// and decodes about one new line per tick.
+///
+class BvhLazyFrames
+{
+public:
+  static const uint32_t INDEX_STRIDE = 16;
+  using Values = std::shared_ptr<const std::vector<float>>;
+
+private:
+  std::shared_ptr<MappedFile> mapping_;
+  std::string_view motion_;
+  uint32_t frame_count_ = 0;
+  uint32_t channel_count_ = 0;
+  size_t capacity_ = 0;
+  uint32_t readahead_ = 0;
+  // offset in motion_ of line i * INDEX_STRIDE
+  std::vector<uint64_t> index_;
+
+  struct Entry
+  {
+    uint32_t frame;
+    std::shared_ptr<std::vector<float>> values;
+  };
+  std::mutex mutex_;
+  // front is the most recent
+  std::list<Entry> lru_;
+  std::unordered_map<uint32_t, std::list<Entry>::iterator> map_;
+
+public:
+  BvhLazyFrames(const std::shared_ptr<MappedFile>& mapping,
+                std::string_view motion,
+                uint32_t frame_count,
+                uint32_t channel_count,
+                size_t capacity,
+                uint32_t readahead);
+  // scan the line offsets. false if there are less than frame_count lines
+  bool BuildIndex();
+  // malformed lines decode as zeros
+  Values Get(uint32_t frame);
+  // decode frame and the readahead frames after it that are not cached
+  void ReadAhead(uint32_t frame);
+  size_t CachedCount();
+
+private:
+  const char* LineBegin(uint32_t frame) const;
+  Values Load(uint32_t frame);
+};
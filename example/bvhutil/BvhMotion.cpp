@@ -0,0 +1,109 @@
+#include "BvhMotion.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <vector>
+
+// below this a single thread is faster than starting workers
+const size_t PARALLEL_MIN_BYTES = 1024 * 1024;
+
+// parse lines [first, last) starting at p
+static bool
+ParseLines(const char* p,
+           const char* end,
+           uint32_t first,
+           uint32_t last,
+           uint32_t channel_count,
+           float* out)
+{
+  for (uint32_t i = first; i < last; ++i) {
+    auto eol = bvh_scan::find_eol(p, end);
+    if (eol == end) {
+      return false;
+    }
+    if (!ParseFrameLine(p, eol, out + size_t(i) * channel_count, channel_count)) {
+      return false;
+    }
+    p = eol + 1;
+  }
+  return true;
+}
+
+struct MotionChunk
+{
+  const char* begin;
+  const char* end;
+  uint32_t first_line;
+  uint32_t line_count;
+};
+
+bool
+ParseMotion(std::string_view src,
+            uint32_t frame_count,
+            uint32_t channel_count,
+            std::span<float> out,
+            uint32_t threads)
+{
+  if (out.size() < size_t(frame_count) * channel_count) {
+    return false;
+  }
+  auto begin = src.data();
+  auto end = src.data() + src.size();
+
+  if (threads == 0) {
+    threads = WorkStealingPool::Shared().ThreadCount();
+  }
+  if (threads == 1 || src.size() < PARALLEL_MIN_BYTES) {
+    return ParseLines(begin, end, 0, frame_count, channel_count, out.data());
+  }
+
+  // newline aligned chunks
+  std::vector<MotionChunk> chunks(threads);
+  auto p = begin;
+  for (uint32_t i = 0; i < threads; ++i) {
+    auto chunk_end =
+      i + 1 == threads ? end : begin + src.size() * (i + 1) / threads;
+    if (chunk_end < p) {
+      chunk_end = p;
+    }
+    if (chunk_end != end) {
+      chunk_end = bvh_scan::find_eol(chunk_end, end);
+      if (chunk_end != end) {
+        ++chunk_end;
+      }
+    }
+    chunks[i] = { p, chunk_end, 0, 0 };
+    p = chunk_end;
+  }
+
+  // line index of each chunk
+  ParallelRanges(threads, threads, [&chunks](size_t first, size_t last) {
+    for (auto i = first; i < last; ++i) {
+      auto& chunk = chunks[i];
+      chunk.line_count =
+        static_cast<uint32_t>(std::count(chunk.begin, chunk.end, '\n'));
+    }
+  });
+  uint32_t lines = 0;
+  for (auto& chunk : chunks) {
+    chunk.first_line = lines;
+    lines += chunk.line_count;
+  }
+  if (lines < frame_count) {
+    return false;
+  }
+
+  // parse into each slice of out
+  std::vector<char> results(threads, 0);
+  auto parse_chunks = [frame_count, channel_count, out, &chunks, &results](
+                        size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      auto& chunk = chunks[i];
+      auto first = std::min(chunk.first_line, frame_count);
+      auto last = std::min(chunk.first_line + chunk.line_count, frame_count);
+      results[i] = ParseLines(
+        chunk.begin, chunk.end, first, last, channel_count, out.data());
+    }
+  };
+  ParallelRanges(threads, threads, parse_chunks);
+  return std::all_of(results.begin(), results.end(), [](char r) { return r; });
+}
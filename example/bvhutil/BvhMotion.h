@@ -0,0 +1,39 @@
+#pragma once
+#include "BvhNumber.h"
+#include "BvhTokenizer.h"
+#include <span>
+#include <stdint.h>
+#include <string_view>
+
+///
+/// MOTION block parser.
+///
+/// every line after "Frame Time:" is one frame of channel_count floats and
+/// does not depend on the others. that lets a big block be split into
+/// newline aligned chunks and parsed on several threads straight into the
+/// preallocated frame matrix.
+///
+
+// parse one line [p, eol). the line must hold exactly count numbers.
+inline bool
+ParseFrameLine(const char* p, const char* eol, float* out, uint32_t count)
+{
+  for (uint32_t i = 0; i < count; ++i) {
+    p = bvh_scan::skip_space(p, eol);
+    auto next = bvh_number::parse(p, eol, out[i]);
+    if (!next || (next != eol && !bvh_scan::is_space(*next))) {
+      return false;
+    }
+    p = next;
+  }
+  return bvh_scan::skip_space(p, eol) == eol;
+}
+
+// threads: chunks on WorkStealingPool::Shared, 0 for one per pool thread
+// out: frame_count * channel_count
+bool
+ParseMotion(std::string_view src,
+            uint32_t frame_count,
+            uint32_t channel_count,
+            std::span<float> out,
+            uint32_t threads = 0);
@@ -32,6 +32,48 @@ Float4(float x, float y, float z, float w)
   return DirectX::XMLoadFloat4(&v);
 }
 
+DirectX::XMFLOAT4X4
+BvhNode::Shape(const BvhJoint* tail, float scaling)
+{
+  if (!tail) {
+    return Shape(nullptr);
+  }
+  BvhOffset offset{
+    tail->localOffset.x * scaling,
+    tail->localOffset.y * scaling,
+    tail->localOffset.z * scaling,
+  };
+  return Shape(&offset);
+}
+
+DirectX::XMFLOAT4X4
+BvhNode::Shape(const BvhOffset* tail)
+{
+  DirectX::XMFLOAT4X4 shape;
+  if (!tail) {
+    DirectX::XMStoreFloat4x4(
+      &shape,
+      DirectX::XMMatrixScaling(DEFAULT_SIZE, DEFAULT_SIZE, DEFAULT_SIZE));
+    return shape;
+  }
+
+  auto Y = Float3(tail->x, tail->y, tail->z);
+
+  auto length = Float3Len(Y);
+  // std::cout << name_ << "=>" << tail->name_ << "=" << length << std::endl;
+  Y = DirectX::XMVector3Normalize(Y);
+  auto Z = Float3(0, 0, 1);
+  auto X = DirectX::XMVector3Cross(Y, Z);
+  Z = DirectX::XMVector3Cross(X, Y);
+
+  auto center = DirectX::XMMatrixTranslation(0, 0.5f, 0);
+  auto scale = DirectX::XMMatrixScaling(DEFAULT_SIZE, length, DEFAULT_SIZE);
+  auto r = DirectX::XMMATRIX(X, Y, Z, Float4(0, 0, 0, 1));
+
+  DirectX::XMStoreFloat4x4(&shape, center * scale * r);
+  return shape;
+}
+
 void
 BvhNode::CalcShape(float scaling)
 {
@@ -58,23 +100,7 @@ BvhNode::CalcShape(float scaling)
         }
     }
 
-    auto Y = Float3(tail->joint_.localOffset.x * scaling,
-                    tail->joint_.localOffset.y * scaling,
-                    tail->joint_.localOffset.z * scaling);
-
-    auto length = Float3Len(Y);
-    // std::cout << name_ << "=>" << tail->name_ << "=" << length << std::endl;
-    Y = DirectX::XMVector3Normalize(Y);
-    auto Z = Float3(0, 0, 1);
-    auto X = DirectX::XMVector3Cross(Y, Z);
-    Z = DirectX::XMVector3Cross(X, Y);
-
-    auto center = DirectX::XMMatrixTranslation(0, 0.5f, 0);
-    auto scale = DirectX::XMMatrixScaling(DEFAULT_SIZE, length, DEFAULT_SIZE);
-    auto r = DirectX::XMMATRIX(X, Y, Z, Float4(0, 0, 0, 1));
-
-    auto shape = center * scale * r;
-    DirectX::XMStoreFloat4x4(&shape_, shape);
+    shape_ = Shape(&tail->joint_, scaling);
   }
 
   for (auto& child : children_) {
@@ -89,7 +115,7 @@ BvhNode::ResolveFrame(const BvhFrame& frame,
                       float scaling,
                       std::span<DirectX::XMFLOAT4X4>::iterator& out)
 {
-  auto [pos, rot] = frame.Resolve(joint_.channels);
+  auto [pos, rot] = frame.Resolve(joint_.index, joint_.channels);
 
   auto t = DirectX::XMMatrixTranslation(
     pos.x * scaling, pos.y * scaling, pos.z * scaling);
@@ -13,6 +13,10 @@ struct BvhNode {
     children_.push_back(node);
   }
   void CalcShape(float scaling);
+  // box from the joint to the tail joint. default cube when tail is null
+  static DirectX::XMFLOAT4X4 Shape(const BvhJoint *tail, float scaling);
+  // tail: offset of the tail joint, already scaled
+  static DirectX::XMFLOAT4X4 Shape(const BvhOffset *tail);
   void ResolveFrame(const BvhFrame &frame, DirectX::XMMATRIX m, float scaling,
                     std::span<DirectX::XMFLOAT4X4>::iterator &out);
 };
@@ -0,0 +1,175 @@
+#pragma once
+#include <bit>
+#include <charconv>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+///
+/// locale free decimal to float for the MOTION block.
+///
+/// mocap exporters write short fixed precision numbers (-123.456789).
+/// those take the clinger fast path: the decimal significand fits in 53 bits
+/// and the power of ten is exact in a double, so one multiply or divide gives
+/// the correctly rounded double. digits are consumed 8 at a time (swar).
+/// anything else (long significands, big exponents, inf, nan) falls back to
+/// std::from_chars, or strtod where the library has no floating from_chars.
+///
+/// the float overload rounds through double, so it is bit identical to
+/// (float)strtod(...).
+///
+namespace bvh_number {
+
+inline bool
+is_digit(char c)
+{
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+inline bool
+is_eight_digits(uint64_t v)
+{
+  return !(((v + 0x4646464646464646) | (v - 0x3030303030303030)) &
+           0x8080808080808080);
+}
+
+inline uint32_t
+parse_eight_digits(uint64_t v)
+{
+  const uint64_t mask = 0x000000FF000000FF;
+  const uint64_t mul1 = 0x000F424000000064; // 100 + (1000000 << 32)
+  const uint64_t mul2 = 0x0000271000000001; // 1 + (10000 << 32)
+  v -= 0x3030303030303030;
+  v = (v * 10) + (v >> 8);
+  v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+  return static_cast<uint32_t>(v);
+}
+
+// accumulate digits into mantissa. returns the new position.
+inline const char*
+parse_digits(const char* p, const char* last, uint64_t& mantissa, int& digits)
+{
+  if constexpr (std::endian::native == std::endian::little) {
+    // 19 digits always fit in uint64_t
+    while (last - p >= 8 && digits <= 19 - 8) {
+      uint64_t v;
+      memcpy(&v, p, 8);
+      if (!is_eight_digits(v)) {
+        break;
+      }
+      mantissa = mantissa * 100000000 + parse_eight_digits(v);
+      digits += 8;
+      p += 8;
+    }
+  }
+  for (; p != last && is_digit(*p); ++p) {
+    mantissa = mantissa * 10 + (*p - '0');
+    ++digits;
+  }
+  return p;
+}
+
+// [first, last) must be followed by a character that can not continue a
+// number (the tokenizer guarantees whitespace) for the strtod fallback.
+inline const char*
+parse_fallback(const char* first, const char* last, double& value)
+{
+#if defined(__cpp_lib_to_chars)
+  // from_chars takes no '+'. strtod takes one sign, not "+-1"
+  if (first != last && *first == '+') {
+    ++first;
+    if (first != last && *first == '-') {
+      return nullptr;
+    }
+  }
+  auto [ptr, ec] = std::from_chars(first, last, value);
+  if (ec != std::errc{}) {
+    return nullptr;
+  }
+  return ptr;
+#else
+  char* end = nullptr;
+  value = strtod(first, &end);
+  if (end == first) {
+    return nullptr;
+  }
+  return end;
+#endif
+}
+
+// returns the end of the number or nullptr
+inline const char*
+parse(const char* first, const char* last, double& value)
+{
+  static constexpr double POW10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+
+  auto p = first;
+  bool negative = false;
+  if (p != last && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  p = parse_digits(p, last, mantissa, digits);
+  int64_t exponent = 0;
+  if (p != last && *p == '.') {
+    ++p;
+    auto fraction = p;
+    p = parse_digits(p, last, mantissa, digits);
+    exponent = -(p - fraction);
+  }
+  if (digits == 0 || digits > 19) {
+    // inf, nan or may overflow
+    return parse_fallback(first, last, value);
+  }
+  if (p != last && (*p == 'e' || *p == 'E')) {
+    auto e = p + 1;
+    bool eneg = false;
+    if (e != last && (*e == '-' || *e == '+')) {
+      eneg = *e == '-';
+      ++e;
+    }
+    if (e == last || !is_digit(*e)) {
+      // not an exponent. "1e" is 1
+    } else {
+      int64_t n = 0;
+      for (; e != last && is_digit(*e); ++e) {
+        if (n < 100000) {
+          n = n * 10 + (*e - '0');
+        }
+      }
+      exponent += eneg ? -n : n;
+      p = e;
+    }
+  }
+
+  if (mantissa > (uint64_t(1) << 53) || exponent < -22 || exponent > 22) {
+    return parse_fallback(first, last, value);
+  }
+  auto d = static_cast<double>(mantissa);
+  if (exponent < 0) {
+    d = d / POW10[-exponent];
+  } else {
+    d = d * POW10[exponent];
+  }
+  value = negative ? -d : d;
+  return p;
+}
+
+inline const char*
+parse(const char* first, const char* last, float& value)
+{
+  double d;
+  auto p = parse(first, last, d);
+  if (p) {
+    value = static_cast<float>(d);
+  }
+  return p;
+}
+
+} // namespace bvh_number
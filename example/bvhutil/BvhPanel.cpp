@@ -1,14 +1,24 @@
 #include "BvhPanel.h"
 #include "Animation.h"
 #include "Bvh.h"
+#include "BvhFlatSolver.h"
 #include "BvhNode.h"
 #include "BvhSolver.h"
+#include "BvhStream.h"
+#include "BvhTracks.h"
+#include "TripleBuffer.h"
 #include "UdpSender.h"
 #include <algorithm>
 #include <asio.hpp>
+#include <atomic>
 #include <imgui.h>
+#include <string>
 #include <thread>
 
+// a clip whose tracks would be larger plays without them (nearest frame,
+// trig per frame). 64MB: about 20 minutes of a 55 joint take at 30fps
+const uint64_t MAX_TRACK_BYTES = 64ull * 1024 * 1024;
+
 struct BvhPanelImpl
 {
   asio::io_context io_;
@@ -16,14 +26,30 @@ struct BvhPanelImpl
   Animation m_animation;
   UdpSender m_sender;
   std::thread m_thread;
+  // gui thread
   std::shared_ptr<Bvh> m_bvh;
+  // asio thread: the clip the animation plays, with m_flatSolver
+  std::shared_ptr<Bvh> m_playing;
+  // the first endpoint of m_sender
   asio::ip::udp::endpoint m_ep;
+  char m_host[64] = "127.0.0.1";
+  int m_port = 54345;
   bool m_enablePackQuat = false;
+  // 0: clip rate
+  float m_outputRate = 0;
+  int m_latePolicy = 0;
   std::vector<int> m_parentMap;
 
-  std::vector<cuber::Instance> m_instances;
+  // asio thread(SyncFrame) => render thread(GetCubes)
+  TripleBuffer<std::vector<cuber::Instance>> m_pose;
   std::mutex m_mutex;
+  // tree for the gui, flat for the per frame solve on the asio thread
   BvhSolver m_bvhSolver;
+  BvhFlatSolver m_flatSolver;
+  std::unique_ptr<BvhFileFollower> m_follower;
+  // follower thread => gui thread
+  std::shared_ptr<Bvh> m_pendingLive;
+  std::atomic<bool> m_liveReady = false;
 
   BvhPanelImpl()
     : m_work(asio::make_work_guard(io_))
@@ -31,9 +57,12 @@ struct BvhPanelImpl
     , m_sender(io_)
     , m_ep(asio::ip::address::from_string("127.0.0.1"), 54345)
   {
+    m_sender.AddEndpoint(m_ep);
+    // one batch per tick for every endpoint
     m_animation.OnFrame([self = this](const BvhFrame& frame) {
-      self->m_sender.SendFrame(
-        self->m_ep, self->m_bvh, frame, self->m_enablePackQuat);
+      self->m_sender.QueueFrame(
+        *self->m_playing, frame, self->m_enablePackQuat);
+      self->m_sender.Flush();
     });
     m_thread = std::thread([self = this]() {
       try {
@@ -51,25 +80,75 @@ struct BvhPanelImpl
 
   ~BvhPanelImpl()
   {
+    m_follower.reset();
     m_animation.Stop();
     m_work.reset();
     m_thread.join();
   }
 
-  void SetBvh(const std::shared_ptr<Bvh>& bvh)
+  void SetBvh(const std::shared_ptr<Bvh>& bvh, bool live = false)
   {
     m_bvh = bvh;
     if (!m_bvh) {
       return;
     }
-    m_animation.SetBvh(bvh);
+    // no trig per frame for a loaded clip, when the tracks stay small.
+    // a lazy clip has no decoded frames to build them from
+    if (!live && !bvh->tracks && !bvh->lazy_frames &&
+        BvhTracks::Bytes(*bvh) <= MAX_TRACK_BYTES) {
+      bvh->BuildTracks();
+    }
+    m_parentMap.clear();
     for (auto& joint : m_bvh->joints) {
       m_parentMap.push_back(joint.parent);
     }
-    m_sender.SendSkeleton(m_ep, m_bvh);
-
     m_bvhSolver.Initialize(bvh);
-    m_instances.resize(m_bvh->joints.size());
+
+    // ticks of the previous clip keep running on the asio thread. the
+    // solver is swapped there, between two ticks, and the new clip starts
+    // with it
+    BvhFlatSolver flatSolver;
+    flatSolver.Initialize(bvh);
+    asio::post(
+      io_,
+      [self = this, bvh, live, solver = std::move(flatSolver)]() mutable {
+        self->m_flatSolver = std::move(solver);
+        self->m_playing = bvh;
+        if (live) {
+          self->m_animation.SetLiveBvh(bvh);
+        } else {
+          self->m_animation.SetBvh(bvh);
+        }
+      });
+    SendSkeleton();
+  }
+
+  // to every endpoint, on the asio thread
+  void SendSkeleton()
+  {
+    asio::post(io_, [self = this, bvh = m_bvh]() {
+      self->m_sender.QueueSkeleton(*bvh);
+      self->m_sender.Flush();
+    });
+  }
+
+  bool Follow(std::string_view path)
+  {
+    m_follower = std::make_unique<BvhFileFollower>();
+    m_liveReady = false;
+    auto& parser = m_follower->Parser();
+    // SetBvh runs on the gui thread (UpdateGui) like a loaded file
+    parser.OnHierarchy([self = this](const std::shared_ptr<Bvh>& bvh) {
+      std::lock_guard<std::mutex> lock(self->m_mutex);
+      self->m_pendingLive = bvh;
+    });
+    // frames before SetBvh are dropped
+    parser.OnFrame([self = this](const BvhFrame& frame) {
+      if (self->m_liveReady) {
+        self->m_animation.PushFrame(frame);
+      }
+    });
+    return m_follower->Start({ path.begin(), path.end() });
   }
 
   void SelectBone(const std::shared_ptr<BvhNode>& node)
@@ -91,8 +170,7 @@ struct BvhPanelImpl
     }
   }
 
-  void TreeGui(const std::shared_ptr<BvhNode>& node,
-               std::span<cuber::Instance>::iterator& it)
+  void TreeGui(const std::shared_ptr<BvhNode>& node)
   {
     ImGui::TableNextRow();
     ImGui::TableNextColumn();
@@ -113,23 +191,82 @@ struct BvhPanelImpl
     ImGui::TableNextColumn();
     SelectBone(node);
 
-    // color picker
-    // ImGui::TableNextColumn();
-    // ImGui::ColorEdit4("##color",
-    //                   &it->Color.x,
-    //                   ImGuiColorEditFlags_NoInputs |
-    //                     ImGuiColorEditFlags_NoLabel);
-
     if (open) {
       for (auto& child : node->children_) {
-        TreeGui(child, ++it);
+        TreeGui(child);
       }
       ImGui::TreePop();
     }
   }
 
+  void TimingGui()
+  {
+    if (!ImGui::CollapsingHeader("timing")) {
+      return;
+    }
+    static const char* policies[] = { "catch up", "drop" };
+    if (ImGui::Combo("late", &m_latePolicy, policies, 2)) {
+      m_animation.SetLatePolicy((AnimationLatePolicy)m_latePolicy);
+    }
+    auto stats = m_animation.GetStats();
+    ImGui::Text("ticks %llu, caught up %llu, missed %llu",
+                (unsigned long long)stats.ticks,
+                (unsigned long long)stats.caughtUp,
+                (unsigned long long)stats.missed);
+    ImGui::Text(
+      "callback mean %.3fms, max %.3fms, late max %.3fms",
+      std::chrono::duration<float, std::milli>(stats.CallbackMean()).count(),
+      std::chrono::duration<float, std::milli>(stats.callbackMax).count(),
+      std::chrono::duration<float, std::milli>(stats.lateMax).count());
+    float late[AnimationStats::LATE_BUCKETS];
+    for (size_t i = 0; i < AnimationStats::LATE_BUCKETS; ++i) {
+      late[i] = static_cast<float>(stats.late[i]);
+    }
+    // <50us, <100us, ... <8ms, later
+    ImGui::PlotHistogram("late", late, AnimationStats::LATE_BUCKETS);
+    if (ImGui::Button("reset")) {
+      m_animation.ResetStats();
+    }
+  }
+
+  void EndpointGui()
+  {
+    if (!ImGui::CollapsingHeader("endpoints")) {
+      return;
+    }
+    for (auto& ep : m_sender.Endpoints()) {
+      auto name = ep.address().to_string() + ":" + std::to_string(ep.port());
+      ImGui::PushID(name.c_str());
+      if (ImGui::Button("x")) {
+        m_sender.RemoveEndpoint(ep);
+      }
+      ImGui::SameLine();
+      ImGui::Text("%s", name.c_str());
+      ImGui::PopID();
+    }
+    ImGui::InputText("host", m_host, sizeof(m_host));
+    ImGui::InputInt("port", &m_port);
+    if (ImGui::Button("add")) {
+      asio::error_code ec;
+      auto address = asio::ip::make_address(m_host, ec);
+      if (!ec && m_port > 0 && m_port < 65536) {
+        m_sender.AddEndpoint({ address, static_cast<uint16_t>(m_port) });
+      }
+    }
+  }
+
   void UpdateGui()
   {
+    std::shared_ptr<Bvh> live;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      live = std::move(m_pendingLive);
+    }
+    if (live) {
+      SetBvh(live, true);
+      m_liveReady = true;
+    }
+
     if (!m_bvh) {
       return;
     }
@@ -137,11 +274,25 @@ struct BvhPanelImpl
     ImGui::Begin("BVH");
 
     ImGui::LabelText("bvh", "%zu joints", m_bvh->joints.size());
+    ImGui::LabelText("frames",
+                     "%u%s",
+                     m_bvh->FrameCount(),
+                     m_bvh->lazy_frames ? " (lazy)"
+                     : m_bvh->tracks    ? " (tracks)"
+                                        : "");
 
     ImGui::Checkbox("use quaternion pack32", &m_enablePackQuat);
 
+    // 0 for the clip rate. otherwise interpolated, with tracks
+    if (ImGui::InputFloat("output Hz", &m_outputRate, 30, 60, "%.0f")) {
+      m_outputRate = std::max(0.0f, m_outputRate);
+      m_animation.SetOutputRate(m_outputRate);
+    }
+    TimingGui();
+    EndpointGui();
+
     if (ImGui::Button("send skeleton")) {
-      m_sender.SendSkeleton(m_ep, m_bvh);
+      SendSkeleton();
     }
 
     // TREE
@@ -154,9 +305,7 @@ struct BvhPanelImpl
       ImGui::TableSetupColumn("Color");
       // ImGui::TableSetupScrollFreeze(0, 1);
       ImGui::TableHeadersRow();
-      std::span<cuber::Instance> span{ m_instances.begin(), m_instances.end() };
-      auto it = span.begin();
-      TreeGui(m_bvhSolver.root_, it);
+      TreeGui(m_bvhSolver.root_);
       ImGui::EndTable();
     }
 
@@ -165,25 +314,25 @@ struct BvhPanelImpl
 
   void SyncFrame(const BvhFrame& frame)
   {
-    auto instances = m_bvhSolver.ResolveFrame(frame);
-    {
-      std::lock_guard<std::mutex> lock(m_mutex);
-      m_instances.resize(instances.size());
-      for (size_t i = 0; i < m_instances.size(); ++i) {
-        m_instances[i] = { .Matrix = instances[i] };
-      }
+    auto instances = m_flatSolver.ResolveFrame(frame);
+    auto& back = m_pose.Back();
+    back.resize(instances.size());
+    for (size_t i = 0; i < back.size(); ++i) {
+      back[i] = { .Matrix = instances[i] };
     }
+    m_pose.Publish();
   }
 
   std::span<const cuber::Instance> GetCubes()
   {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_instances;
+    m_pose.Update();
+    return m_pose.Front();
   }
 
   void GetCubes(std::vector<cuber::Instance>& cubes)
   {
-    cubes.assign(m_instances.begin(), m_instances.end());
+    auto front = GetCubes();
+    cubes.assign(front.begin(), front.end());
   }
 };
 
@@ -200,6 +349,11 @@ BvhPanel::SetBvh(const std::shared_ptr<Bvh>& bvh)
 {
   m_impl->SetBvh(bvh);
 }
+bool
+BvhPanel::Follow(std::string_view path)
+{
+  return m_impl->Follow(path);
+}
 void
 BvhPanel::UpdateGui()
 {
@@ -17,7 +17,11 @@ public:
   BvhPanel();
   ~BvhPanel();
   void SetBvh(const std::shared_ptr<Bvh>& bvh);
+  // play a bvh file that is still being written
+  bool Follow(std::string_view path);
   void UpdateGui();
+  // render thread. the latest solved pose, never blocks.
+  // the span is valid until the next GetCubes
   std::span<const cuber::Instance> GetCubes();
   void GetCubes(std::vector<cuber::Instance> &cubes);
 };
@@ -0,0 +1,168 @@
+#include "BvhStream.h"
+#include "BvhMotion.h"
+#include <chrono>
+#include <iostream>
+#include <stdio.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+bool
+BvhStreamParser::Feed(std::string_view chunk)
+{
+  if (error_) {
+    return false;
+  }
+  pending_.append(chunk.begin(), chunk.end());
+  if (!bvh_) {
+    if (!ParseHierarchy()) {
+      return !error_;
+    }
+  }
+  return ParseFrames();
+}
+
+bool
+BvhStreamParser::ParseHierarchy()
+{
+  // wait for the complete "Frame Time:" line
+  auto pos = pending_.find("Frame Time:");
+  if (pos == std::string::npos ||
+      pending_.find('\n', pos) == std::string::npos) {
+    return false;
+  }
+
+  auto bvh = std::make_shared<Bvh>();
+  std::optional<std::string_view> motion;
+  try {
+    motion = bvh->ParseHierarchy(pending_);
+  } catch (std::exception const& e) {
+    std::cout << "BvhStreamParser: " << e.what() << std::endl;
+  }
+  if (!motion) {
+    error_ = true;
+    return false;
+  }
+  pending_.erase(0, motion->data() - pending_.data());
+  bvh_ = bvh;
+  if (onHierarchy_) {
+    onHierarchy_(bvh_);
+  }
+  return true;
+}
+
+bool
+BvhStreamParser::ParseFrames()
+{
+  const char* data = pending_.data();
+  const char* end = data + pending_.size();
+  auto p = data;
+  while (true) {
+    auto eol = bvh_scan::find_eol(p, end);
+    if (eol == end) {
+      // partial line. wait for the rest
+      break;
+    }
+    if (bvh_scan::skip_space(p, eol) == eol) {
+      // blank line
+      p = eol + 1;
+      continue;
+    }
+
+    auto values =
+      std::make_shared<std::vector<float>>(bvh_->frame_channel_count);
+    if (!ParseFrameLine(p, eol, values->data(), bvh_->frame_channel_count)) {
+      error_ = true;
+      break;
+    }
+    p = eol + 1;
+
+    auto index = frame_count_++;
+    if (onFrame_) {
+      onFrame_({
+        .index = static_cast<int>(index),
+        .time = bvh_->frame_time * index,
+        .values = *values,
+        .storage = values,
+      });
+    }
+  }
+  pending_.erase(0, p - data);
+  return !error_;
+}
+
+BvhFileFollower::BvhFileFollower() {}
+
+BvhFileFollower::~BvhFileFollower()
+{
+  Stop();
+}
+
+bool
+BvhFileFollower::Start(const std::string& path)
+{
+  Stop();
+  auto fp = fopen(path.c_str(), "rb");
+  if (!fp) {
+    return false;
+  }
+  stop_ = false;
+  thread_ = std::thread([self = this, fp, path]() { self->Run(fp, path); });
+  return true;
+}
+
+void
+BvhFileFollower::Stop()
+{
+  stop_ = true;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void
+BvhFileFollower::Run(FILE* fp, std::string path)
+{
+#ifdef __linux__
+  int notify = inotify_init1(IN_NONBLOCK);
+  if (notify >= 0) {
+    inotify_add_watch(notify, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE);
+  }
+#endif
+
+  char buf[64 * 1024];
+  while (!stop_) {
+    auto n = fread(buf, 1, sizeof(buf), fp);
+    if (n > 0) {
+      if (!parser_.Feed({ buf, n })) {
+        std::cout << "BvhFileFollower: parse error: " << path << std::endl;
+        break;
+      }
+      continue;
+    }
+
+    // end of the written part. wait for the writer
+    clearerr(fp);
+#ifdef __linux__
+    if (notify >= 0) {
+      pollfd pfd{ .fd = notify, .events = POLLIN };
+      if (poll(&pfd, 1, 100) > 0) {
+        char events[4096];
+        while (read(notify, events, sizeof(events)) > 0) {
+        }
+      }
+      continue;
+    }
+#endif
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+
+#ifdef __linux__
+  if (notify >= 0) {
+    close(notify);
+  }
+#endif
+  fclose(fp);
+}
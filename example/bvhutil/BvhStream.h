@@ -0,0 +1,68 @@
+#pragma once
+#include "Bvh.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+///
+/// incremental bvh parser for a file that is still being written.
+///
+/// the HIERARCHY is parsed once, when the "Frame Time:" line is complete.
+/// after that every complete MOTION line becomes a frame and is handed to
+/// OnFrame right away. only the trailing partial line is kept between
+/// Feed calls, nothing is parsed twice. the "Frames:" count is ignored,
+/// live writers do not know it yet.
+///
+class BvhStreamParser
+{
+public:
+  using OnHierarchyFunc = std::function<void(const std::shared_ptr<Bvh>&)>;
+  using OnFrameFunc = std::function<void(const BvhFrame& frame)>;
+
+private:
+  std::string pending_;
+  std::shared_ptr<Bvh> bvh_;
+  uint32_t frame_count_ = 0;
+  bool error_ = false;
+  OnHierarchyFunc onHierarchy_;
+  OnFrameFunc onFrame_;
+
+public:
+  void OnHierarchy(const OnHierarchyFunc& f) { onHierarchy_ = f; }
+  void OnFrame(const OnFrameFunc& f) { onFrame_ = f; }
+  // false if the input is malformed. the stream stops there
+  bool Feed(std::string_view chunk);
+  std::shared_ptr<Bvh> GetBvh() const { return bvh_; }
+  uint32_t FrameCount() const { return frame_count_; }
+
+private:
+  bool ParseHierarchy();
+  bool ParseFrames();
+};
+
+///
+/// follow a growing bvh file (tail -f) on a thread and feed the parser.
+/// linux waits for writes with inotify, other platforms poll.
+///
+class BvhFileFollower
+{
+  BvhStreamParser parser_;
+  std::thread thread_;
+  std::atomic<bool> stop_ = false;
+
+public:
+  BvhFileFollower(const BvhFileFollower&) = delete;
+  BvhFileFollower& operator=(const BvhFileFollower&) = delete;
+  BvhFileFollower();
+  ~BvhFileFollower();
+  // set the callbacks before Start. they are called on the follower thread
+  BvhStreamParser& Parser() { return parser_; }
+  bool Start(const std::string& path);
+  void Stop();
+
+private:
+  void Run(FILE* fp, std::string path);
+};
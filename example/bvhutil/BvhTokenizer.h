@@ -0,0 +1,243 @@
+#pragma once
+#include "BvhNumber.h"
+#include <bit>
+#include <charconv>
+#include <optional>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string_view>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SCAN_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define BVH_SCAN_AVX2 1
+#include <immintrin.h>
+#endif
+
+// the whole token is the number: "1.5x" fails
+template<typename T>
+std::optional<T>
+to_num(std::string_view view)
+{
+  T value;
+  auto last = view.data() + view.size();
+  if constexpr (std::is_floating_point_v<T>) {
+    if (bvh_number::parse(view.data(), last, value) != last) {
+      return {};
+    }
+  } else {
+    auto [ptr, ec] = std::from_chars(view.data(), last, value);
+    if (ec != std::errc{} || ptr != last) {
+      return {};
+    }
+  }
+  return value;
+}
+
+///
+/// whitespace / newline scanner.
+///
+/// whitespace is the "C" locale std::isspace set: ' ', '\t', '\n', '\v',
+/// '\f', '\r'. the simd paths test 32(avx2) or 16(sse2) bytes per step and
+/// the tail is done by the scalar loop.
+///
+namespace bvh_scan {
+
+inline bool
+is_space(char c)
+{
+  // '\t' .. '\r' is 0x09 .. 0x0d
+  return c == ' ' || static_cast<unsigned char>(c - '\t') < 5;
+}
+
+#ifdef BVH_SCAN_AVX2
+inline uint32_t
+space_mask32(const char* p)
+{
+  auto v = _mm256_loadu_si256((const __m256i*)p);
+  auto sp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+  auto t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+  auto ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t);
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(sp, ctl)));
+}
+#endif
+
+#ifdef BVH_SCAN_SSE2
+inline uint32_t
+space_mask16(const char* p)
+{
+  auto v = _mm_loadu_si128((const __m128i*)p);
+  auto sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  auto t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+  auto ctl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+  return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(sp, ctl)));
+}
+#endif
+
+// first whitespace in [p, end) or end
+inline const char*
+find_space(const char* p, const char* end)
+{
+#ifdef BVH_SCAN_AVX2
+  for (; end - p >= 32; p += 32) {
+    if (auto mask = space_mask32(p)) {
+      return p + std::countr_zero(mask);
+    }
+  }
+#endif
+#ifdef BVH_SCAN_SSE2
+  for (; end - p >= 16; p += 16) {
+    if (auto mask = space_mask16(p)) {
+      return p + std::countr_zero(mask);
+    }
+  }
+#endif
+  for (; p != end; ++p) {
+    if (is_space(*p)) {
+      return p;
+    }
+  }
+  return end;
+}
+
+// first non whitespace in [p, end) or end
+inline const char*
+skip_space(const char* p, const char* end)
+{
+#ifdef BVH_SCAN_AVX2
+  for (; end - p >= 32; p += 32) {
+    if (auto mask = ~space_mask32(p)) {
+      return p + std::countr_zero(mask);
+    }
+  }
+#endif
+#ifdef BVH_SCAN_SSE2
+  for (; end - p >= 16; p += 16) {
+    if (auto mask = ~space_mask16(p) & 0xffff) {
+      return p + std::countr_zero(mask);
+    }
+  }
+#endif
+  for (; p != end; ++p) {
+    if (!is_space(*p)) {
+      return p;
+    }
+  }
+  return end;
+}
+
+// first '\n' in [p, end) or end
+inline const char*
+find_eol(const char* p, const char* end)
+{
+  // memchr is vectorized by every libc we build with
+  if (auto found = (const char*)memchr(p, '\n', end - p)) {
+    return found;
+  }
+  return end;
+}
+
+} // namespace bvh_scan
+
+//
+// delimiter policies for Tokenizer::token.
+// tail: end of the token (the delimiter position) or end when not found.
+// next: start of the next token.
+//
+
+// token ends at whitespace. skip the whitespace run.
+struct SpaceDelimiter
+{
+  static const char* tail(const char* p, const char* end)
+  {
+    return bvh_scan::find_space(p, end);
+  }
+  static const char* next(const char* tail, const char* end)
+  {
+    return bvh_scan::skip_space(tail, end);
+  }
+};
+
+// token is the rest of the line.
+struct EolDelimiter
+{
+  static const char* tail(const char* p, const char* end)
+  {
+    return bvh_scan::find_eol(p, end);
+  }
+  static const char* next(const char* tail, const char* end)
+  {
+    return tail + 1;
+  }
+};
+
+// token is the rest of the line. skip the indent of the next line.
+struct NameDelimiter
+{
+  static const char* tail(const char* p, const char* end)
+  {
+    return bvh_scan::find_eol(p, end);
+  }
+  static const char* next(const char* tail, const char* end)
+  {
+    return bvh_scan::skip_space(tail + 1, end);
+  }
+};
+
+class Tokenizer
+{
+  const char* m_pos;
+  const char* m_end;
+
+public:
+  Tokenizer(std::string_view data)
+    : m_pos(data.data())
+    , m_end(data.data() + data.size())
+  {
+  }
+
+  // not consumed part
+  std::string_view rest() const { return { m_pos, size_t(m_end - m_pos) }; }
+
+  template<typename D>
+  std::optional<std::string_view> token()
+  {
+    auto tail = D::tail(m_pos, m_end);
+    if (tail == m_end) {
+      return {};
+    }
+    auto begin = m_pos;
+    m_pos = D::next(tail, m_end);
+    return std::string_view(begin, tail - begin);
+  }
+
+  template<typename D>
+  bool expect(std::string_view expected)
+  {
+    if (auto line = token<D>()) {
+      if (*line == expected) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template<typename T, typename D>
+  std::optional<T> number()
+  {
+    auto n = token<D>();
+    if (!n) {
+      return {};
+    }
+    if (auto value = to_num<T>(*n)) {
+      return *value;
+    } else {
+      return {};
+    }
+  }
+};
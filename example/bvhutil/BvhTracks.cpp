@@ -0,0 +1,150 @@
+#include <DirectXMath.h>
+
+#include "BvhTracks.h"
+#include "Bvh.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+std::shared_ptr<BvhTracks>
+BvhTracks::Build(const Bvh& bvh, uint32_t threads)
+{
+  if (bvh.frames.size() != size_t(bvh.frame_count) * bvh.frame_channel_count) {
+    // not decoded (lazy)
+    return {};
+  }
+  auto tracks = std::make_shared<BvhTracks>();
+  tracks->frame_count = bvh.FrameCount();
+  tracks->joint_count = static_cast<uint32_t>(bvh.joints.size());
+  auto size = size_t(tracks->frame_count) * tracks->joint_count;
+  tracks->rotations.resize(size);
+  tracks->translations.resize(size);
+
+  auto build_range = [&bvh, t = tracks.get()](size_t first, size_t last) {
+    for (auto i = first; i < last; ++i) {
+      auto frame = bvh.GetFrame(static_cast<int>(i));
+      auto dst = i * t->joint_count;
+      for (auto& joint : bvh.joints) {
+        auto [pos, rot] = frame.Resolve(joint.channels);
+        t->translations[dst + joint.index] = pos;
+        DirectX::XMStoreFloat4(
+          &t->rotations[dst + joint.index],
+          DirectX::XMQuaternionNormalize(
+            DirectX::XMQuaternionRotationMatrix(rot)));
+      }
+    }
+  };
+
+  // frames are independent. same split as BvhFlatSolver::Bake
+  if (threads == 1) {
+    build_range(0, tracks->frame_count);
+  } else {
+    ParallelRanges(tracks->frame_count, threads, build_range);
+  }
+
+  // q and -q are the same rotation. pick the one nearest to the previous
+  // frame so the tracks interpolate without detours
+  auto& rotations = tracks->rotations;
+  for (size_t i = tracks->joint_count; i < size; ++i) {
+    auto prev = DirectX::XMLoadFloat4(&rotations[i - tracks->joint_count]);
+    auto q = DirectX::XMLoadFloat4(&rotations[i]);
+    if (DirectX::XMVectorGetX(DirectX::XMVector4Dot(prev, q)) < 0) {
+      DirectX::XMStoreFloat4(&rotations[i], DirectX::XMVectorNegate(q));
+    }
+  }
+  return tracks;
+}
+
+uint64_t
+BvhTracks::Bytes(const Bvh& bvh)
+{
+  return uint64_t(bvh.FrameCount()) * bvh.joints.size() *
+         (sizeof(DirectX::XMFLOAT4) + sizeof(DirectX::XMFLOAT3));
+}
+
+// four quaternions as x, y, z, w vectors
+static void
+Slerp4(const DirectX::XMMATRIX& a,
+       const DirectX::XMMATRIX& b,
+       float t,
+       DirectX::XMMATRIX& out)
+{
+  using namespace DirectX;
+  auto dot = XMVectorMultiply(a.r[0], b.r[0]);
+  dot = XMVectorMultiplyAdd(a.r[1], b.r[1], dot);
+  dot = XMVectorMultiplyAdd(a.r[2], b.r[2], dot);
+  dot = XMVectorMultiplyAdd(a.r[3], b.r[3], dot);
+
+  // shortest path
+  auto zero = XMVectorZero();
+  auto one = XMVectorSplatOne();
+  auto negative = XMVectorLess(dot, zero);
+  auto sign = XMVectorSelect(one, XMVectorNegate(one), negative);
+  dot = XMVectorAbs(dot);
+
+  auto theta = XMVectorACos(XMVectorMin(dot, one));
+  auto inv_sin = XMVectorReciprocal(XMVectorSin(theta));
+  auto t0 = XMVectorReplicate(1.0f - t);
+  auto t1 = XMVectorReplicate(t);
+  auto w0 = XMVectorMultiply(XMVectorSin(XMVectorMultiply(t0, theta)), inv_sin);
+  auto w1 = XMVectorMultiply(XMVectorSin(XMVectorMultiply(t1, theta)), inv_sin);
+  // nearly the same rotation. sin(theta) is too small to divide by
+  auto nearly = XMVectorGreater(dot, XMVectorReplicate(0.9995f));
+  w0 = XMVectorSelect(w0, t0, nearly);
+  w1 = XMVectorMultiply(XMVectorSelect(w1, t1, nearly), sign);
+
+  XMMATRIX r;
+  for (int i = 0; i < 4; ++i) {
+    r.r[i] = XMVectorMultiplyAdd(a.r[i], w0, XMVectorMultiply(b.r[i], w1));
+  }
+  // lerp is not unit length
+  auto len = XMVectorMultiply(r.r[0], r.r[0]);
+  for (int i = 1; i < 4; ++i) {
+    len = XMVectorMultiplyAdd(r.r[i], r.r[i], len);
+  }
+  auto inv_len = XMVectorReciprocalSqrt(len);
+  for (int i = 0; i < 4; ++i) {
+    out.r[i] = XMVectorMultiply(r.r[i], inv_len);
+  }
+}
+
+void
+BvhSlerp(std::span<const DirectX::XMFLOAT4> a,
+         std::span<const DirectX::XMFLOAT4> b,
+         float t,
+         std::span<DirectX::XMFLOAT4> out)
+{
+  auto count = std::min({ a.size(), b.size(), out.size() });
+  for (size_t i = 0; i < count; i += 4) {
+    // the tail is padded with identity
+    auto n = std::min<size_t>(4, count - i);
+    DirectX::XMMATRIX qa = DirectX::XMMatrixIdentity();
+    DirectX::XMMATRIX qb = DirectX::XMMatrixIdentity();
+    for (size_t j = 0; j < n; ++j) {
+      qa.r[j] = DirectX::XMLoadFloat4(&a[i + j]);
+      qb.r[j] = DirectX::XMLoadFloat4(&b[i + j]);
+    }
+    DirectX::XMMATRIX r;
+    Slerp4(
+      DirectX::XMMatrixTranspose(qa), DirectX::XMMatrixTranspose(qb), t, r);
+    r = DirectX::XMMatrixTranspose(r);
+    for (size_t j = 0; j < n; ++j) {
+      DirectX::XMStoreFloat4(&out[i + j], r.r[j]);
+    }
+  }
+}
+
+void
+BvhTracks::Blend(uint32_t a, uint32_t b, float t, BvhPose& out) const
+{
+  out.rotations.resize(joint_count);
+  out.translations.resize(joint_count);
+  BvhSlerp(Rotations(a), Rotations(b), t, out.rotations);
+  auto ta = Translations(a);
+  auto tb = Translations(b);
+  for (uint32_t i = 0; i < joint_count; ++i) {
+    DirectX::XMStoreFloat3(&out.translations[i],
+                           DirectX::XMVectorLerp(DirectX::XMLoadFloat3(&ta[i]),
+                                                 DirectX::XMLoadFloat3(&tb[i]),
+                                                 t));
+  }
+}
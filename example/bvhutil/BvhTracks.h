@@ -0,0 +1,60 @@
+#pragma once
+#include "BvhFrame.h"
+#include <grapho/dxmath_stub.h>
+#include <memory>
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+struct Bvh;
+
+// interpolated local pose. what a sampled BvhFrame points to
+struct BvhPose
+{
+  std::vector<DirectX::XMFLOAT4> rotations;
+  std::vector<DirectX::XMFLOAT3> translations;
+};
+
+// out[i] = slerp(a[i], b[i], t), shortest path.
+// four quaternions per step, transposed to x, y, z, w vectors.
+void
+BvhSlerp(std::span<const DirectX::XMFLOAT4> a,
+         std::span<const DirectX::XMFLOAT4> b,
+         float t,
+         std::span<DirectX::XMFLOAT4> out);
+
+///
+/// local pose of every joint for every frame, decoded once.
+///
+/// rotations and translations are separate arrays ([frame][joint]), so a
+/// frame is two contiguous spans. quaternions are normalized and kept in
+/// the same hemisphere as the previous frame of the joint (no sign flips
+/// along a track). translations are unscaled, as BvhFrame::Resolve returns.
+///
+/// with tracks, Bvh::GetFrame points BvhFrame at them and the per frame
+/// playback does no trig and no matrix to quaternion conversion.
+///
+struct BvhTracks
+{
+  uint32_t frame_count = 0;
+  uint32_t joint_count = 0;
+  std::vector<DirectX::XMFLOAT4> rotations;
+  std::vector<DirectX::XMFLOAT3> translations;
+
+  // nullptr if the frames are not decoded (lazy).
+  // threads: ranges on WorkStealingPool::Shared, 0 for one per pool thread
+  static std::shared_ptr<BvhTracks> Build(const Bvh& bvh, uint32_t threads = 0);
+  // what Build would allocate: 7 floats per joint per frame
+  static uint64_t Bytes(const Bvh& bvh);
+
+  std::span<const DirectX::XMFLOAT4> Rotations(uint32_t frame) const
+  {
+    return { rotations.data() + size_t(frame) * joint_count, joint_count };
+  }
+  std::span<const DirectX::XMFLOAT3> Translations(uint32_t frame) const
+  {
+    return { translations.data() + size_t(frame) * joint_count, joint_count };
+  }
+  // slerp rotations, lerp translations of frame a and b
+  void Blend(uint32_t a, uint32_t b, float t, BvhPose& out) const;
+};
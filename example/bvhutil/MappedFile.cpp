@@ -0,0 +1,130 @@
+#include "MappedFile.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {}
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+#ifdef _WIN32
+bool
+MappedFile::Open(const std::string& path, bool sequential)
+{
+  Close();
+  file_ = CreateFileA(path.c_str(),
+                      GENERIC_READ,
+                      FILE_SHARE_READ,
+                      nullptr,
+                      OPEN_EXISTING,
+                      sequential ? FILE_FLAG_SEQUENTIAL_SCAN
+                                 : FILE_ATTRIBUTE_NORMAL,
+                      nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    file_ = nullptr;
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+    Close();
+    return false;
+  }
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping_) {
+    Close();
+    return false;
+  }
+  data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (!data_) {
+    Close();
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+void
+MappedFile::Close()
+{
+  if (data_) {
+    UnmapViewOfFile(data_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+  if (mapping_) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+  if (file_) {
+    CloseHandle(file_);
+    file_ = nullptr;
+  }
+}
+
+void
+MappedFile::Prefetch(size_t offset, size_t size) const
+{
+  // no-op. FILE_FLAG_SEQUENTIAL_SCAN reads ahead for sequential playback
+}
+#else
+bool
+MappedFile::Open(const std::string& path, bool sequential)
+{
+  Close();
+  fd_ = open(path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || st.st_size == 0) {
+    Close();
+    return false;
+  }
+  auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (p == MAP_FAILED) {
+    Close();
+    return false;
+  }
+  if (sequential) {
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+  }
+  data_ = (const char*)p;
+  size_ = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+void
+MappedFile::Close()
+{
+  if (data_) {
+    munmap((void*)data_, size_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+void
+MappedFile::Prefetch(size_t offset, size_t size) const
+{
+  if (offset >= size_) {
+    return;
+  }
+  // madvise needs a page aligned address
+  auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  auto begin = offset / page * page;
+  auto end = std::min(offset + size, size_);
+  madvise((void*)(data_ + begin), end - begin, MADV_WILLNEED);
+}
+#endif
@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <string_view>
+
+///
+/// read only memory mapped file.
+///
+/// the mapping is the backing store of the text parser.
+/// no intermediate copy of the file is made.
+///
+class MappedFile
+{
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+
+public:
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile();
+  ~MappedFile();
+  // sequential: hint the kernel that the mapping is read front to back
+  bool Open(const std::string& path, bool sequential = true);
+  void Close();
+  // hint that [offset, offset + size) is read soon
+  void Prefetch(size_t offset, size_t size) const;
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string_view view() const { return { data_, size_ }; }
+};
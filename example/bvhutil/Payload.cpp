@@ -1,41 +1,103 @@
 #include "Payload.h"
-#include <iostream>
+#include <algorithm>
+#include <bit>
+#include <memory>
 
-Payload::Payload() { std::cout << "Payload::Payload" << std::endl; }
-Payload::~Payload() { std::cout << "Payload::~Payload" << std::endl; }
-
-void Payload::Push(const void *begin, const void *end) {
-  auto dst = buffer.size();
-  auto size = std::distance((const char *)begin, (const char *)end);
-  buffer.resize(dst + size);
-  std::copy((const char *)begin, (const char *)end, buffer.data() + dst);
-}
-
-void Payload::SetSkeleton(std::span<srht::JointDefinition> joints) {
-  buffer.clear();
+void Payload::SetSkeleton(uint16_t jointCount, uint16_t skeletonId,
+                          srht::SkeletonFlags flags) {
+  size = 0;
 
   srht::SkeletonHeader header{
       // .magic = {},
-      .skeletonId = 0,
-      .jointCount = 27,
-      .flags = {},
+      .skeletonId = skeletonId,
+      .jointCount = jointCount,
+      .flags = flags,
   };
   Push((const char *)&header, (const char *)&header + sizeof(header));
-  Push(joints.data(), joints.data() + joints.size());
 }
 
 void Payload::SetFrame(std::chrono::nanoseconds time, float x, float y, float z,
-                       bool usePack) {
-  buffer.clear();
+                       bool usePack, uint16_t skeletonId) {
+  size = 0;
 
   srht::FrameHeader header{
       // .magic = {},
       .time = time.count(),
       .flags = usePack ? srht::FrameFlags::USE_QUAT32 : srht::FrameFlags::NONE,
-      .skeletonId = 0,
+      .skeletonId = skeletonId,
       .x = x,
       .y = y,
       .z = z,
   };
   Push((const char *)&header, (const char *)&header + sizeof(header));
 }
+
+PayloadPool::PayloadPool(size_t count, size_t bytes)
+    : bytes_((bytes + 63) / 64 * 64) {
+  count = std::bit_ceil(std::max<size_t>(count, 2));
+  mask_ = count - 1;
+  slab_.resize(count * bytes_ + 64);
+  void *p = slab_.data();
+  auto space = slab_.size();
+  auto base = (uint8_t *)std::align(64, count * bytes_, p, space);
+
+  payloads_.resize(count);
+  cells_.reset(new Cell[count]);
+  for (size_t i = 0; i < count; ++i) {
+    payloads_[i] = {
+        .data = base + i * bytes_,
+        .capacity = bytes_,
+        .pool = this,
+    };
+    // every payload starts free
+    cells_[i].sequence.store(i + 1, std::memory_order_relaxed);
+    cells_[i].index = static_cast<uint32_t>(i);
+  }
+  enqueue_.store(count, std::memory_order_relaxed);
+  dequeue_.store(0, std::memory_order_relaxed);
+}
+
+Payload *PayloadPool::Acquire() {
+  auto pos = dequeue_.load(std::memory_order_relaxed);
+  for (;;) {
+    auto &cell = cells_[pos & mask_];
+    auto seq = cell.sequence.load(std::memory_order_acquire);
+    auto diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (dequeue_.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+        auto payload = &payloads_[cell.index];
+        // the cell is free for the enqueue one lap later
+        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        payload->size = 0;
+        return payload;
+      }
+    } else if (diff < 0) {
+      // empty
+      return nullptr;
+    } else {
+      pos = dequeue_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void PayloadPool::Release(Payload *payload) {
+  auto index = static_cast<uint32_t>(payload - payloads_.data());
+  auto pos = enqueue_.load(std::memory_order_relaxed);
+  for (;;) {
+    auto &cell = cells_[pos & mask_];
+    auto seq = cell.sequence.load(std::memory_order_acquire);
+    auto diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (enqueue_.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+        cell.index = index;
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        return;
+      }
+    } else {
+      // never full: at most Count() payloads are released
+      pos = enqueue_.load(std::memory_order_relaxed);
+    }
+  }
+}
@@ -1,21 +1,73 @@
 #pragma once
 #include "srht.h"
+#include <atomic>
 #include <chrono>
+#include <memory>
 #include <span>
+#include <string.h>
 #include <vector>
 
+class PayloadPool;
+
+///
+/// one datagram in a PayloadPool slab. fields are written in place, the
+/// caller checks Fits once for the whole datagram.
+///
 struct Payload {
-  std::vector<uint8_t> buffer;
+  uint8_t *data = nullptr;
+  size_t size = 0;
+  size_t capacity = 0;
+  PayloadPool *pool = nullptr;
+  // memory for the asio operation that sends this payload
+  static constexpr size_t HANDLER_BYTES = 512;
+  alignas(16) uint8_t handler[HANDLER_BYTES];
+  bool handlerInUse = false;
 
-  Payload(const Payload &) = delete;
-  Payload &operator=(const Payload &) = delete;
-  Payload();
-  ~Payload();
-  void Push(const void *begin, const void *end);
+  bool Fits(size_t bytes) const { return bytes <= capacity; }
+  void Push(const void *begin, const void *end) {
+    auto n = (const char *)end - (const char *)begin;
+    memcpy(data + size, begin, n);
+    size += n;
+  }
   template <typename T> void Push(const T &t) {
     Push((const char *)&t, (const char *)&t + sizeof(T));
   }
-  void SetSkeleton(std::span<srht::JointDefinition> joints);
+  std::span<const uint8_t> Bytes() const { return {data, size}; }
+  // header only. JointDefinition x jointCount follows (or what flags tell)
+  void SetSkeleton(uint16_t jointCount, uint16_t skeletonId = 0,
+                   srht::SkeletonFlags flags = {});
+  // header only. a rotation per joint follows
   void SetFrame(std::chrono::nanoseconds time, float x, float y, float z,
-                bool usePack);
+                bool usePack, uint16_t skeletonId = 0);
+};
+
+///
+/// fixed number of preallocated payloads of the same capacity, 64 byte
+/// aligned in one slab. the free list is a bounded lock-free MPMC ring of
+/// payload indices (sequence numbered cells), so Acquire and Release on
+/// the send path neither lock nor allocate.
+///
+class PayloadPool {
+  struct Cell {
+    std::atomic<size_t> sequence;
+    uint32_t index;
+  };
+  size_t bytes_ = 0;
+  std::vector<uint8_t> slab_;
+  std::vector<Payload> payloads_;
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_ = 0;
+  alignas(64) std::atomic<size_t> enqueue_ = 0;
+  alignas(64) std::atomic<size_t> dequeue_ = 0;
+
+public:
+  PayloadPool(const PayloadPool &) = delete;
+  PayloadPool &operator=(const PayloadPool &) = delete;
+  // count: rounded up to a power of 2. bytes: capacity of each payload
+  PayloadPool(size_t count, size_t bytes);
+  size_t Count() const { return payloads_.size(); }
+  size_t Bytes() const { return bytes_; }
+  // empty payload. nullptr when every payload is in flight
+  Payload *Acquire();
+  void Release(Payload *payload);
 };
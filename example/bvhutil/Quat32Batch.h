@@ -0,0 +1,320 @@
+#pragma once
+#include "srht.h"
+#include <span>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+  (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUAT32_BATCH_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define QUAT32_BATCH_AVX2 1
+#include <immintrin.h>
+#endif
+
+///
+/// quat_packer::Pack / Unpack for a whole skeleton.
+///
+/// 8(avx2) or 4(sse2) quaternions per step: transposed to x, y, z, w
+/// vectors, the largest component is selected with compare masks instead
+/// of branches and the dropped one is restored with one vectorized sqrt.
+/// the tail is done by the scalar functions.
+///
+/// the same float operations in the same order as the scalar code, so the
+/// result is bit identical to it and to mu::quat32. that holds only without
+/// fma contraction: gcc fuses a * b + c of both the scalar code and these
+/// intrinsics under -mfma. the meson targets build with -ffp-contract=off.
+///
+namespace quat_packer {
+
+#ifdef QUAT32_BATCH_SSE2
+namespace batch_sse2 {
+
+inline __m128
+select(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline void
+transpose(__m128& r0, __m128& r1, __m128& r2, __m128& r3)
+{
+  auto t0 = _mm_unpacklo_ps(r0, r1);
+  auto t1 = _mm_unpackhi_ps(r0, r1);
+  auto t2 = _mm_unpacklo_ps(r2, r3);
+  auto t3 = _mm_unpackhi_ps(r2, r3);
+  r0 = _mm_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  r1 = _mm_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  r2 = _mm_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  r3 = _mm_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+inline __m128i
+pack(__m128 a)
+{
+  auto v = _mm_mul_ps(
+    _mm_mul_ps(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(SR2)), _mm_set1_ps(1.0f)),
+               _mm_set1_ps(0.5f)),
+    _mm_set1_ps(C));
+  return _mm_and_si128(_mm_cvttps_epi32(v), _mm_set1_epi32(0x3ff));
+}
+
+inline __m128
+unpack(__m128i a)
+{
+  auto v = _mm_mul_ps(_mm_cvtepi32_ps(a), _mm_set1_ps(R));
+  return _mm_mul_ps(
+    _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(2.0f)), _mm_set1_ps(1.0f)),
+    _mm_set1_ps(RSR2));
+}
+
+// 4 quaternions
+inline __m128i
+Pack4(const float* src)
+{
+  auto x = _mm_loadu_ps(src);
+  auto y = _mm_loadu_ps(src + 4);
+  auto z = _mm_loadu_ps(src + 8);
+  auto w = _mm_loadu_ps(src + 12);
+  transpose(x, y, z, w);
+
+  // dropmax
+  auto xx = _mm_mul_ps(x, x);
+  auto yy = _mm_mul_ps(y, y);
+  auto zz = _mm_mul_ps(z, z);
+  auto ww = _mm_mul_ps(w, w);
+  auto d0 = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(xx, yy), _mm_cmpgt_ps(xx, zz)),
+                       _mm_cmpgt_ps(xx, ww));
+  auto d1 = _mm_andnot_ps(
+    d0, _mm_and_ps(_mm_cmpgt_ps(yy, zz), _mm_cmpgt_ps(yy, ww)));
+  auto d01 = _mm_or_ps(d0, d1);
+  auto d2 = _mm_andnot_ps(d01, _mm_cmpgt_ps(zz, ww));
+  auto d012 = _mm_or_ps(d01, d2);
+
+  // sign of the dropped component
+  auto s = select(d0, x, select(d1, y, select(d2, z, w)));
+  auto sign = select(_mm_cmplt_ps(s, _mm_setzero_ps()),
+                     _mm_set1_ps(-1.0f),
+                     _mm_set1_ps(1.0f));
+  auto a0 = _mm_mul_ps(select(d0, y, x), sign);
+  auto a1 = _mm_mul_ps(select(d01, z, y), sign);
+  auto a2 = _mm_mul_ps(select(d012, w, z), sign);
+
+  auto drop = _mm_or_si128(
+    _mm_or_si128(_mm_and_si128(_mm_castps_si128(d1), _mm_set1_epi32(1)),
+                 _mm_and_si128(_mm_castps_si128(d2), _mm_set1_epi32(2))),
+    _mm_andnot_si128(_mm_castps_si128(d012), _mm_set1_epi32(3)));
+  return _mm_or_si128(
+    _mm_or_si128(pack(a0), _mm_slli_epi32(pack(a1), 10)),
+    _mm_or_si128(_mm_slli_epi32(pack(a2), 20), _mm_slli_epi32(drop, 30)));
+}
+
+// 4 quaternions
+inline void
+Unpack4(__m128i src, float* dst)
+{
+  auto mask = _mm_set1_epi32(0x3ff);
+  auto a0 = unpack(_mm_and_si128(src, mask));
+  auto a1 = unpack(_mm_and_si128(_mm_srli_epi32(src, 10), mask));
+  auto a2 = unpack(_mm_and_si128(_mm_srli_epi32(src, 20), mask));
+  auto iss = _mm_sqrt_ps(_mm_sub_ps(
+    _mm_set1_ps(1.0f),
+    _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, a0), _mm_mul_ps(a1, a1)),
+               _mm_mul_ps(a2, a2))));
+
+  auto drop = _mm_srli_epi32(src, 30);
+  auto d0 = _mm_castsi128_ps(_mm_cmpeq_epi32(drop, _mm_setzero_si128()));
+  auto d1 = _mm_castsi128_ps(_mm_cmpeq_epi32(drop, _mm_set1_epi32(1)));
+  auto d2 = _mm_castsi128_ps(_mm_cmpeq_epi32(drop, _mm_set1_epi32(2)));
+  auto d3 = _mm_castsi128_ps(_mm_cmpeq_epi32(drop, _mm_set1_epi32(3)));
+  auto x = select(d0, iss, a0);
+  auto y = select(d0, a0, select(d1, iss, a1));
+  auto z = select(d3, a2, select(d2, iss, a1));
+  auto w = select(d3, iss, a2);
+
+  transpose(x, y, z, w);
+  _mm_storeu_ps(dst, x);
+  _mm_storeu_ps(dst + 4, y);
+  _mm_storeu_ps(dst + 8, z);
+  _mm_storeu_ps(dst + 12, w);
+}
+
+} // namespace batch_sse2
+#endif
+
+#ifdef QUAT32_BATCH_AVX2
+namespace batch_avx2 {
+
+// 2 quaternions per row. each 128bit lane is transposed by itself
+inline void
+transpose(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+{
+  auto t0 = _mm256_unpacklo_ps(r0, r1);
+  auto t1 = _mm256_unpackhi_ps(r0, r1);
+  auto t2 = _mm256_unpacklo_ps(r2, r3);
+  auto t3 = _mm256_unpackhi_ps(r2, r3);
+  r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+inline __m256i
+pack(__m256 a)
+{
+  auto v = _mm256_mul_ps(
+    _mm256_mul_ps(
+      _mm256_add_ps(_mm256_mul_ps(a, _mm256_set1_ps(SR2)),
+                    _mm256_set1_ps(1.0f)),
+      _mm256_set1_ps(0.5f)),
+    _mm256_set1_ps(C));
+  return _mm256_and_si256(_mm256_cvttps_epi32(v), _mm256_set1_epi32(0x3ff));
+}
+
+inline __m256
+unpack(__m256i a)
+{
+  auto v = _mm256_mul_ps(_mm256_cvtepi32_ps(a), _mm256_set1_ps(R));
+  return _mm256_mul_ps(
+    _mm256_sub_ps(_mm256_mul_ps(v, _mm256_set1_ps(2.0f)), _mm256_set1_ps(1.0f)),
+    _mm256_set1_ps(RSR2));
+}
+
+// 8 quaternions
+inline __m256i
+Pack8(const float* src)
+{
+  // lanes hold q0 q2 q4 q6 | q1 q3 q5 q7 after the transpose
+  auto x = _mm256_loadu_ps(src);
+  auto y = _mm256_loadu_ps(src + 8);
+  auto z = _mm256_loadu_ps(src + 16);
+  auto w = _mm256_loadu_ps(src + 24);
+  transpose(x, y, z, w);
+
+  auto xx = _mm256_mul_ps(x, x);
+  auto yy = _mm256_mul_ps(y, y);
+  auto zz = _mm256_mul_ps(z, z);
+  auto ww = _mm256_mul_ps(w, w);
+  auto d0 = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(xx, yy, _CMP_GT_OQ),
+                                        _mm256_cmp_ps(xx, zz, _CMP_GT_OQ)),
+                          _mm256_cmp_ps(xx, ww, _CMP_GT_OQ));
+  auto d1 = _mm256_andnot_ps(d0,
+                             _mm256_and_ps(_mm256_cmp_ps(yy, zz, _CMP_GT_OQ),
+                                           _mm256_cmp_ps(yy, ww, _CMP_GT_OQ)));
+  auto d01 = _mm256_or_ps(d0, d1);
+  auto d2 = _mm256_andnot_ps(d01, _mm256_cmp_ps(zz, ww, _CMP_GT_OQ));
+  auto d012 = _mm256_or_ps(d01, d2);
+
+  auto s = _mm256_blendv_ps(
+    _mm256_blendv_ps(_mm256_blendv_ps(w, z, d2), y, d1), x, d0);
+  auto sign = _mm256_blendv_ps(_mm256_set1_ps(1.0f),
+                               _mm256_set1_ps(-1.0f),
+                               _mm256_cmp_ps(s, _mm256_setzero_ps(), _CMP_LT_OQ));
+  auto a0 = _mm256_mul_ps(_mm256_blendv_ps(x, y, d0), sign);
+  auto a1 = _mm256_mul_ps(_mm256_blendv_ps(y, z, d01), sign);
+  auto a2 = _mm256_mul_ps(_mm256_blendv_ps(z, w, d012), sign);
+
+  auto drop = _mm256_or_si256(
+    _mm256_or_si256(
+      _mm256_and_si256(_mm256_castps_si256(d1), _mm256_set1_epi32(1)),
+      _mm256_and_si256(_mm256_castps_si256(d2), _mm256_set1_epi32(2))),
+    _mm256_andnot_si256(_mm256_castps_si256(d012), _mm256_set1_epi32(3)));
+  auto packed = _mm256_or_si256(
+    _mm256_or_si256(pack(a0), _mm256_slli_epi32(pack(a1), 10)),
+    _mm256_or_si256(_mm256_slli_epi32(pack(a2), 20),
+                    _mm256_slli_epi32(drop, 30)));
+  // back to q0 .. q7
+  return _mm256_permutevar8x32_epi32(packed,
+                                     _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+// 8 quaternions
+inline void
+Unpack8(__m256i src, float* dst)
+{
+  // q0 q2 q4 q6 | q1 q3 q5 q7, so that the transpose gives q0 .. q7
+  src = _mm256_permutevar8x32_epi32(src,
+                                    _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+  auto mask = _mm256_set1_epi32(0x3ff);
+  auto a0 = unpack(_mm256_and_si256(src, mask));
+  auto a1 = unpack(_mm256_and_si256(_mm256_srli_epi32(src, 10), mask));
+  auto a2 = unpack(_mm256_and_si256(_mm256_srli_epi32(src, 20), mask));
+  auto iss = _mm256_sqrt_ps(_mm256_sub_ps(
+    _mm256_set1_ps(1.0f),
+    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a0, a0), _mm256_mul_ps(a1, a1)),
+                  _mm256_mul_ps(a2, a2))));
+
+  auto drop = _mm256_srli_epi32(src, 30);
+  auto d0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(drop, _mm256_setzero_si256()));
+  auto d1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(drop, _mm256_set1_epi32(1)));
+  auto d2 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(drop, _mm256_set1_epi32(2)));
+  auto d3 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(drop, _mm256_set1_epi32(3)));
+  auto x = _mm256_blendv_ps(a0, iss, d0);
+  auto y = _mm256_blendv_ps(_mm256_blendv_ps(a1, iss, d1), a0, d0);
+  auto z = _mm256_blendv_ps(_mm256_blendv_ps(a1, iss, d2), a2, d3);
+  auto w = _mm256_blendv_ps(a2, iss, d3);
+
+  transpose(x, y, z, w);
+  _mm256_storeu_ps(dst, x);
+  _mm256_storeu_ps(dst + 8, y);
+  _mm256_storeu_ps(dst + 16, z);
+  _mm256_storeu_ps(dst + 24, w);
+}
+
+} // namespace batch_avx2
+#endif
+
+// xyzw: x, y, z, w of dst.size() quaternions.
+// in place: dst may start at xyzw.data(), every quaternion is read before
+// its packed value is written
+inline void
+PackBatch(std::span<const float> xyzw, std::span<uint32_t> dst)
+{
+  auto src = xyzw.data();
+  size_t i = 0;
+#ifdef QUAT32_BATCH_AVX2
+  for (; i + 8 <= dst.size(); i += 8) {
+    auto packed = batch_avx2::Pack8(src + i * 4);
+    _mm256_storeu_si256((__m256i*)(dst.data() + i), packed);
+  }
+#endif
+#ifdef QUAT32_BATCH_SSE2
+  for (; i + 4 <= dst.size(); i += 4) {
+    auto packed = batch_sse2::Pack4(src + i * 4);
+    _mm_storeu_si128((__m128i*)(dst.data() + i), packed);
+  }
+#endif
+  for (; i < dst.size(); ++i) {
+    float q[4];
+    memcpy(q, src + i * 4, sizeof(q));
+    auto packed = Pack(q[0], q[1], q[2], q[3]);
+    memcpy(dst.data() + i, &packed, sizeof(packed));
+  }
+}
+
+// xyzw: x, y, z, w of src.size() quaternions
+inline void
+UnpackBatch(std::span<const uint32_t> src, std::span<float> xyzw)
+{
+  auto dst = xyzw.data();
+  size_t i = 0;
+#ifdef QUAT32_BATCH_AVX2
+  for (; i + 8 <= src.size(); i += 8) {
+    batch_avx2::Unpack8(_mm256_loadu_si256((const __m256i*)(src.data() + i)),
+                        dst + i * 4);
+  }
+#endif
+#ifdef QUAT32_BATCH_SSE2
+  for (; i + 4 <= src.size(); i += 4) {
+    batch_sse2::Unpack4(_mm_loadu_si128((const __m128i*)(src.data() + i)),
+                        dst + i * 4);
+  }
+#endif
+  for (; i < src.size(); ++i) {
+    Unpack(src[i], dst + i * 4);
+  }
+}
+
+} // namespace quat_packer
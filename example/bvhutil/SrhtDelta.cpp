@@ -0,0 +1,212 @@
+#include "SrhtDelta.h"
+#include <algorithm>
+#include <cstdlib>
+#include <string.h>
+
+namespace srht {
+
+static const uint32_t COMPONENT = 0x3ff;
+
+enum JointCode : uint8_t
+{
+  KEYFRAME = 0,
+  SMALL = 1,
+  VARINT = 2,
+  PACKED = 3,
+};
+
+// 5 bit signed
+static const int32_t SMALL_MIN = -16;
+static const int32_t SMALL_MAX = 15;
+
+static uint32_t
+Zigzag(int32_t v)
+{
+  return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+static int32_t
+Unzigzag(uint32_t v)
+{
+  return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+static size_t
+VarintSize(uint32_t v)
+{
+  size_t size = 1;
+  for (; v >= 0x80; v >>= 7) {
+    ++size;
+  }
+  return size;
+}
+
+static uint8_t*
+PutVarint(uint8_t* p, uint32_t v)
+{
+  while (v >= 0x80) {
+    *p++ = static_cast<uint8_t>(v) | 0x80;
+    v >>= 7;
+  }
+  *p++ = static_cast<uint8_t>(v);
+  return p;
+}
+
+static bool
+GetVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v)
+{
+  v = 0;
+  // zigzag of a 10 bit delta fits in 2 bytes. more is malformed
+  for (int shift = 0; shift < 14; shift += 7) {
+    if (p == end) {
+      return false;
+    }
+    auto b = *p++;
+    v |= static_cast<uint32_t>(b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int32_t
+Component(uint32_t packed, int j)
+{
+  return static_cast<int32_t>((packed >> (j * 10)) & COMPONENT);
+}
+
+size_t
+EncodeDelta(int64_t keyframeTime,
+            std::span<const uint32_t> keyframe,
+            std::span<const uint32_t> current,
+            uint32_t threshold,
+            uint8_t* dst)
+{
+  DeltaHeader header{ .keyframeTime = keyframeTime };
+  memcpy(dst, &header, sizeof(header));
+  auto codes = dst + sizeof(header);
+  auto codeBytes = (current.size() + 3) / 4;
+  memset(codes, 0, codeBytes);
+
+  auto p = codes + codeBytes;
+  for (size_t i = 0; i < current.size(); ++i) {
+    auto k = keyframe[i];
+    auto c = current[i];
+    if (c == k) {
+      continue;
+    }
+    JointCode code = PACKED;
+    int32_t d[3];
+    if ((c >> 30) == (k >> 30)) {
+      int32_t low = 0;
+      int32_t high = 0;
+      uint32_t largest = 0;
+      size_t varints = 0;
+      for (int j = 0; j < 3; ++j) {
+        d[j] = Component(c, j) - Component(k, j);
+        low = std::min(low, d[j]);
+        high = std::max(high, d[j]);
+        largest = std::max(largest, static_cast<uint32_t>(std::abs(d[j])));
+        varints += VarintSize(Zigzag(d[j]));
+      }
+      if (largest <= threshold) {
+        continue;
+      }
+      if (low >= SMALL_MIN && high <= SMALL_MAX) {
+        code = SMALL;
+      } else if (varints < sizeof(uint32_t)) {
+        code = VARINT;
+      }
+    }
+
+    codes[i >> 2] |= code << ((i & 3) * 2);
+    switch (code) {
+      case SMALL: {
+        auto small = static_cast<uint16_t>((d[0] & 0x1f) | (d[1] & 0x1f) << 5 |
+                                           (d[2] & 0x1f) << 10);
+        memcpy(p, &small, sizeof(small));
+        p += sizeof(small);
+        break;
+      }
+      case VARINT:
+        for (int j = 0; j < 3; ++j) {
+          p = PutVarint(p, Zigzag(d[j]));
+        }
+        break;
+      default:
+        memcpy(p, &c, sizeof(c));
+        p += sizeof(c);
+        break;
+    }
+  }
+  return p - dst;
+}
+
+bool
+DecodeDelta(std::span<const uint8_t> body,
+            std::span<const uint32_t> keyframe,
+            std::span<uint32_t> current)
+{
+  auto count = keyframe.size();
+  auto codeBytes = (count + 3) / 4;
+  if (current.size() != count ||
+      body.size() < sizeof(DeltaHeader) + codeBytes) {
+    return false;
+  }
+  auto codes = body.data() + sizeof(DeltaHeader);
+  auto p = codes + codeBytes;
+  auto end = body.data() + body.size();
+  for (size_t i = 0; i < count; ++i) {
+    auto k = keyframe[i];
+    int32_t d[3];
+    switch ((codes[i >> 2] >> ((i & 3) * 2)) & 0x3) {
+      case KEYFRAME:
+        current[i] = k;
+        continue;
+      case SMALL: {
+        uint16_t small;
+        if (end - p < static_cast<ptrdiff_t>(sizeof(small))) {
+          return false;
+        }
+        memcpy(&small, p, sizeof(small));
+        p += sizeof(small);
+        for (int j = 0; j < 3; ++j) {
+          // sign extend 5 bits
+          d[j] = static_cast<int32_t>((small >> (j * 5)) & 0x1f) ^ 0x10;
+          d[j] -= 0x10;
+        }
+        break;
+      }
+      case VARINT:
+        for (int j = 0; j < 3; ++j) {
+          uint32_t v;
+          if (!GetVarint(p, end, v)) {
+            return false;
+          }
+          d[j] = Unzigzag(v);
+        }
+        break;
+      default:
+        if (end - p < static_cast<ptrdiff_t>(sizeof(uint32_t))) {
+          return false;
+        }
+        memcpy(&current[i], p, sizeof(uint32_t));
+        p += sizeof(uint32_t);
+        continue;
+    }
+
+    uint32_t c = k & ~(COMPONENT | COMPONENT << 10 | COMPONENT << 20);
+    for (int j = 0; j < 3; ++j) {
+      auto component = Component(k, j) + d[j];
+      if (component < 0 || component > static_cast<int32_t>(COMPONENT)) {
+        return false;
+      }
+      c |= static_cast<uint32_t>(component) << (j * 10);
+    }
+    current[i] = c;
+  }
+  return p == end;
+}
+
+} // namespace srht
@@ -0,0 +1,41 @@
+#pragma once
+#include "srht.h"
+#include <span>
+#include <stddef.h>
+#include <stdint.h>
+
+///
+/// FrameFlags::DELTA body: DeltaHeader, a 2 bit code per joint, joint data.
+///
+/// a joint is sent when its drop component changed or any of its three
+/// 10 bit components moved more than threshold steps away from the
+/// keyframe, in the shortest of the small, varint and PackQuat codes. the
+/// receiver keeps the keyframe value for the others, so the error stays
+/// within threshold and does not add up between keyframes.
+///
+namespace srht {
+
+// largest body for jointCount joints
+inline constexpr size_t
+DeltaBound(size_t jointCount)
+{
+  // PackQuat when the varints would not be shorter
+  return sizeof(DeltaHeader) + (jointCount + 3) / 4 + 4 * jointCount;
+}
+
+// dst: DeltaBound(current.size()) bytes. returns the bytes written
+size_t
+EncodeDelta(int64_t keyframeTime,
+            std::span<const uint32_t> keyframe,
+            std::span<const uint32_t> current,
+            uint32_t threshold,
+            uint8_t* dst);
+
+// body: DeltaHeader .. end of the datagram. the caller matches
+// DeltaHeader::keyframeTime with keyframe. false if malformed
+bool
+DecodeDelta(std::span<const uint8_t> body,
+            std::span<const uint32_t> keyframe,
+            std::span<uint32_t> current);
+
+} // namespace srht
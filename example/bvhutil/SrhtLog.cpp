@@ -0,0 +1,289 @@
+#include "SrhtLog.h"
+#include "srht.h"
+#include <algorithm>
+
+static size_t
+Padded(size_t size)
+{
+  return (size + srht::LOG_ALIGNMENT - 1) / srht::LOG_ALIGNMENT *
+         srht::LOG_ALIGNMENT;
+}
+
+//
+// SrhtRecorder
+//
+bool
+SrhtRecorder::Open(const std::string& path)
+{
+  Close();
+  fp_ = fopen(path.c_str(), "wb");
+  if (!fp_) {
+    return false;
+  }
+  // the datagrams of a tick come in small writes
+  setvbuf(fp_, nullptr, _IOFBF, 1024 * 1024);
+  start_ = Clock::now();
+  srht::LogHeader header;
+  header.startTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::system_clock::now().time_since_epoch())
+                       .count();
+  if (fwrite(&header, sizeof(header), 1, fp_) != 1) {
+    Close();
+    return false;
+  }
+  offset_ = sizeof(header);
+  count_ = 0;
+  last_ = 0;
+  index_.clear();
+  skeletons_.clear();
+  skeletonMessage_.reset();
+  return true;
+}
+
+bool
+SrhtRecorder::Close()
+{
+  if (!fp_) {
+    return true;
+  }
+  srht::LogFooter footer;
+  footer.indexOffset = offset_;
+  footer.indexCount = index_.size();
+  footer.skeletonCount = skeletons_.size();
+  footer.count = count_;
+  footer.duration = last_;
+  auto write = [fp = fp_](const void* p, size_t size) {
+    return size == 0 || fwrite(p, size, 1, fp) == 1;
+  };
+  bool ok = write(index_.data(), index_.size() * sizeof(index_[0])) &&
+            write(skeletons_.data(), skeletons_.size() * sizeof(uint64_t)) &&
+            write(&footer, sizeof(footer));
+  if (fclose(fp_) != 0) {
+    ok = false;
+  }
+  fp_ = nullptr;
+  return ok;
+}
+
+template<typename T>
+static bool
+HasMagic(std::span<const uint8_t> bytes)
+{
+  return bytes.size() >= sizeof(T) && memcmp(bytes.data(), T{}.magic, 8) == 0;
+}
+
+bool
+SrhtRecorder::IsSkeleton(std::span<const uint8_t> datagram)
+{
+  if (HasMagic<srht::SkeletonHeader>(datagram)) {
+    return true;
+  }
+  if (HasMagic<srht::BundleHeader>(datagram)) {
+    srht::BundleHeader header;
+    memcpy(&header, datagram.data(), sizeof(header));
+    auto p = datagram.subspan(sizeof(header));
+    for (uint16_t i = 0; i < header.count && p.size() >= 2; ++i) {
+      uint16_t size;
+      memcpy(&size, p.data(), sizeof(size));
+      p = p.subspan(2);
+      if (size > p.size()) {
+        break;
+      }
+      if (HasMagic<srht::SkeletonHeader>(p.subspan(0, size))) {
+        return true;
+      }
+      p = p.subspan(size);
+    }
+    return false;
+  }
+  if (HasMagic<srht::FragmentHeader>(datagram)) {
+    // the first fragment starts with the packet header
+    srht::FragmentHeader header;
+    memcpy(&header, datagram.data(), sizeof(header));
+    if (header.index == 0) {
+      if (HasMagic<srht::SkeletonHeader>(datagram.subspan(sizeof(header)))) {
+        skeletonMessage_ = header.messageId;
+      } else {
+        skeletonMessage_.reset();
+      }
+    }
+    return skeletonMessage_ == header.messageId;
+  }
+  return false;
+}
+
+bool
+SrhtRecorder::Record(std::span<const uint8_t> datagram, Clock::time_point time)
+{
+  if (!fp_ || datagram.size() > UINT32_MAX) {
+    return false;
+  }
+  srht::LogRecord record{
+    .time = std::max(
+      last_,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(time - start_)
+        .count()),
+    .size = static_cast<uint32_t>(datagram.size()),
+    .flags = IsSkeleton(datagram) ? srht::LogRecordFlags::SKELETON
+                                  : srht::LogRecordFlags::NONE,
+  };
+  static const uint8_t padding[srht::LOG_ALIGNMENT] = {};
+  auto size = Padded(sizeof(record) + datagram.size());
+  auto pad = size - sizeof(record) - datagram.size();
+  if (fwrite(&record, sizeof(record), 1, fp_) != 1 ||
+      fwrite(datagram.data(), 1, datagram.size(), fp_) != datagram.size() ||
+      fwrite(padding, 1, pad, fp_) != pad) {
+    return false;
+  }
+  if (count_ % srht::LOG_INDEX_STRIDE == 0) {
+    index_.push_back({ record.time, offset_ });
+  }
+  if (record.flags == srht::LogRecordFlags::SKELETON) {
+    skeletons_.push_back(offset_);
+  }
+  offset_ += size;
+  ++count_;
+  last_ = record.time;
+  return true;
+}
+
+//
+// SrhtLogReader
+//
+bool
+SrhtLogReader::Open(const std::string& path)
+{
+  Close();
+  if (!file_.Open(path)) {
+    return false;
+  }
+  srht::LogHeader header;
+  srht::LogHeader expected;
+  if (file_.size() < sizeof(header)) {
+    Close();
+    return false;
+  }
+  memcpy(&header, file_.data(), sizeof(header));
+  if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+      header.version != expected.version ||
+      header.byte_order != expected.byte_order) {
+    Close();
+    return false;
+  }
+
+  // a log without a footer is scanned
+  srht::LogFooter footer;
+  bool footed = false;
+  if (file_.size() >= sizeof(header) + sizeof(footer)) {
+    memcpy(&footer, file_.data() + file_.size() - sizeof(footer),
+           sizeof(footer));
+    // the tables fill [indexOffset, footer) exactly. file values are only
+    // compared against what is left, never added up
+    auto tables = file_.size() - sizeof(footer);
+    if (memcmp(footer.magic, srht::LogFooter{}.magic, sizeof(footer.magic)) ==
+          0 &&
+        footer.indexOffset >= sizeof(header) && footer.indexOffset <= tables &&
+        footer.indexCount <=
+          (tables - footer.indexOffset) / sizeof(srht::LogIndexEntry)) {
+      auto rest = tables - footer.indexOffset -
+                  footer.indexCount * sizeof(srht::LogIndexEntry);
+      footed = rest % sizeof(uint64_t) == 0 &&
+               footer.skeletonCount == rest / sizeof(uint64_t);
+    }
+  }
+  if (footed) {
+    // copied out: a damaged file may put the tables anywhere
+    auto tables = file_.data() + footer.indexOffset;
+    index_.resize(footer.indexCount);
+    memcpy(index_.data(), tables, index_.size() * sizeof(index_[0]));
+    tables += index_.size() * sizeof(index_[0]);
+    skeletons_.resize(footer.skeletonCount);
+    memcpy(skeletons_.data(), tables, skeletons_.size() * sizeof(uint64_t));
+    end_ = footer.indexOffset;
+    count_ = footer.count;
+    duration_ = footer.duration;
+    indexed_ = true;
+  } else {
+    Scan();
+  }
+  cursor_ = sizeof(header);
+  return true;
+}
+
+void
+SrhtLogReader::Scan()
+{
+  size_t offset = sizeof(srht::LogHeader);
+  srht::LogRecord record;
+  while (offset <= file_.size() && file_.size() - offset >= sizeof(record)) {
+    memcpy(&record, file_.data() + offset, sizeof(record));
+    if (record.size > file_.size() - offset - sizeof(record)) {
+      // cut short
+      break;
+    }
+    if (count_ % srht::LOG_INDEX_STRIDE == 0) {
+      index_.push_back({ record.time, offset });
+    }
+    if (record.flags == srht::LogRecordFlags::SKELETON) {
+      skeletons_.push_back(offset);
+    }
+    ++count_;
+    duration_ = record.time;
+    offset += Padded(sizeof(record) + record.size);
+  }
+  end_ = std::min(offset, file_.size());
+}
+
+void
+SrhtLogReader::Close()
+{
+  file_.Close();
+  index_.clear();
+  skeletons_.clear();
+  indexed_ = false;
+  count_ = 0;
+  duration_ = 0;
+  end_ = 0;
+  cursor_ = 0;
+}
+
+void
+SrhtLogReader::Seek(std::chrono::nanoseconds time)
+{
+  if (!file_.data()) {
+    return;
+  }
+  // the last indexed record before time, then forward
+  auto it = std::lower_bound(
+    index_.begin(),
+    index_.end(),
+    time.count(),
+    [](const srht::LogIndexEntry& entry, int64_t t) { return entry.time < t; });
+  cursor_ =
+    it == index_.begin() ? sizeof(srht::LogHeader) : std::prev(it)->offset;
+  // the index is read from the file. Next stops at an offset past end_
+  srht::LogRecord record;
+  while (cursor_ <= end_ && end_ - cursor_ >= sizeof(record)) {
+    memcpy(&record, file_.data() + cursor_, sizeof(record));
+    if (record.time >= time.count() ||
+        record.size > end_ - cursor_ - sizeof(record)) {
+      break;
+    }
+    cursor_ += Padded(sizeof(record) + record.size);
+  }
+}
+
+std::vector<SrhtLogEntry>
+SrhtLogReader::Skeletons(std::chrono::nanoseconds time) const
+{
+  std::vector<SrhtLogEntry> entries;
+  for (auto offset : skeletons_) {
+    SrhtLogEntry entry;
+    size_t next;
+    if (!At(offset, entry, next) || entry.time >= time) {
+      break;
+    }
+    entries.push_back(entry);
+  }
+  return entries;
+}
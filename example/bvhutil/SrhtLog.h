@@ -0,0 +1,221 @@
+#pragma once
+#include "MappedFile.h"
+#include <chrono>
+#include <optional>
+#include <span>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace srht {
+
+//
+// .srhtlog: the datagrams of a stream, as sent.
+//
+// [LogHeader]
+// [LogRecord, datagram, padding to 8] x count
+// written by Close:
+// [LogIndexEntry x indexCount]
+// [uint64_t x skeletonCount] offsets of the LogRecordFlags::SKELETON records
+// [LogFooter]
+//
+// append only. a log whose recorder did not Close has no index and may end
+// in a partial record: the reader scans it and stops at the last complete
+// record.
+//
+struct LogHeader
+{
+  char magic[8] = { 'S', 'R', 'H', 'T', 'L', 'O', 'G', '1' };
+  uint32_t version = 1;
+  // 0x01020304 in the writer byte order
+  uint32_t byte_order = 0x01020304;
+  // system_clock nanoseconds of SrhtRecorder::Open, record time 0
+  int64_t startTime = 0;
+  uint64_t reserved = 0;
+};
+static_assert(sizeof(LogHeader) == 32, "LogHeader");
+
+enum class LogRecordFlags : uint32_t
+{
+  NONE = 0,
+  // a SkeletonHeader packet, a bundle with one or a fragment of one. a
+  // replay that starts after Seek needs them
+  SKELETON = 0x1,
+};
+
+struct LogRecord
+{
+  // nanoseconds since SrhtRecorder::Open
+  int64_t time;
+  uint32_t size;
+  LogRecordFlags flags;
+};
+static_assert(sizeof(LogRecord) == 16, "LogRecord");
+
+// every LOG_INDEX_STRIDE records
+struct LogIndexEntry
+{
+  int64_t time;
+  // of the LogRecord from the start of the file
+  uint64_t offset;
+};
+static_assert(sizeof(LogIndexEntry) == 16, "LogIndexEntry");
+
+struct LogFooter
+{
+  char magic[8] = { 'S', 'R', 'H', 'T', 'I', 'D', 'X', '1' };
+  uint64_t indexOffset = 0;
+  uint64_t indexCount = 0;
+  uint64_t skeletonCount = 0;
+  uint64_t count = 0;
+  // time of the last record
+  int64_t duration = 0;
+};
+static_assert(sizeof(LogFooter) == 48, "LogFooter");
+
+inline constexpr uint32_t LOG_INDEX_STRIDE = 256;
+inline constexpr size_t LOG_ALIGNMENT = 8;
+
+} // namespace srht
+
+///
+/// appends datagrams to a .srhtlog.
+///
+/// UdpSender::SetRecorder records every datagram of a Flush once, whatever
+/// the number of endpoints. writes are buffered: a record reaches the file
+/// in blocks and on Close. not thread safe.
+///
+class SrhtRecorder
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  FILE* fp_ = nullptr;
+  uint64_t offset_ = 0;
+  uint64_t count_ = 0;
+  Clock::time_point start_;
+  int64_t last_ = 0;
+  std::vector<srht::LogIndexEntry> index_;
+  std::vector<uint64_t> skeletons_;
+  // FragmentHeader::messageId of the skeleton packet being fragmented
+  std::optional<uint32_t> skeletonMessage_;
+
+  bool IsSkeleton(std::span<const uint8_t> datagram);
+
+public:
+  SrhtRecorder(const SrhtRecorder&) = delete;
+  SrhtRecorder& operator=(const SrhtRecorder&) = delete;
+  SrhtRecorder() {}
+  ~SrhtRecorder() { Close(); }
+  // truncates path
+  bool Open(const std::string& path);
+  // writes the index. false if a write failed
+  bool Close();
+  bool IsOpen() const { return fp_ != nullptr; }
+  // time: when the datagram was sent. a time before the previous record is
+  // recorded as that record's time
+  bool Record(std::span<const uint8_t> datagram,
+              Clock::time_point time = Clock::now());
+  uint64_t Count() const { return count_; }
+  // file bytes so far, without the index
+  uint64_t Bytes() const { return offset_; }
+};
+
+// a record of a SrhtLogReader. bytes point into the mapping
+struct SrhtLogEntry
+{
+  std::chrono::nanoseconds time;
+  std::span<const uint8_t> bytes;
+};
+
+///
+/// reads a .srhtlog through a read only mapping. no copy of the datagrams.
+///
+class SrhtLogReader
+{
+  MappedFile file_;
+  // the footer index, or one built by scanning an unfinished log
+  std::vector<srht::LogIndexEntry> index_;
+  std::vector<uint64_t> skeletons_;
+  bool indexed_ = false;
+  uint64_t count_ = 0;
+  int64_t duration_ = 0;
+  size_t end_ = 0;
+  size_t cursor_ = 0;
+
+  void Scan();
+  // the record at offset and the offset of the one after it
+  bool At(size_t offset, SrhtLogEntry& entry, size_t& next) const
+  {
+    if (offset > end_ || end_ - offset < sizeof(srht::LogRecord)) {
+      return false;
+    }
+    srht::LogRecord record;
+    memcpy(&record, file_.data() + offset, sizeof(record));
+    if (record.size > end_ - offset - sizeof(record)) {
+      return false;
+    }
+    entry.time = std::chrono::nanoseconds(record.time);
+    entry.bytes = { (const uint8_t*)file_.data() + offset + sizeof(record),
+                    record.size };
+    next = offset + (sizeof(record) + record.size + srht::LOG_ALIGNMENT - 1) /
+                      srht::LOG_ALIGNMENT * srht::LOG_ALIGNMENT;
+    return true;
+  }
+
+public:
+  // false if not a .srhtlog
+  bool Open(const std::string& path);
+  void Close();
+  uint64_t Count() const { return count_; }
+  std::chrono::nanoseconds Duration() const
+  {
+    return std::chrono::nanoseconds(duration_);
+  }
+  // false: the recorder did not Close, the index was built by a scan
+  bool Indexed() const { return indexed_; }
+
+  // the first record at or after time, through the index
+  void Seek(std::chrono::nanoseconds time);
+  void Rewind() { Seek({}); }
+  // false at the end
+  bool Next(SrhtLogEntry& entry) { return At(cursor_, entry, cursor_); }
+  // the LogRecordFlags::SKELETON records before time: pushed ahead of a
+  // replay from Seek(time), a receiver knows the skeletons of its frames
+  std::vector<SrhtLogEntry> Skeletons(std::chrono::nanoseconds time) const;
+
+  // f(const SrhtLogEntry&) for each record from the cursor on, at the
+  // recorded pace divided by speed (2: twice as fast). speed 0: as fast as
+  // possible. stops early when f returns false. returns the records played
+  template<typename F>
+  uint64_t Replay(double speed, const F& f)
+  {
+    using Clock = std::chrono::steady_clock;
+    uint64_t played = 0;
+    SrhtLogEntry entry;
+    Clock::time_point start;
+    std::chrono::nanoseconds base = {};
+    while (Next(entry)) {
+      if (speed > 0) {
+        if (played == 0) {
+          start = Clock::now();
+          base = entry.time;
+        }
+        auto due = start + std::chrono::duration_cast<Clock::duration>(
+                             (entry.time - base) / speed);
+        if (due > Clock::now()) {
+          std::this_thread::sleep_until(due);
+        }
+      }
+      ++played;
+      if (!f(entry)) {
+        break;
+      }
+    }
+    return played;
+  }
+};
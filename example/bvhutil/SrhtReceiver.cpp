@@ -0,0 +1,479 @@
+#include <DirectXMath.h>
+
+#include "SrhtReceiver.h"
+#include "BvhNode.h"
+#include "Quat32Batch.h"
+#include "SrhtDelta.h"
+#include <algorithm>
+#include <string.h>
+
+static const uint16_t ROOT_PARENT = 0xffff;
+static_assert(srht::MAX_FRAGMENTS <= 64, "Reassembly::received");
+
+// the sender clock moved ahead of its mapping this far: a new timeline
+static const auto RESYNC = std::chrono::seconds(1);
+
+SrhtReceiver::SrhtReceiver(size_t depth,
+                           std::chrono::nanoseconds delay,
+                           size_t maxDatagram)
+  : slots_(std::max<size_t>(depth, 1))
+  , delay_(delay)
+{
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    slots_[i].bytes.resize(maxDatagram);
+    free_.push_back(static_cast<uint32_t>(i));
+  }
+  order_.reserve(slots_.size());
+  reassembly_.resize(REASSEMBLY);
+  for (auto& r : reassembly_) {
+    r.bytes.resize(maxDatagram);
+  }
+}
+
+const SrhtSkeleton*
+SrhtReceiver::Skeleton(uint16_t id) const
+{
+  return id < skeletons_.size() ? skeletons_[id].get() : nullptr;
+}
+
+template<typename T>
+static bool
+HasMagic(std::span<const uint8_t> datagram)
+{
+  return datagram.size() >= sizeof(T) &&
+         memcmp(datagram.data(), T{}.magic, sizeof(T{}.magic)) == 0;
+}
+
+bool
+SrhtReceiver::Push(std::span<const uint8_t> datagram, Clock::time_point arrival)
+{
+  ++pushed_;
+  if (HasMagic<srht::BundleHeader>(datagram)) {
+    return PushBundle(datagram, arrival);
+  }
+  if (HasMagic<srht::FragmentHeader>(datagram)) {
+    return PushFragment(datagram, arrival);
+  }
+  return PushPacket(datagram, arrival);
+}
+
+bool
+SrhtReceiver::PushPacket(std::span<const uint8_t> packet,
+                         Clock::time_point arrival)
+{
+  // a CompactFrameHeader is shorter than FrameHeader
+  if (srht::IsFramePacket(packet.data(), packet.size())) {
+    return PushFrame(packet, arrival);
+  }
+  if (HasMagic<srht::SkeletonHeader>(packet)) {
+    return PushSkeleton(packet);
+  }
+  ++stats_.malformed;
+  return false;
+}
+
+bool
+SrhtReceiver::PushBundle(std::span<const uint8_t> datagram,
+                         Clock::time_point arrival)
+{
+  ++stats_.bundles;
+  srht::BundleHeader header;
+  memcpy(&header, datagram.data(), sizeof(header));
+  auto rest = datagram.subspan(sizeof(header));
+  bool ok = true;
+  for (uint16_t i = 0; i < header.count; ++i) {
+    uint16_t size;
+    if (rest.size() < sizeof(size)) {
+      ++stats_.malformed;
+      return false;
+    }
+    memcpy(&size, rest.data(), sizeof(size));
+    rest = rest.subspan(sizeof(size));
+    if (rest.size() < size) {
+      ++stats_.malformed;
+      return false;
+    }
+    if (!PushPacket(rest.subspan(0, size), arrival)) {
+      ok = false;
+    }
+    rest = rest.subspan(size);
+  }
+  if (!rest.empty()) {
+    ++stats_.malformed;
+    return false;
+  }
+  return ok;
+}
+
+bool
+SrhtReceiver::PushFragment(std::span<const uint8_t> datagram,
+                           Clock::time_point arrival)
+{
+  ++stats_.fragments;
+  srht::FragmentHeader header;
+  memcpy(&header, datagram.data(), sizeof(header));
+  auto chunk = datagram.subspan(sizeof(header));
+  if (header.count == 0 || header.count > srht::MAX_FRAGMENTS ||
+      header.index >= header.count ||
+      header.totalSize > slots_[0].bytes.size() ||
+      header.offset > header.totalSize ||
+      chunk.size() > header.totalSize - header.offset) {
+    ++stats_.malformed;
+    return false;
+  }
+
+  Reassembly* target = nullptr;
+  for (auto& r : reassembly_) {
+    if (r.used && r.messageId == header.messageId) {
+      target = &r;
+      break;
+    }
+  }
+  if (target && (target->count != header.count ||
+                 target->totalSize != header.totalSize)) {
+    ++stats_.malformed;
+    return false;
+  }
+  if (!target) {
+    // a free buffer or the oldest unfinished packet
+    for (auto& r : reassembly_) {
+      if (!target || !r.used || (target->used && r.started < target->started)) {
+        target = &r;
+      }
+    }
+    if (target->used) {
+      ++stats_.incomplete;
+    }
+    target->used = true;
+    target->messageId = header.messageId;
+    target->count = header.count;
+    target->totalSize = header.totalSize;
+    target->received = 0;
+    target->receivedBytes = 0;
+    target->started = pushed_;
+  }
+
+  auto bit = uint64_t(1) << header.index;
+  if (target->received & bit) {
+    // duplicate
+    return true;
+  }
+  target->received |= bit;
+  memcpy(target->bytes.data() + header.offset, chunk.data(), chunk.size());
+  target->receivedBytes += chunk.size();
+  auto all = header.count == 64 ? ~uint64_t(0)
+                                 : (uint64_t(1) << header.count) - 1;
+  if (target->received != all) {
+    return true;
+  }
+
+  target->used = false;
+  if (target->receivedBytes != target->totalSize) {
+    ++stats_.malformed;
+    return false;
+  }
+  ++stats_.reassembled;
+  return PushPacket({ target->bytes.data(), target->totalSize }, arrival);
+}
+
+bool
+SrhtReceiver::PushSkeleton(std::span<const uint8_t> datagram)
+{
+  srht::SkeletonHeader header;
+  memcpy(&header, datagram.data(), sizeof(header));
+  auto body = datagram.subspan(sizeof(header));
+  float positionScale = 0;
+  if (srht::HasFlag(header.flags, srht::SkeletonFlags::POSITION_SCALE)) {
+    if (body.size() >= sizeof(positionScale)) {
+      memcpy(&positionScale, body.data(), sizeof(positionScale));
+      body = body.subspan(sizeof(positionScale));
+    }
+    if (!(positionScale > 0)) {
+      ++stats_.malformed;
+      return false;
+    }
+  }
+  auto compact =
+    srht::HasFlag(header.flags, srht::SkeletonFlags::COMPACT_JOINTS);
+  if (body.size() != (compact ? sizeof(srht::CompactJointDefinition)
+                              : sizeof(srht::JointDefinition)) *
+                       header.jointCount ||
+      header.jointCount == 0 || (compact && positionScale == 0)) {
+    ++stats_.malformed;
+    return false;
+  }
+  std::vector<srht::JointDefinition> joints(header.jointCount);
+  if (compact) {
+    for (size_t i = 0; i < joints.size(); ++i) {
+      srht::CompactJointDefinition c;
+      memcpy(&c, body.data() + sizeof(c) * i, sizeof(c));
+      joints[i] = {
+        .parentBoneIndex = static_cast<uint16_t>(
+          c.parentBoneIndex == 0xff ? ROOT_PARENT : c.parentBoneIndex),
+        .boneType = c.boneType,
+        .xFromParent = srht::FloatFromFixed(c.xFromParent, positionScale),
+        .yFromParent = srht::FloatFromFixed(c.yFromParent, positionScale),
+        .zFromParent = srht::FloatFromFixed(c.zFromParent, positionScale),
+      };
+    }
+  } else {
+    memcpy(
+      joints.data(), body.data(), sizeof(srht::JointDefinition) * joints.size());
+  }
+  // parent first, like the bvh order
+  for (size_t i = 0; i < joints.size(); ++i) {
+    auto parent = joints[i].parentBoneIndex;
+    if (i == 0 ? parent != ROOT_PARENT : parent >= i) {
+      ++stats_.malformed;
+      return false;
+    }
+  }
+  ++stats_.skeletons;
+
+  if (header.skeletonId >= skeletons_.size()) {
+    skeletons_.resize(header.skeletonId + 1);
+  }
+  auto& skeleton = skeletons_[header.skeletonId];
+  if (skeleton && skeleton->positionScale == positionScale &&
+      skeleton->joints.size() == joints.size() &&
+      memcmp(skeleton->joints.data(),
+             joints.data(),
+             sizeof(srht::JointDefinition) * joints.size()) == 0) {
+    // sent again
+    return true;
+  }
+
+  skeleton = std::make_unique<SrhtSkeleton>();
+  skeleton->id = header.skeletonId;
+  skeleton->joints = std::move(joints);
+  skeleton->positionScale = positionScale;
+  auto count = skeleton->joints.size();
+  // same tail as BvhFlatSolver. the first child, or the one nearest to the
+  // x = 0 plane
+  std::vector<const srht::JointDefinition*> tails(count);
+  for (size_t i = 1; i < count; ++i) {
+    auto& joint = skeleton->joints[i];
+    auto& tail = tails[joint.parentBoneIndex];
+    if (!tail || std::abs(joint.xFromParent) < std::abs(tail->xFromParent)) {
+      tail = &joint;
+    }
+  }
+  tails[0] = nullptr;
+  skeleton->shapes.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    if (auto tail = tails[i]) {
+      BvhOffset offset{ tail->xFromParent, tail->yFromParent, tail->zFromParent };
+      skeleton->shapes[i] = BvhNode::Shape(&offset);
+    } else {
+      skeleton->shapes[i] = BvhNode::Shape(nullptr);
+    }
+  }
+  skeleton->rotations.resize(count);
+  skeleton->keyframe.resize(count);
+  skeleton->packed.resize(count);
+  skeleton->world.resize(count);
+  skeleton->instances.resize(count);
+  return true;
+}
+
+bool
+SrhtReceiver::PushFrame(std::span<const uint8_t> datagram,
+                        Clock::time_point arrival)
+{
+  srht::FrameHeader header;
+  memcpy(
+    static_cast<void*>(&header), datagram.data(), srht::FRAME_PREFIX_SIZE);
+  auto skeleton = header.skeletonId < skeletons_.size()
+                    ? skeletons_[header.skeletonId].get()
+                    : nullptr;
+  if (!skeleton) {
+    ++stats_.unknownSkeleton;
+    return false;
+  }
+  if (datagram.size() > slots_[0].bytes.size() ||
+      !srht::ReadFrameHeader(datagram.data(),
+                             datagram.size(),
+                             skeleton->positionScale,
+                             header)) {
+    ++stats_.malformed;
+    return false;
+  }
+  ++stats_.frames;
+
+  auto time = std::chrono::nanoseconds(header.time);
+  auto offset = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    arrival.time_since_epoch() - time);
+  // older than the played frame by more than the jitter window: the clip
+  // looped or the sender restarted, not a late packet
+  auto back = skeleton->played != INT64_MIN &&
+              header.time + delay_.count() < skeleton->played;
+  if (!skeleton->synced || back || offset > skeleton->clockOffset + RESYNC) {
+    // first frame or the sender clock jumped
+    if (skeleton->synced) {
+      ++stats_.resync;
+    }
+    skeleton->synced = true;
+    skeleton->clockOffset = offset;
+    skeleton->played = INT64_MIN;
+  } else if (offset < skeleton->clockOffset) {
+    // less network delay than seen so far
+    skeleton->clockOffset = offset;
+  }
+  if (header.time <= skeleton->played) {
+    ++stats_.late;
+    return true;
+  }
+
+  if (free_.empty()) {
+    // drop the earliest
+    ++stats_.overflow;
+    free_.push_back(order_.front());
+    order_.erase(order_.begin());
+  }
+  auto index = free_.back();
+  free_.pop_back();
+  auto& slot = slots_[index];
+  memcpy(slot.bytes.data(), datagram.data(), datagram.size());
+  slot.size = datagram.size();
+  slot.time = header.time;
+  slot.skeletonId = header.skeletonId;
+  slot.due = Clock::time_point(time + skeleton->clockOffset + delay_);
+
+  // insertion into a short sorted array
+  auto pos = order_.end();
+  while (pos != order_.begin() && slots_[*(pos - 1)].due > slot.due) {
+    --pos;
+  }
+  for (auto it = pos; it != order_.end(); ++it) {
+    if (slots_[*it].skeletonId == slot.skeletonId) {
+      ++stats_.reordered;
+      break;
+    }
+  }
+  order_.insert(pos, index);
+  return true;
+}
+
+const SrhtSkeleton*
+SrhtReceiver::Pop(Clock::time_point now)
+{
+  while (!order_.empty()) {
+    auto index = order_.front();
+    auto& slot = slots_[index];
+    if (slot.due > now) {
+      return nullptr;
+    }
+    order_.erase(order_.begin());
+    free_.push_back(index);
+
+    auto skeleton = skeletons_[slot.skeletonId].get();
+    if (slot.time <= skeleton->played) {
+      ++stats_.late;
+      continue;
+    }
+    if (!Decode(slot, *skeleton)) {
+      continue;
+    }
+    skeleton->played = slot.time;
+    ++stats_.played;
+    return skeleton;
+  }
+  return nullptr;
+}
+
+bool
+SrhtReceiver::Decode(const Slot& slot, SrhtSkeleton& skeleton)
+{
+  srht::FrameHeader header;
+  auto headerSize = srht::ReadFrameHeader(
+    slot.bytes.data(), slot.size, skeleton.positionScale, header);
+  if (!headerSize) {
+    // FIXED_POSITION of a skeleton sent again without a scale
+    ++stats_.malformed;
+    return false;
+  }
+  auto count = skeleton.joints.size();
+  std::span<const uint8_t> body(slot.bytes.data() + headerSize,
+                                slot.size - headerSize);
+  // a size that does not match: the skeleton changed after the frame was
+  // buffered
+  if (srht::HasFlag(header.flags, srht::FrameFlags::DELTA)) {
+    srht::DeltaHeader delta;
+    if (!srht::HasFlag(header.flags, srht::FrameFlags::USE_QUAT32) ||
+        body.size() < sizeof(delta)) {
+      ++stats_.malformed;
+      return false;
+    }
+    memcpy(&delta, body.data(), sizeof(delta));
+    if (!skeleton.hasKeyframe || delta.keyframeTime != skeleton.keyframeTime) {
+      ++stats_.missingKeyframe;
+      return false;
+    }
+    if (!srht::DecodeDelta(body, skeleton.keyframe, skeleton.packed)) {
+      ++stats_.malformed;
+      return false;
+    }
+    quat_packer::UnpackBatch(skeleton.packed,
+                             { &skeleton.rotations[0].x, count * 4 });
+    ++stats_.deltas;
+  } else if (srht::HasFlag(header.flags, srht::FrameFlags::USE_QUAT32)) {
+    if (body.size() != sizeof(uint32_t) * count) {
+      ++stats_.malformed;
+      return false;
+    }
+    memcpy(skeleton.keyframe.data(), body.data(), body.size());
+    skeleton.keyframeTime = header.time;
+    skeleton.hasKeyframe = true;
+    quat_packer::UnpackBatch(skeleton.keyframe,
+                             { &skeleton.rotations[0].x, count * 4 });
+  } else {
+    if (body.size() != sizeof(DirectX::XMFLOAT4) * count) {
+      ++stats_.malformed;
+      return false;
+    }
+    memcpy(skeleton.rotations.data(), body.data(), body.size());
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    auto& joint = skeleton.joints[i];
+    auto t = i == 0 ? DirectX::XMMatrixTranslation(header.x, header.y, header.z)
+                    : DirectX::XMMatrixTranslation(
+                        joint.xFromParent, joint.yFromParent, joint.zFromParent);
+    auto m = DirectX::XMMatrixRotationQuaternion(
+               DirectX::XMLoadFloat4(&skeleton.rotations[i])) *
+             t;
+    if (i > 0) {
+      m = m * DirectX::XMLoadFloat4x4(&skeleton.world[joint.parentBoneIndex]);
+    }
+    DirectX::XMStoreFloat4x4(&skeleton.world[i], m);
+    DirectX::XMStoreFloat4x4(&skeleton.instances[i].Matrix,
+                             DirectX::XMLoadFloat4x4(&skeleton.shapes[i]) * m);
+  }
+  skeleton.time = std::chrono::nanoseconds(header.time);
+  return true;
+}
+
+SrhtUdpReceiver::SrhtUdpReceiver(asio::io_context& io,
+                                 const asio::ip::udp::endpoint& ep)
+  : socket_(io, ep)
+  , buffer_(SrhtReceiver::MAX_DATAGRAM)
+{
+  socket_.non_blocking(true);
+}
+
+size_t
+SrhtUdpReceiver::Poll(SrhtReceiver& receiver)
+{
+  size_t count = 0;
+  for (;;) {
+    asio::error_code ec;
+    asio::ip::udp::endpoint from;
+    auto size = socket_.receive_from(asio::buffer(buffer_), from, 0, ec);
+    if (ec) {
+      // would_block: drained
+      return count;
+    }
+    receiver.Push({ buffer_.data(), size });
+    ++count;
+  }
+}
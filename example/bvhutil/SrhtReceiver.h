@@ -0,0 +1,177 @@
+#pragma once
+#include "srht.h"
+#include <grapho/dxmath_stub.h>
+#include <asio.hpp>
+#include <chrono>
+#include <cuber/mesh.h>
+#include <memory>
+#include <span>
+#include <stdint.h>
+#include <vector>
+
+// a skeleton announced by a SkeletonHeader packet and its last decoded pose
+struct SrhtSkeleton
+{
+  uint16_t id = 0;
+  std::vector<srht::JointDefinition> joints;
+  // SkeletonFlags::POSITION_SCALE, of FrameFlags::FIXED_POSITION frames.
+  // 0 without
+  float positionScale = 0;
+  // box from each joint toward its tail (BvhNode::Shape)
+  std::vector<DirectX::XMFLOAT4X4> shapes;
+
+  // written by SrhtReceiver::Pop. sized once per skeleton packet
+  std::chrono::nanoseconds time = {};
+  std::vector<DirectX::XMFLOAT4> rotations;
+  std::vector<DirectX::XMFLOAT4X4> world;
+  std::vector<cuber::Instance> instances;
+
+  // last quat32 frame without FrameFlags::DELTA, the base of delta frames
+  std::vector<uint32_t> keyframe;
+  int64_t keyframeTime = 0;
+  bool hasKeyframe = false;
+  // delta + keyframe
+  std::vector<uint32_t> packed;
+
+  // sender time => local clock. min(arrival - time)
+  std::chrono::nanoseconds clockOffset = {};
+  bool synced = false;
+  // time of the last played frame
+  int64_t played = INT64_MIN;
+};
+
+struct SrhtReceiverStats
+{
+  uint64_t skeletons = 0;
+  uint64_t frames = 0;
+  // not SRHT, truncated, or a size that does not match the skeleton
+  uint64_t malformed = 0;
+  // frame of a skeleton that was never announced
+  uint64_t unknownSkeleton = 0;
+  // not newer than the last played frame of its skeleton
+  uint64_t late = 0;
+  // arrived after a newer frame of the same skeleton, put back in order
+  uint64_t reordered = 0;
+  // pushed out of a full jitter buffer before playing
+  uint64_t overflow = 0;
+  // a jump of the sender clock (clip loop, new sender)
+  uint64_t resync = 0;
+  uint64_t played = 0;
+  // FrameFlags::DELTA frames played
+  uint64_t deltas = 0;
+  // delta frames whose keyframe was lost or is not the last one
+  uint64_t missingKeyframe = 0;
+  // BundleHeader datagrams
+  uint64_t bundles = 0;
+  // FragmentHeader datagrams and the packets put together from them
+  uint64_t fragments = 0;
+  uint64_t reassembled = 0;
+  // packets that lost a fragment (pushed out by newer ones)
+  uint64_t incomplete = 0;
+};
+
+///
+/// SRHT packets to poses.
+///
+/// skeleton packets are cached by skeletonId. frame packets are copied into
+/// a fixed set of preallocated slots, kept in order of their play time
+/// (sender time mapped to the local clock plus delay). Pop takes the
+/// earliest frame that is due and decodes its float4, quat32 or delta
+/// (SrhtDelta.h) rotations straight into the world and instance arrays of
+/// its skeleton. compact joints and 16 bit root positions are expanded to
+/// floats.
+///
+/// bundles are split into their packets. fragments are put together in a
+/// few preallocated packet buffers, the oldest unfinished one gives way to
+/// a new message.
+///
+/// Push and Pop do not allocate for frames. not thread safe: poll the
+/// socket (SrhtUdpReceiver) and Pop on the same thread.
+///
+class SrhtReceiver
+{
+public:
+  using Clock = std::chrono::steady_clock;
+  static constexpr size_t MAX_DATAGRAM = 65536;
+  // fragmented packets put together at once
+  static constexpr size_t REASSEMBLY = 4;
+
+private:
+  struct Slot
+  {
+    std::vector<uint8_t> bytes;
+    size_t size = 0;
+    int64_t time = 0;
+    uint16_t skeletonId = 0;
+    Clock::time_point due;
+  };
+  std::vector<Slot> slots_;
+  struct Reassembly
+  {
+    std::vector<uint8_t> bytes;
+    bool used = false;
+    uint32_t messageId = 0;
+    uint16_t count = 0;
+    uint32_t totalSize = 0;
+    // bit per fragment
+    uint64_t received = 0;
+    size_t receivedBytes = 0;
+    // Push count of the first fragment
+    uint64_t started = 0;
+  };
+  std::vector<Reassembly> reassembly_;
+  uint64_t pushed_ = 0;
+  // filled slots in play order
+  std::vector<uint32_t> order_;
+  std::vector<uint32_t> free_;
+  std::chrono::nanoseconds delay_;
+  std::vector<std::unique_ptr<SrhtSkeleton>> skeletons_;
+  SrhtReceiverStats stats_;
+
+public:
+  SrhtReceiver(const SrhtReceiver&) = delete;
+  SrhtReceiver& operator=(const SrhtReceiver&) = delete;
+  // depth: frames held for reordering. delay: how long a frame waits for
+  // earlier ones. maxDatagram: largest frame packet
+  explicit SrhtReceiver(
+    size_t depth = 8,
+    std::chrono::nanoseconds delay = std::chrono::milliseconds(30),
+    size_t maxDatagram = MAX_DATAGRAM);
+  // false if the datagram is not a valid SRHT packet. maxDatagram limits
+  // a reassembled packet as well
+  bool Push(std::span<const uint8_t> datagram,
+            Clock::time_point arrival = Clock::now());
+  // decode the earliest frame due at now. nullptr when none is due.
+  // the skeleton is valid until the next Push of its skeleton packet
+  const SrhtSkeleton* Pop(Clock::time_point now = Clock::now());
+  const SrhtSkeleton* Skeleton(uint16_t id) const;
+  size_t Buffered() const { return order_.size(); }
+  const SrhtReceiverStats& Stats() const { return stats_; }
+
+private:
+  bool PushPacket(std::span<const uint8_t> packet, Clock::time_point arrival);
+  bool PushBundle(std::span<const uint8_t> datagram, Clock::time_point arrival);
+  bool PushFragment(std::span<const uint8_t> datagram,
+                    Clock::time_point arrival);
+  bool PushSkeleton(std::span<const uint8_t> datagram);
+  bool PushFrame(std::span<const uint8_t> datagram, Clock::time_point arrival);
+  // false: counted as malformed or missingKeyframe
+  bool Decode(const Slot& slot, SrhtSkeleton& skeleton);
+};
+
+// non blocking loopback/lan receive for SrhtReceiver
+class SrhtUdpReceiver
+{
+  asio::ip::udp::socket socket_;
+  std::vector<uint8_t> buffer_;
+
+public:
+  // port 0 for any free port
+  SrhtUdpReceiver(asio::io_context& io, const asio::ip::udp::endpoint& ep);
+  asio::ip::udp::endpoint LocalEndpoint() const
+  {
+    return socket_.local_endpoint();
+  }
+  // Push every datagram waiting on the socket. returns the count
+  size_t Poll(SrhtReceiver& receiver);
+};
@@ -0,0 +1,358 @@
+#include "SrhtShm.h"
+#include <optional>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static size_t
+Stride(uint32_t slotSize)
+{
+  return (sizeof(srht::ShmSlot) + slotSize + 63) / 64 * 64;
+}
+
+#ifdef _WIN32
+bool
+SrhtShmMapping::Create(const std::string& name, size_t size)
+{
+  Close();
+  mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                nullptr,
+                                PAGE_READWRITE,
+                                static_cast<DWORD>(uint64_t(size) >> 32),
+                                static_cast<DWORD>(size),
+                                name.c_str());
+  if (!mapping_) {
+    return false;
+  }
+  data_ = (uint8_t*)MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (!data_) {
+    Close();
+    return false;
+  }
+  // a mapping left by a writer that did not Close
+  memset(data_, 0, size);
+  size_ = size;
+  owner_ = true;
+  return true;
+}
+
+bool
+SrhtShmMapping::Open(const std::string& name)
+{
+  Close();
+  mapping_ = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+  if (!mapping_) {
+    return false;
+  }
+  data_ = (uint8_t*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (!data_) {
+    Close();
+    return false;
+  }
+  MEMORY_BASIC_INFORMATION info;
+  if (!VirtualQuery(data_, &info, sizeof(info))) {
+    Close();
+    return false;
+  }
+  size_ = info.RegionSize;
+  return true;
+}
+
+void
+SrhtShmMapping::Close()
+{
+  if (data_) {
+    UnmapViewOfFile(data_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+  // the name goes with the last handle
+  if (mapping_) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+  owner_ = false;
+}
+#else
+bool
+SrhtShmMapping::Create(const std::string& name, size_t size)
+{
+  Close();
+  name_ = "/" + name;
+  fd_ = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd_ < 0 && errno == EEXIST) {
+    // left by a writer that did not Close. readers still attached keep the
+    // old region, the name gets a fresh zero filled one
+    shm_unlink(name_.c_str());
+    fd_ = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  if (fd_ < 0) {
+    return false;
+  }
+  owner_ = true;
+  if (ftruncate(fd_, size) != 0) {
+    Close();
+    return false;
+  }
+  auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    Close();
+    return false;
+  }
+  data_ = (uint8_t*)p;
+  size_ = size;
+  return true;
+}
+
+bool
+SrhtShmMapping::Open(const std::string& name)
+{
+  Close();
+  fd_ = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+  if (fd_ < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || st.st_size == 0) {
+    Close();
+    return false;
+  }
+  auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (p == MAP_FAILED) {
+    Close();
+    return false;
+  }
+  data_ = (uint8_t*)p;
+  size_ = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+void
+SrhtShmMapping::Close()
+{
+  if (data_) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  if (owner_) {
+    // readers keep their mapping
+    shm_unlink(name_.c_str());
+    owner_ = false;
+  }
+}
+#endif
+
+//
+// SrhtShmWriter
+//
+bool
+SrhtShmWriter::Create(const std::string& name,
+                      uint32_t slotCount,
+                      uint32_t slotSize,
+                      uint32_t skeletonCount)
+{
+  Close();
+  if (slotCount == 0) {
+    return false;
+  }
+  auto stride = Stride(slotSize);
+  if (!mapping_.Create(name,
+                       sizeof(srht::ShmHeader) +
+                         stride * (uint64_t(skeletonCount) * 2 + slotCount))) {
+    return false;
+  }
+  stride_ = stride;
+  // zero filled. the magic is written last, readers check it first
+  header_ = (srht::ShmHeader*)mapping_.data();
+  header_->slotCount = slotCount;
+  header_->slotSize = slotSize;
+  header_->skeletonCount = skeletonCount;
+  header_->written.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(header_->magic, srht::ShmHeader{}.magic, sizeof(header_->magic));
+  return true;
+}
+
+void
+SrhtShmWriter::Close()
+{
+  header_ = nullptr;
+  mapping_.Close();
+}
+
+static void
+WriteSlot(srht::ShmSlot& slot,
+          uint64_t writing,
+          uint64_t done,
+          std::span<const uint8_t> packet)
+{
+  slot.seq.store(writing, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.size = static_cast<uint32_t>(packet.size());
+  memcpy((uint8_t*)&slot + sizeof(slot), packet.data(), packet.size());
+  slot.seq.store(done, std::memory_order_release);
+}
+
+bool
+SrhtShmWriter::Write(std::span<const uint8_t> packet)
+{
+  if (!header_) {
+    return false;
+  }
+  if (packet.size() > header_->slotSize) {
+    ++dropped_;
+    return false;
+  }
+  auto slot = [this](size_t index) -> srht::ShmSlot& {
+    return *(srht::ShmSlot*)(mapping_.data() + sizeof(srht::ShmHeader) +
+                             stride_ * index);
+  };
+
+  // per skeletonId
+  std::optional<size_t> table;
+  uint16_t skeletonId = 0;
+  if (packet.size() >= sizeof(srht::SkeletonHeader) &&
+      memcmp(packet.data(), srht::SkeletonHeader{}.magic, 8) == 0) {
+    srht::SkeletonHeader header;
+    memcpy(&header, packet.data(), sizeof(header));
+    skeletonId = header.skeletonId;
+    table = 0;
+  } else if (srht::IsFramePacket(packet.data(), packet.size())) {
+    srht::FrameHeader header;
+    memcpy(
+      static_cast<void*>(&header), packet.data(), srht::FRAME_PREFIX_SIZE);
+    skeletonId = header.skeletonId;
+    table = header_->skeletonCount;
+  }
+  if (table && skeletonId < header_->skeletonCount) {
+    auto& s = slot(*table + skeletonId);
+    auto version = s.seq.load(std::memory_order_relaxed);
+    WriteSlot(s, version + 1, version + 2, packet);
+  }
+
+  auto index = header_->written.load(std::memory_order_relaxed);
+  auto& s = slot(header_->skeletonCount * 2 + index % header_->slotCount);
+  WriteSlot(s, index * 2 + 1, index * 2 + 2, packet);
+  header_->written.store(index + 1, std::memory_order_release);
+  return true;
+}
+
+//
+// SrhtShmReader
+//
+bool
+SrhtShmReader::Open(const std::string& name)
+{
+  Close();
+  if (!mapping_.Open(name)) {
+    return false;
+  }
+  auto header = (const srht::ShmHeader*)mapping_.data();
+  if (mapping_.size() < sizeof(srht::ShmHeader) ||
+      memcmp(header->magic, srht::ShmHeader{}.magic, sizeof(header->magic)) !=
+        0) {
+    // not created yet, or not ours
+    mapping_.Close();
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // read once. a writer (or anyone) may change them later
+  auto slotCount = header->slotCount;
+  auto slotSize = header->slotSize;
+  auto skeletonCount = header->skeletonCount;
+  auto stride = Stride(slotSize);
+  if (slotCount == 0 ||
+      (mapping_.size() - sizeof(srht::ShmHeader)) / stride <
+        uint64_t(skeletonCount) * 2 + slotCount) {
+    mapping_.Close();
+    return false;
+  }
+  header_ = header;
+  slotCount_ = slotCount;
+  slotSize_ = slotSize;
+  skeletonCount_ = skeletonCount;
+  stride_ = stride;
+  cursor_ = header_->written.load(std::memory_order_acquire);
+  skeletons_.assign(skeletonCount_, 0);
+  buffer_.resize(slotSize_);
+  return true;
+}
+
+void
+SrhtShmReader::Close()
+{
+  header_ = nullptr;
+  slotCount_ = 0;
+  slotSize_ = 0;
+  skeletonCount_ = 0;
+  mapping_.Close();
+}
+
+bool
+SrhtShmReader::Copy(const srht::ShmSlot& slot, uint64_t& seq, size_t& size)
+{
+  seq = slot.seq.load(std::memory_order_acquire);
+  size = slot.size;
+  if ((seq & 1) || size > buffer_.size()) {
+    return false;
+  }
+  memcpy(buffer_.data(), Bytes(slot), size);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+size_t
+SrhtShmReader::Poll(SrhtReceiver& receiver)
+{
+  if (!header_) {
+    return 0;
+  }
+  size_t count = 0;
+  uint64_t seq;
+  size_t size;
+  for (size_t i = 0; i < skeletons_.size(); ++i) {
+    auto& slot = Slot(i);
+    if (slot.seq.load(std::memory_order_relaxed) == skeletons_[i]) {
+      continue;
+    }
+    // a torn copy is tried again on the next Poll
+    if (Copy(slot, seq, size) && seq != 0) {
+      skeletons_[i] = seq;
+      receiver.Push({ buffer_.data(), size });
+      ++count;
+    }
+  }
+
+  auto written = header_->written.load(std::memory_order_acquire);
+  if (written < cursor_) {
+    // a new writer
+    cursor_ = 0;
+  }
+  if (written - cursor_ > slotCount_) {
+    lost_ += written - cursor_ - slotCount_;
+    cursor_ = written - slotCount_;
+  }
+  for (; cursor_ < written; ++cursor_) {
+    auto& slot = Slot(skeletonCount_ * 2 + cursor_ % slotCount_);
+    if (!Copy(slot, seq, size) || seq != cursor_ * 2 + 2) {
+      // overwritten while we read
+      ++lost_;
+      continue;
+    }
+    receiver.Push({ buffer_.data(), size });
+    ++count;
+  }
+  return count;
+}
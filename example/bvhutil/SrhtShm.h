@@ -0,0 +1,180 @@
+#pragma once
+#include "SrhtReceiver.h"
+#include <atomic>
+#include <span>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace srht {
+
+//
+// shared memory layout
+//
+// ShmHeader, skeletonCount skeleton slots (the last SkeletonHeader packet
+// of each skeletonId), skeletonCount latest slots (the last FrameHeader
+// packet of each skeletonId), slotCount ring slots (every packet in order).
+// a slot is a ShmSlot and slotSize bytes, 64 byte aligned.
+//
+struct ShmHeader
+{
+  char magic[8] = { 'S', 'R', 'H', 'T', 'S', 'H', 'M', '1' };
+  uint32_t slotCount = 0;
+  uint32_t slotSize = 0;
+  uint32_t skeletonCount = 0;
+  uint32_t reserved = 0;
+  // packets written to the ring
+  alignas(64) std::atomic<uint64_t> written;
+};
+
+// seqlock
+struct ShmSlot
+{
+  // ring: 2 * index + 2 when packet index is complete.
+  // skeleton / latest: a version. 0 when never written.
+  // odd while the writer copies
+  std::atomic<uint64_t> seq;
+  uint32_t size;
+  uint32_t reserved;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "atomics shared between processes");
+
+} // namespace srht
+
+// named shared memory. Create replaces a region left under the name,
+// the creator removes the name on Close
+class SrhtShmMapping
+{
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  std::string name_;
+  bool owner_ = false;
+#ifdef _WIN32
+  void* mapping_ = nullptr;
+#else
+  int fd_ = -1;
+#endif
+
+public:
+  SrhtShmMapping(const SrhtShmMapping&) = delete;
+  SrhtShmMapping& operator=(const SrhtShmMapping&) = delete;
+  SrhtShmMapping() {}
+  ~SrhtShmMapping() { Close(); }
+  // zero filled, read write
+  bool Create(const std::string& name, size_t size);
+  // read only
+  bool Open(const std::string& name);
+  void Close();
+  uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+};
+
+///
+/// SRHT packets to readers on the same host through shared memory.
+///
+/// one writer. every packet goes to a ring of fixed size slots that
+/// readers follow at their own pace (a reader that falls a whole ring
+/// behind loses the overwritten packets). skeleton and frame packets are
+/// also kept per skeletonId, so a reader that attaches late gets the
+/// skeletons and any reader can look at the latest frame in place.
+/// each slot is a seqlock: the writer never waits for readers.
+///
+/// UdpSender::SetShm writes the queued packets of each Flush here.
+///
+class SrhtShmWriter
+{
+  SrhtShmMapping mapping_;
+  srht::ShmHeader* header_ = nullptr;
+  size_t stride_ = 0;
+  uint64_t dropped_ = 0;
+
+public:
+  static constexpr uint32_t SLOT_COUNT = 64;
+  static constexpr uint32_t SLOT_SIZE = 16384;
+  static constexpr uint32_t SKELETON_COUNT = 16;
+  // name: a short name without '/'. slotSize: largest packet. skeletons
+  // with a skeletonId of skeletonCount or more are only in the ring
+  bool Create(const std::string& name,
+              uint32_t slotCount = SLOT_COUNT,
+              uint32_t slotSize = SLOT_SIZE,
+              uint32_t skeletonCount = SKELETON_COUNT);
+  void Close();
+  bool IsOpen() const { return header_ != nullptr; }
+  // false if larger than slotSize
+  bool Write(std::span<const uint8_t> packet);
+  // packets larger than slotSize
+  uint64_t Dropped() const { return dropped_; }
+};
+
+class SrhtShmReader
+{
+  SrhtShmMapping mapping_;
+  const srht::ShmHeader* header_ = nullptr;
+  // the layout checked against the mapping size at Open. the header in
+  // shared memory is not read again
+  uint32_t slotCount_ = 0;
+  uint32_t slotSize_ = 0;
+  uint32_t skeletonCount_ = 0;
+  size_t stride_ = 0;
+  uint64_t cursor_ = 0;
+  // version of each skeleton slot pushed to the receiver
+  std::vector<uint64_t> skeletons_;
+  std::vector<uint8_t> buffer_;
+  uint64_t lost_ = 0;
+
+  const srht::ShmSlot& Slot(size_t index) const
+  {
+    return *(const srht::ShmSlot*)((const uint8_t*)header_ +
+                                   sizeof(srht::ShmHeader) + stride_ * index);
+  }
+  const uint8_t* Bytes(const srht::ShmSlot& slot) const
+  {
+    return (const uint8_t*)&slot + sizeof(srht::ShmSlot);
+  }
+  bool Copy(const srht::ShmSlot& slot, uint64_t& seq, size_t& size);
+
+public:
+  // false if no writer created name
+  bool Open(const std::string& name);
+  void Close();
+  bool IsOpen() const { return header_ != nullptr; }
+
+  // Push the skeletons that changed and every ring packet since the last
+  // Poll (from the newest packet on the first Poll). returns the packets
+  // pushed
+  size_t Poll(SrhtReceiver& receiver);
+  // ring packets overwritten before this reader got to them
+  uint64_t Lost() const { return lost_; }
+
+  // zero copy look at the latest frame packet of skeletonId, in shared
+  // memory. f may run more than once: a run that raced with the writer is
+  // repeated. false if there is no frame or the writer kept overwriting it
+  template<typename F>
+  bool ReadLatest(uint16_t skeletonId, const F& f) const
+  {
+    if (!header_ || skeletonId >= skeletonCount_) {
+      return false;
+    }
+    auto& slot = Slot(skeletonCount_ + skeletonId);
+    for (int retry = 0; retry < 16; ++retry) {
+      auto seq = slot.seq.load(std::memory_order_acquire);
+      if (seq == 0) {
+        return false;
+      }
+      if (seq & 1) {
+        continue;
+      }
+      auto size = slot.size;
+      if (size <= slotSize_) {
+        f(std::span<const uint8_t>(Bytes(slot), size));
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == seq &&
+          size <= slotSize_) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
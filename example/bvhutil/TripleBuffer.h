@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+///
+/// single producer, single consumer handoff of the latest value.
+///
+/// three T: the writer fills Back, the reader looks at Front and the third
+/// holds the last published one. Publish and Update swap an index with
+/// that middle slot in one atomic exchange, so neither side waits and the
+/// reader only ever sees a buffer the writer has finished with.
+/// values the reader did not pick up in time are overwritten.
+///
+/// T is reused, not reset. a std::vector keeps its capacity.
+///
+template<typename T>
+class TripleBuffer
+{
+  static constexpr uint8_t INDEX = 0x3;
+  // middle_ holds a buffer the reader has not seen
+  static constexpr uint8_t DIRTY = 0x4;
+
+  T buffers_[3];
+  std::atomic<uint8_t> middle_ = 1;
+  // writer thread
+  uint8_t back_ = 0;
+  // reader thread
+  uint8_t front_ = 2;
+
+public:
+  // writer thread
+  T& Back() { return buffers_[back_]; }
+  // writer thread. Back becomes the latest value and a free buffer the new
+  // Back
+  void Publish()
+  {
+    auto prev = middle_.exchange(back_ | DIRTY, std::memory_order_acq_rel);
+    back_ = prev & INDEX;
+  }
+
+  // reader thread. take the latest published value. false if nothing was
+  // published since the last Update
+  bool Update()
+  {
+    if (!(middle_.load(std::memory_order_relaxed) & DIRTY)) {
+      return false;
+    }
+    auto prev = middle_.exchange(front_, std::memory_order_acq_rel);
+    front_ = prev & INDEX;
+    return true;
+  }
+  // reader thread. valid until the next Update
+  const T& Front() const { return buffers_[front_]; }
+};
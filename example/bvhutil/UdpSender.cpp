@@ -1,52 +1,182 @@
 #include <DirectXMath.h>
 
 #include "UdpSender.h"
-#include "../../subprojects/meshutils/Source/MeshUtils/muQuat32.h"
 #include "Bvh.h"
 #include "Payload.h"
+#include "Quat32Batch.h"
+#include "SrhtDelta.h"
+#include "SrhtLog.h"
+#include "SrhtShm.h"
 #include <DirectXMath.h>
+#include <algorithm>
+#include <errno.h>
 #include <iostream>
 
+// hands out Payload::handler to the send operation of that payload
+template <typename T> struct PayloadHandlerAllocator {
+  using value_type = T;
+  Payload *payload;
+
+  PayloadHandlerAllocator(Payload *p) : payload(p) {}
+  template <typename U>
+  PayloadHandlerAllocator(const PayloadHandlerAllocator<U> &other)
+      : payload(other.payload) {}
+  T *allocate(size_t n) {
+    if (!payload->handlerInUse && sizeof(T) * n <= Payload::HANDLER_BYTES) {
+      payload->handlerInUse = true;
+      return (T *)payload->handler;
+    }
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *p, size_t n) {
+    if ((void *)p == payload->handler) {
+      payload->handlerInUse = false;
+      return;
+    }
+    std::allocator<T>().deallocate(p, n);
+  }
+  template <typename U>
+  bool operator==(const PayloadHandlerAllocator<U> &other) const {
+    return payload == other.payload;
+  }
+  template <typename U>
+  bool operator!=(const PayloadHandlerAllocator<U> &other) const {
+    return payload != other.payload;
+  }
+};
+
+// returns the payload to its pool. the operation memory is freed before
+// the handler runs
+struct SendHandler {
+  UdpSender *self;
+  Payload *payload;
+
+  using allocator_type = PayloadHandlerAllocator<void>;
+  allocator_type get_allocator() const { return {payload}; }
+  void operator()(asio::error_code ec, std::size_t bytes_transferred) {
+    self->ReleasePayload(payload);
+  }
+};
+
 UdpSender::UdpSender(asio::io_context &io)
     : socket_(io, asio::ip::udp::endpoint(asio::ip::udp::v4(), 0)) {}
 
-std::shared_ptr<Payload> UdpSender::GetOrCreatePayload() {
+Payload *UdpSender::AcquirePayload(size_t bytes) {
+  auto pool = pool_.load(std::memory_order_acquire);
+  if (pool && pool->Bytes() >= bytes) {
+    if (auto payload = pool->Acquire()) {
+      return payload;
+    }
+  }
+  // a new skeleton or every payload in flight. not on the per frame path
+  // once the pool fits the ticks
   std::lock_guard<std::mutex> lock(mutex_);
-  if (payloads_.empty()) {
-    return std::make_shared<Payload>();
-  } else {
-    auto payload = payloads_.front();
-    payloads_.pop_front();
-    return payload;
+  pool = pool_.load(std::memory_order_relaxed);
+  auto count = POOL_SIZE;
+  if (pool) {
+    if (pool->Bytes() >= bytes) {
+      // grown by another thread meanwhile, or full
+      if (auto payload = pool->Acquire()) {
+        return payload;
+      }
+      count = pool->Count() * 2;
+    } else {
+      count = pool->Count();
+    }
+    bytes = std::max(bytes, pool->Bytes());
+  }
+  if (count > MAX_POOL_SIZE) {
+    return nullptr;
   }
+  pools_.push_back(std::make_unique<PayloadPool>(count, bytes));
+  pool = pools_.back().get();
+  pool_.store(pool, std::memory_order_release);
+  return pool->Acquire();
 }
 
-void UdpSender::ReleasePayload(const std::shared_ptr<Payload> &payload) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  payloads_.push_back(payload);
+void UdpSender::ReleasePayload(Payload *payload) {
+  payload->pool->Release(payload);
+}
+
+Payload *UdpSender::WriteSkeleton(const Bvh &bvh, uint16_t skeletonId,
+                                  float positionScale) {
+  // frames of the same skeleton fit as well
+  auto payload = AcquirePayload(
+      std::max(sizeof(srht::SkeletonHeader) + sizeof(float) +
+                   sizeof(srht::JointDefinition) * bvh.joints.size(),
+               sizeof(srht::FrameHeader) +
+                   sizeof(DirectX::XMFLOAT4) * bvh.joints.size()));
+  if (!payload) {
+    ++dropped_;
+    return nullptr;
+  }
+  auto jointCount = static_cast<uint16_t>(bvh.joints.size());
+  auto scaling = bvh.GuessScaling();
+  if (positionScale <= 0) {
+    payload->SetSkeleton(jointCount, skeletonId);
+    for (auto &joint : bvh.joints) {
+      payload->Push(srht::JointDefinition{
+          .parentBoneIndex = joint.parent,
+          .boneType = (uint16_t)joint.bone_,
+          .xFromParent = joint.localOffset.x * scaling,
+          .yFromParent = joint.localOffset.y * scaling,
+          .zFromParent = joint.localOffset.z * scaling,
+      });
+    }
+    return payload;
+  }
+
+  auto compact = [&bvh, scaling, positionScale](const BvhJoint &joint,
+                                                srht::CompactJointDefinition &c) {
+    c.parentBoneIndex = static_cast<uint8_t>(joint.parent);
+    c.boneType = static_cast<uint8_t>(joint.bone_);
+    return (joint.index == 0 || joint.parent < 0xff) &&
+           static_cast<uint16_t>(joint.bone_) <= 0xff &&
+           srht::FixedFromFloat(joint.localOffset.x * scaling, positionScale,
+                                c.xFromParent) &&
+           srht::FixedFromFloat(joint.localOffset.y * scaling, positionScale,
+                                c.yFromParent) &&
+           srht::FixedFromFloat(joint.localOffset.z * scaling, positionScale,
+                                c.zFromParent);
+  };
+  // 1 byte joint indices up to 255 joints
+  bool fits = jointCount <= 0xff;
+  srht::CompactJointDefinition c;
+  for (size_t i = 0; fits && i < bvh.joints.size(); ++i) {
+    fits = compact(bvh.joints[i], c);
+  }
+  if (fits) {
+    payload->SetSkeleton(jointCount, skeletonId,
+                         srht::SkeletonFlags::POSITION_SCALE |
+                             srht::SkeletonFlags::COMPACT_JOINTS);
+    payload->Push(positionScale);
+    for (auto &joint : bvh.joints) {
+      compact(joint, c);
+      payload->Push(c);
+    }
+  } else {
+    payload->SetSkeleton(jointCount, skeletonId,
+                         srht::SkeletonFlags::POSITION_SCALE);
+    payload->Push(positionScale);
+    for (auto &joint : bvh.joints) {
+      payload->Push(srht::JointDefinition{
+          .parentBoneIndex = joint.parent,
+          .boneType = (uint16_t)joint.bone_,
+          .xFromParent = joint.localOffset.x * scaling,
+          .yFromParent = joint.localOffset.y * scaling,
+          .zFromParent = joint.localOffset.z * scaling,
+      });
+    }
+  }
+  return payload;
 }
 
 void UdpSender::SendSkeleton(asio::ip::udp::endpoint ep,
                              const std::shared_ptr<Bvh> &bvh) {
-  auto payload = GetOrCreatePayload();
-  joints_.clear();
-  auto scaling = bvh->GuessScaling();
-  for (auto joint : bvh->joints) {
-    joints_.push_back({
-        .parentBoneIndex = joint.parent,
-        .boneType = (uint16_t)joint.bone_,
-        .xFromParent = joint.localOffset.x * scaling,
-        .yFromParent = joint.localOffset.y * scaling,
-        .zFromParent = joint.localOffset.z * scaling,
-    });
+  if (auto payload = WriteSkeleton(*bvh, 0)) {
+    socket_.async_send_to(asio::buffer(payload->data, payload->size), ep,
+                          SendHandler{this, payload});
   }
-  payload->SetSkeleton(joints_);
-
-  socket_.async_send_to(asio::buffer(payload->buffer), ep,
-                        [self = this, payload](asio::error_code ec,
-                                               std::size_t bytes_transferred) {
-                          self->ReleasePayload(payload);
-                        });
 }
 
 static DirectX::XMFLOAT4X4 ToMat(const BvhMat3 &rot, const BvhOffset &pos,
@@ -70,42 +200,372 @@ static DirectX::XMFLOAT4 ToQuat(const BvhMat3 &rot) {
   return vec4;
 }
 
-void UdpSender::SendFrame(asio::ip::udp::endpoint ep,
-                          const std::shared_ptr<Bvh> &bvh,
-                          const BvhFrame &frame, bool pack) {
-
-  auto payload = GetOrCreatePayload();
+Payload *UdpSender::WriteFrame(const Bvh &bvh, const BvhFrame &frame,
+                               bool pack, uint16_t skeletonId) {
+  // one pass of direct writes into a preallocated payload
+  auto payload = AcquirePayload(sizeof(srht::FrameHeader) +
+                                sizeof(DirectX::XMFLOAT4) * bvh.joints.size());
+  if (!payload) {
+    ++dropped_;
+    return nullptr;
+  }
 
-  auto scaling = bvh->GuessScaling();
-  for (auto &joint : bvh->joints) {
-    auto [pos, rot] = frame.Resolve(joint.channels);
+  auto scaling = bvh.GuessScaling();
+  for (auto &joint : bvh.joints) {
+    auto [pos, q] = frame.ResolveQuaternion(joint.index, joint.channels);
     DirectX::XMFLOAT4 rotation;
-    DirectX::XMStoreFloat4(&rotation, DirectX::XMQuaternionRotationMatrix(rot));
+    DirectX::XMStoreFloat4(&rotation, q);
 
     if (joint.index == 0) {
       payload->SetFrame(
           std::chrono::duration_cast<std::chrono::nanoseconds>(frame.time),
-          pos.x * scaling, pos.y * scaling, pos.z * scaling, pack);
-    }
-    if (pack) {
-      auto packed =
-          quat_packer::Pack(rotation.x, rotation.y, rotation.z, rotation.w);
-#if _DEBUG
-      {
-        mu::quatf debug_q{rotation.x, rotation.y, rotation.z, rotation.w};
-        auto debug_packed = mu::quat32(debug_q);
-        assert(*(uint32_t *)&debug_packed.value == packed);
+          pos.x * scaling, pos.y * scaling, pos.z * scaling, pack,
+          skeletonId);
+    }
+    payload->Push(rotation);
+  }
+  if (pack) {
+    // float4 x joints => quat32 x joints, in place
+    auto rotations = payload->data + sizeof(srht::FrameHeader);
+    auto count = bvh.joints.size();
+    quat_packer::PackBatch({(const float *)rotations, count * 4},
+                           {(uint32_t *)rotations, count});
+    payload->size = sizeof(srht::FrameHeader) + sizeof(uint32_t) * count;
+  }
+  return payload;
+}
+
+void UdpSender::SendFrame(asio::ip::udp::endpoint ep,
+                          const std::shared_ptr<Bvh> &bvh,
+                          const BvhFrame &frame, bool pack) {
+  if (auto payload = WriteFrame(*bvh, frame, pack, 0)) {
+    socket_.async_send_to(asio::buffer(payload->data, payload->size), ep,
+                          SendHandler{this, payload});
+  }
+}
+
+bool UdpSender::AddEndpoint(const asio::ip::udp::endpoint &ep) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (ep.protocol() != socket_.local_endpoint().protocol()) {
+    // a v6 endpoint on the v4 socket. every send to it would fail
+    return false;
+  }
+  if (std::find(endpoints_.begin(), endpoints_.end(), ep) !=
+      endpoints_.end()) {
+    return false;
+  }
+  endpoints_.push_back(ep);
+  return true;
+}
+
+bool UdpSender::RemoveEndpoint(const asio::ip::udp::endpoint &ep) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = std::find(endpoints_.begin(), endpoints_.end(), ep);
+  if (found == endpoints_.end()) {
+    return false;
+  }
+  endpoints_.erase(found);
+  return true;
+}
+
+std::vector<asio::ip::udp::endpoint> UdpSender::Endpoints() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return endpoints_;
+}
+
+void UdpSender::QueueSkeleton(const Bvh &bvh, uint16_t skeletonId) {
+  auto scale =
+      positionEncoding_ == PositionEncoding::FLOAT ? 0.0f : positionScale_;
+  if (auto payload = WriteSkeleton(bvh, skeletonId, scale)) {
+    queue_.push_back(payload);
+    if (skeletonId >= skeletonScales_.size()) {
+      skeletonScales_.resize(skeletonId + 1);
+    }
+    skeletonScales_[skeletonId] = scale;
+    // receivers that see the skeleton for the first time need a keyframe
+    if (skeletonId < keyframes_.size()) {
+      keyframes_[skeletonId].packed.clear();
+    }
+  }
+}
+
+void UdpSender::QueueFrame(const Bvh &bvh, const BvhFrame &frame, bool pack,
+                           uint16_t skeletonId) {
+  if (auto payload = WriteFrame(bvh, frame, pack, skeletonId)) {
+    if (pack && keyframeInterval_ > 0) {
+      WriteDelta(payload, bvh.joints.size(), skeletonId);
+    }
+    if (positionEncoding_ != PositionEncoding::FLOAT) {
+      CompactPosition(payload, skeletonId);
+    }
+    queue_.push_back(payload);
+  }
+}
+
+void UdpSender::WriteDelta(Payload *payload, size_t jointCount,
+                           uint16_t skeletonId) {
+  if (skeletonId >= keyframes_.size()) {
+    keyframes_.resize(skeletonId + 1);
+  }
+  auto &keyframe = keyframes_[skeletonId];
+  srht::FrameHeader header;
+  memcpy(&header, payload->data, sizeof(header));
+  std::span<const uint32_t> packed(
+      (const uint32_t *)(payload->data + sizeof(header)), jointCount);
+
+  if (keyframe.packed.size() == jointCount &&
+      keyframe.age + 1 < keyframeInterval_) {
+    delta_.resize(srht::DeltaBound(jointCount));
+    auto size = srht::EncodeDelta(keyframe.time, keyframe.packed, packed,
+                                  deltaThreshold_, delta_.data());
+    if (size < packed.size_bytes()) {
+      header.flags = srht::FrameFlags::USE_QUAT32 | srht::FrameFlags::DELTA;
+      memcpy(payload->data, &header, sizeof(header));
+      memcpy(payload->data + sizeof(header), delta_.data(), size);
+      payload->size = sizeof(header) + size;
+      ++keyframe.age;
+      ++stats_.deltas;
+      return;
+    }
+  }
+
+  // send as is and keep as the new keyframe
+  keyframe.time = header.time;
+  keyframe.packed.assign(packed.begin(), packed.end());
+  keyframe.age = 0;
+  ++stats_.keyframes;
+}
+
+void UdpSender::CompactPosition(Payload *payload, uint16_t skeletonId) {
+  srht::FrameHeader header;
+  memcpy(&header, payload->data, sizeof(header));
+  srht::CompactFrameHeader compact{
+      .time = header.time,
+      .flags = header.flags,
+      .skeletonId = header.skeletonId,
+  };
+  if (positionEncoding_ == PositionEncoding::FIXED) {
+    // the scale the receiver has
+    auto scale = skeletonId < skeletonScales_.size()
+                     ? skeletonScales_[skeletonId]
+                     : 0.0f;
+    int16_t x, y, z;
+    if (scale != positionScale_ ||
+        !srht::FixedFromFloat(header.x, scale, x) ||
+        !srht::FixedFromFloat(header.y, scale, y) ||
+        !srht::FixedFromFloat(header.z, scale, z)) {
+      return;
+    }
+    compact.flags = compact.flags | srht::FrameFlags::FIXED_POSITION;
+    compact.x = static_cast<uint16_t>(x);
+    compact.y = static_cast<uint16_t>(y);
+    compact.z = static_cast<uint16_t>(z);
+  } else {
+    if (!(std::abs(header.x) <= 65504.0f && std::abs(header.y) <= 65504.0f &&
+          std::abs(header.z) <= 65504.0f)) {
+      return;
+    }
+    compact.flags = compact.flags | srht::FrameFlags::HALF_POSITION;
+    compact.x = srht::HalfFromFloat(header.x);
+    compact.y = srht::HalfFromFloat(header.y);
+    compact.z = srht::HalfFromFloat(header.z);
+  }
+  // the rotations move up
+  memcpy(payload->data, &compact, srht::COMPACT_FRAME_SIZE);
+  memmove(payload->data + srht::COMPACT_FRAME_SIZE,
+          payload->data + sizeof(header), payload->size - sizeof(header));
+  payload->size -= sizeof(header) - srht::COMPACT_FRAME_SIZE;
+  ++stats_.compactPositions;
+}
+
+size_t UdpSender::Flush() {
+  if (queue_.empty()) {
+    return 0;
+  }
+  if (shm_) {
+    // whole packets. the MTU is a network limit
+    for (auto payload : queue_) {
+      if (shm_->Write(payload->Bytes())) {
+        ++stats_.shm;
       }
-      payload->Push(packed);
+    }
+  }
+  if (mtu_ > 0) {
+    Packetize();
+  }
+  if (recorder_) {
+    // the datagrams, after bundling and fragmentation
+    auto now = SrhtRecorder::Clock::now();
+    for (auto payload : queue_) {
+      if (recorder_->Record(payload->Bytes(), now)) {
+        ++stats_.recorded;
+      }
+    }
+  }
+  {
+    // copy into a reused vector. Add/RemoveEndpoint do not wait for sends
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushEndpoints_.assign(endpoints_.begin(), endpoints_.end());
+  }
+  ++stats_.flushes;
+  auto sent = SendBatch(queue_.size() * flushEndpoints_.size());
+  for (auto payload : queue_) {
+    ReleasePayload(payload);
+  }
+  queue_.clear();
+  return sent;
+}
+
+void UdpSender::Packetize() {
+  // the open bundle, or a packet that may become its first entry
+  Payload *bundle = nullptr;
+  Payload *single = nullptr;
+  auto append = [this](Payload *bundle, Payload *packet) {
+    auto size = static_cast<uint16_t>(packet->size);
+    bundle->Push(size);
+    bundle->Push(packet->data, packet->data + packet->size);
+    srht::BundleHeader header;
+    memcpy(&header, bundle->data, sizeof(header));
+    ++header.count;
+    memcpy(bundle->data, &header, sizeof(header));
+    ReleasePayload(packet);
+    ++stats_.bundled;
+  };
+  auto close = [this, &bundle, &single]() {
+    if (bundle) {
+      packets_.push_back(bundle);
+      ++stats_.bundles;
+      bundle = nullptr;
+    }
+    if (single) {
+      packets_.push_back(single);
+      single = nullptr;
+    }
+  };
+
+  packets_.clear();
+  for (auto payload : queue_) {
+    if (payload->size > mtu_) {
+      close();
+      Fragment(payload);
+      ReleasePayload(payload);
+      continue;
+    }
+    auto entry = sizeof(uint16_t) + payload->size;
+    if (bundle && bundle->size + entry <= mtu_) {
+      append(bundle, payload);
+      continue;
+    }
+    if (single && sizeof(srht::BundleHeader) + sizeof(uint16_t) +
+                          single->size + entry <=
+                      mtu_) {
+      if (auto opened = AcquirePayload(mtu_)) {
+        opened->Push(srht::BundleHeader{});
+        append(opened, single);
+        append(opened, payload);
+        single = nullptr;
+        bundle = opened;
+        continue;
+      }
+      // every payload in use: send them one by one
+    }
+    close();
+    single = payload;
+  }
+  close();
+  queue_.swap(packets_);
+  packets_.clear();
+}
+
+void UdpSender::Fragment(const Payload *payload) {
+  auto chunk = mtu_ - sizeof(srht::FragmentHeader);
+  auto count = (payload->size + chunk - 1) / chunk;
+  if (count > srht::MAX_FRAGMENTS) {
+    ++dropped_;
+    return;
+  }
+  auto messageId = messageId_++;
+  auto first = packets_.size();
+  for (size_t i = 0; i < count; ++i) {
+    auto fragment = AcquirePayload(mtu_);
+    if (!fragment) {
+      // the packet cannot be completed. send none of it
+      for (auto j = first; j < packets_.size(); ++j) {
+        ReleasePayload(packets_[j]);
+      }
+      stats_.fragments -= packets_.size() - first;
+      packets_.resize(first);
+      ++dropped_;
+      return;
+    }
+    auto offset = i * chunk;
+    auto size = std::min(chunk, payload->size - offset);
+    fragment->Push(srht::FragmentHeader{
+        .messageId = messageId,
+        .index = static_cast<uint16_t>(i),
+        .count = static_cast<uint16_t>(count),
+        .totalSize = static_cast<uint32_t>(payload->size),
+        .offset = static_cast<uint32_t>(offset),
+    });
+    fragment->Push(payload->data + offset, payload->data + offset + size);
+    packets_.push_back(fragment);
+    ++stats_.fragments;
+  }
+}
+
+size_t UdpSender::SendBatch(size_t count) {
+  size_t sent = 0;
+#ifdef __linux__
+  if (batchSend_) {
+    msgs_.resize(count);
+    iovs_.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      auto payload = queue_[i % queue_.size()];
+      auto &ep = flushEndpoints_[i / queue_.size()];
+      iovs_[i] = {payload->data, payload->size};
+      msgs_[i] = {};
+      msgs_[i].msg_hdr.msg_name = (void *)ep.data();
+      msgs_[i].msg_hdr.msg_namelen = static_cast<socklen_t>(ep.size());
+      msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+      msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t i = 0;
+    while (i < count) {
+      // at most UIO_MAXIOV(1024) per call
+      auto n = static_cast<unsigned>(std::min<size_t>(count - i, 1024));
+      auto result =
+          sendmmsg(socket_.native_handle(), &msgs_[i], n, MSG_DONTWAIT);
+      ++stats_.syscalls;
+      if (result > 0) {
+        sent += result;
+        i += result;
+      } else if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // the socket buffer is full. drop the rest of the tick
+        dropped_ += count - i;
+        break;
+      } else {
+        // the error of message i alone (ENETUNREACH for one host). the
+        // other endpoints still get the tick
+        ++dropped_;
+        ++i;
+      }
+    }
+    stats_.datagrams += sent;
+    return sent;
+  }
 #endif
+  for (size_t i = 0; i < count; ++i) {
+    auto payload = queue_[i % queue_.size()];
+    auto &ep = flushEndpoints_[i / queue_.size()];
+    asio::error_code ec;
+    socket_.send_to(asio::buffer(payload->data, payload->size), ep, 0, ec);
+    ++stats_.syscalls;
+    if (ec) {
+      ++dropped_;
     } else {
-      payload->Push(rotation);
+      ++sent;
     }
   }
-
-  socket_.async_send_to(asio::buffer(payload->buffer), ep,
-                        [self = this, payload](asio::error_code ec,
-                                               std::size_t bytes_transferred) {
-                          self->ReleasePayload(payload);
-                        });
+  stats_.datagrams += sent;
+  return sent;
 }
@@ -2,24 +2,196 @@
 #include "Bvh.h"
 #include "Payload.h"
 #include "srht.h"
+#include <algorithm>
 #include <asio.hpp>
-#include <list>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <span>
+#include <vector>
 
+struct UdpSendStats {
+  uint64_t datagrams = 0;
+  // send calls. sendmmsg counts once for its whole batch
+  uint64_t syscalls = 0;
+  // ticks (Flush) with something to send
+  uint64_t flushes = 0;
+  // QueueFrame with SetDelta: full quat32 frames and FrameFlags::DELTA ones
+  uint64_t keyframes = 0;
+  uint64_t deltas = 0;
+  // Flush with SetMtu: datagrams of several packets, packets that were
+  // bundled and fragment datagrams
+  uint64_t bundles = 0;
+  uint64_t bundled = 0;
+  uint64_t fragments = 0;
+  // packets written to SetShm
+  uint64_t shm = 0;
+  // datagrams written to SetRecorder
+  uint64_t recorded = 0;
+  // QueueFrame with SetPositionEncoding: frames with a 16 bit root position
+  uint64_t compactPositions = 0;
+};
+
+// root positions and joint offsets of QueueSkeleton/QueueFrame. error
+// bounds in srht.h
+enum class PositionEncoding {
+  FLOAT,
+  // FrameFlags::HALF_POSITION
+  HALF,
+  // FrameFlags::FIXED_POSITION
+  FIXED,
+};
+
+class SrhtShmWriter;
+class SrhtRecorder;
+
+///
+/// frames and skeletons as SRHT datagrams.
+///
+/// SendFrame/SendSkeleton send one datagram to one endpoint asynchronously.
+/// QueueFrame/QueueSkeleton serialize once for the registered endpoints and
+/// Flush submits every queued datagram x endpoint of the tick: one
+/// sendmmsg per 1024 messages on linux, a send_to each elsewhere (or with
+/// SetBatchSend(false)).
+///
+/// with SetDelta, QueueFrame sends quat32 frames as deltas against the last
+/// keyframe of their skeletonId. a lost keyframe costs the deltas up to the
+/// next one.
+///
+/// with SetMtu, Flush bundles the packets of the tick into datagrams of at
+/// most that size and splits larger packets into fragments.
+///
+/// with SetShm, Flush also writes the queued packets to shared memory for
+/// readers on the same host (SrhtShmReader). no endpoint is needed for it.
+///
+/// with SetPositionEncoding, skeletons carry 8 byte joints and frames a 16
+/// bit root position.
+///
+/// with SetRecorder, Flush appends the datagrams of the tick to a .srhtlog
+/// (SrhtLog.h), once whatever the number of endpoints.
+///
 class UdpSender {
   asio::ip::udp::socket socket_;
-  std::list<std::shared_ptr<Payload>> payloads_;
+  // current pool. replaced by a larger one when a skeleton does not fit or
+  // every payload is in flight (a tick of many skeletons, the fragments of
+  // a large packet). the old ones stay alive for payloads still in flight
+  std::atomic<PayloadPool *> pool_ = nullptr;
+  std::vector<std::unique_ptr<PayloadPool>> pools_;
   std::mutex mutex_;
-  std::vector<srht::JointDefinition> joints_;
+  std::atomic<uint64_t> dropped_ = 0;
+
+  // registry. guarded by mutex_
+  std::vector<asio::ip::udp::endpoint> endpoints_;
+  // io_context thread
+  std::vector<Payload *> queue_;
+  std::vector<asio::ip::udp::endpoint> flushEndpoints_;
+  bool batchSend_ = true;
+  UdpSendStats stats_;
+#ifdef __linux__
+  // sendmmsg arguments. grow to the largest tick
+  std::vector<mmsghdr> msgs_;
+  std::vector<iovec> iovs_;
+#endif
+  // QueueFrame delta state per skeletonId. io_context thread
+  struct Keyframe {
+    int64_t time = 0;
+    std::vector<uint32_t> packed;
+    // frames since the keyframe
+    uint32_t age = 0;
+  };
+  std::vector<Keyframe> keyframes_;
+  std::vector<uint8_t> delta_;
+  uint32_t keyframeInterval_ = 0;
+  uint32_t deltaThreshold_ = 0;
+  // datagram budget of Flush. io_context thread
+  size_t mtu_ = 0;
+  uint32_t messageId_ = 0;
+  std::vector<Payload *> packets_;
+  std::shared_ptr<SrhtShmWriter> shm_;
+  std::shared_ptr<SrhtRecorder> recorder_;
+  // io_context thread
+  PositionEncoding positionEncoding_ = PositionEncoding::FLOAT;
+  float positionScale_ = 0;
+  // SkeletonFlags::POSITION_SCALE of the last QueueSkeleton per skeletonId
+  std::vector<float> skeletonScales_;
+
+  // positionScale: SkeletonFlags::POSITION_SCALE. 0 for none
+  Payload *WriteSkeleton(const Bvh &bvh, uint16_t skeletonId,
+                         float positionScale = 0);
+  Payload *WriteFrame(const Bvh &bvh, const BvhFrame &frame, bool pack,
+                      uint16_t skeletonId);
+  size_t SendBatch(size_t count);
+  void WriteDelta(Payload *payload, size_t jointCount, uint16_t skeletonId);
+  void CompactPosition(Payload *payload, uint16_t skeletonId);
+  void Packetize();
+  void Fragment(const Payload *payload);
 
 public:
+  // payloads of the first pool. each new pool doubles, up to MAX_POOL_SIZE
+  static constexpr size_t POOL_SIZE = 64;
+  static constexpr size_t MAX_POOL_SIZE = 4096;
   UdpSender(asio::io_context &io);
-  std::shared_ptr<Payload> GetOrCreatePayload();
-  void ReleasePayload(const std::shared_ptr<Payload> &payload);
+  // nullptr when MAX_POOL_SIZE payloads are in flight
+  Payload *AcquirePayload(size_t bytes);
+  void ReleasePayload(Payload *payload);
+  // frames dropped for lack of a free payload
+  uint64_t Dropped() const { return dropped_; }
   void SendSkeleton(asio::ip::udp::endpoint ep,
                     const std::shared_ptr<Bvh> &bvh);
   void SendFrame(asio::ip::udp::endpoint ep, const std::shared_ptr<Bvh> &bvh,
                  const BvhFrame &frame, bool pack);
+
+  // thread safe. false if already registered or of another protocol than
+  // the (v4) socket
+  bool AddEndpoint(const asio::ip::udp::endpoint &ep);
+  bool RemoveEndpoint(const asio::ip::udp::endpoint &ep);
+  std::vector<asio::ip::udp::endpoint> Endpoints();
+
+  // io_context thread. skeletonId tells several skeletons of a tick apart
+  void QueueSkeleton(const Bvh &bvh, uint16_t skeletonId = 0);
+  void QueueFrame(const Bvh &bvh, const BvhFrame &frame, bool pack,
+                  uint16_t skeletonId = 0);
+  // io_context thread. send the queue to every endpoint and release it.
+  // returns datagrams sent. a full socket buffer drops the rest of the tick
+  size_t Flush();
+  // false: one send_to per datagram even where sendmmsg exists
+  void SetBatchSend(bool enable) { batchSend_ = enable; }
+  // SetMtu range. the largest UDP payload over IPv4, bundle entry sizes
+  // are 16 bit
+  static constexpr size_t MIN_MTU = 64;
+  static constexpr size_t MAX_MTU = 65507;
+  // io_context thread. UDP payload bytes per datagram, without the IP and
+  // UDP headers: 1472 for an ethernet MTU of 1500, less through tunnels.
+  // 0: a datagram per packet, whatever its size
+  void SetMtu(size_t bytes) {
+    mtu_ = bytes ? std::clamp(bytes, MIN_MTU, MAX_MTU) : 0;
+  }
+  // io_context thread. nullptr to stop
+  void SetShm(const std::shared_ptr<SrhtShmWriter> &shm) { shm_ = shm; }
+  // io_context thread. nullptr to stop
+  void SetRecorder(const std::shared_ptr<SrhtRecorder> &recorder) {
+    recorder_ = recorder;
+  }
+  // io_context thread. a full quat32 frame every keyframeInterval frames
+  // (or when a delta would not be smaller) and deltas between them.
+  // threshold: quat32 steps a joint may move away from the keyframe before
+  // it is sent. keyframeInterval 0: full frames only
+  void SetDelta(uint32_t keyframeInterval, uint32_t threshold = 0) {
+    keyframeInterval_ = keyframeInterval;
+    deltaThreshold_ = threshold;
+  }
+  // meters per unit of PositionEncoding::FIXED: +-32.767m at 0.5mm
+  static constexpr float POSITION_SCALE = 0.001f;
+  // io_context thread. HALF or FIXED: QueueSkeleton sends the scale and
+  // CompactJointDefinition (up to 255 joints whose offsets fit), QueueFrame
+  // a CompactFrameHeader, 12 bytes less. a FIXED frame needs a skeleton
+  // queued with the same scale and a root position in range, it is sent
+  // with a float position otherwise
+  void SetPositionEncoding(PositionEncoding encoding,
+                           float scale = POSITION_SCALE) {
+    positionEncoding_ = encoding;
+    positionScale_ = scale > 0 ? scale : POSITION_SCALE;
+  }
+  // io_context thread
+  const UdpSendStats &Stats() const { return stats_; }
 };
@@ -0,0 +1,152 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(uint32_t threads)
+{
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (uint32_t i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (uint32_t i = 1; i < threads; ++i) {
+    workers_.emplace_back([self = this, i]() { self->WorkerLoop(i); });
+  }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void
+WorkStealingPool::ParallelFor(size_t count, size_t grain, const RangeFunc& func)
+{
+  if (count == 0) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  auto chunk_count = (count + grain - 1) / grain;
+  if (queues_.size() == 1 || chunk_count == 1) {
+    func(0, count, 0);
+    return;
+  }
+
+  std::lock_guard<std::mutex> call(call_);
+  pending_ = chunk_count;
+  for (size_t q = 0; q < queues_.size(); ++q) {
+    auto first = chunk_count * q / queues_.size();
+    auto last = chunk_count * (q + 1) / queues_.size();
+    std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+    // popped from the back. push in reverse so the owner walks forward
+    for (auto c = last; c-- > first;) {
+      queues_[q]->chunks.push_back(
+        { c * grain, std::min(count, (c + 1) * grain), &func });
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++generation_;
+  }
+  wake_.notify_all();
+
+  while (RunOne(0)) {
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [self = this]() { return self->pending_ == 0; });
+}
+
+bool
+WorkStealingPool::RunOne(uint32_t index)
+{
+  std::optional<Chunk> chunk;
+  {
+    auto& own = *queues_[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.chunks.empty()) {
+      chunk = own.chunks.back();
+      own.chunks.pop_back();
+    }
+  }
+  for (size_t i = 1; !chunk && i < queues_.size(); ++i) {
+    auto& victim = *queues_[(index + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.chunks.empty()) {
+      chunk = victim.chunks.front();
+      victim.chunks.pop_front();
+    }
+  }
+  if (!chunk) {
+    return false;
+  }
+
+  (*chunk->func)(chunk->begin, chunk->end, index);
+  if (--pending_ == 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_.notify_all();
+  }
+  return true;
+}
+
+WorkStealingPool&
+WorkStealingPool::Shared()
+{
+  static WorkStealingPool pool;
+  return pool;
+}
+
+// set while a ParallelRanges func runs. the shared pool takes one
+// ParallelFor at a time, a nested one would wait for itself
+static thread_local bool t_inRanges = false;
+
+void
+ParallelRanges(size_t count,
+               uint32_t ranges,
+               const std::function<void(size_t, size_t)>& func)
+{
+  if (count == 0) {
+    return;
+  }
+  if (t_inRanges) {
+    func(0, count);
+    return;
+  }
+  auto& pool = WorkStealingPool::Shared();
+  if (ranges == 0) {
+    ranges = pool.ThreadCount();
+  }
+  auto grain = (count + ranges - 1) / ranges;
+  pool.ParallelFor(count, grain, [&func](size_t begin, size_t end, uint32_t) {
+    auto outer = t_inRanges;
+    t_inRanges = true;
+    func(begin, end);
+    t_inRanges = outer;
+  });
+}
+
+void
+WorkStealingPool::WorkerLoop(uint32_t index)
+{
+  uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [self = this, seen]() {
+        return self->stop_ || self->generation_ != seen;
+      });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+    while (RunOne(index)) {
+    }
+  }
+}
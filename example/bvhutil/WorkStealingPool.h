@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+///
+/// fixed set of worker threads for data parallel loops.
+///
+/// ParallelFor cuts [0, count) into grain sized chunks and deals a
+/// contiguous run of them to every queue. a thread pops its own queue from
+/// the back and, when that is empty, steals from the front of the others.
+/// uneven chunks (characters with more joints, a thread descheduled by the
+/// os) are picked up by whoever is idle.
+///
+/// the calling thread is worker 0 and runs chunks as well.
+///
+class WorkStealingPool
+{
+public:
+  // begin, end, worker index [0, ThreadCount())
+  using RangeFunc = std::function<void(size_t, size_t, uint32_t)>;
+
+private:
+  struct Chunk
+  {
+    size_t begin;
+    size_t end;
+    const RangeFunc* func;
+  };
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Chunk> chunks;
+  };
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+  std::atomic<size_t> pending_ = 0;
+  // one ParallelFor at a time
+  std::mutex call_;
+
+public:
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+  // threads: including the caller. 0 for std::thread::hardware_concurrency
+  explicit WorkStealingPool(uint32_t threads = 0);
+  ~WorkStealingPool();
+  uint32_t ThreadCount() const { return static_cast<uint32_t>(queues_.size()); }
+  // blocks until every chunk is done. func must not throw
+  void ParallelFor(size_t count, size_t grain, const RangeFunc& func);
+  // hardware_concurrency threads for one shot loops (Bake, BvhTracks,
+  // ParseMotion). started on first use
+  static WorkStealingPool& Shared();
+
+private:
+  void WorkerLoop(uint32_t index);
+  bool RunOne(uint32_t index);
+};
+
+// func(first, last) over [0, count) cut into at most ranges contiguous
+// ranges, on WorkStealingPool::Shared. ranges: 0 for one per pool thread.
+// a call from inside another ParallelRanges runs on the calling thread
+void
+ParallelRanges(size_t count,
+               uint32_t ranges,
+               const std::function<void(size_t, size_t)>& func);
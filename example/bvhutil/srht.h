@@ -1,6 +1,8 @@
 #pragma once
 #include <cmath>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 //
 // from
@@ -258,11 +260,36 @@ struct JointDefinition {
 };
 static_assert(sizeof(JointDefinition) == 16, "JointDefintion");
 
+// SkeletonFlags::COMPACT_JOINTS. jointCount <= 255
+struct CompactJointDefinition {
+  // 0xff for root
+  uint8_t parentBoneIndex;
+  uint8_t boneType;
+  // FixedFromFloat with the position scale
+  int16_t xFromParent;
+  int16_t yFromParent;
+  int16_t zFromParent;
+};
+static_assert(sizeof(CompactJointDefinition) == 8, "CompactJointDefinition");
+
 enum class SkeletonFlags : uint32_t {
   NONE = 0,
   // if hasInitialRotation PackQuat X jointCount for InitialRotation
   HAS_INITIAL_ROTATION = 0x1,
+  // float: meters per unit of the fixed point positions of this skeleton
+  // (COMPACT_JOINTS, FrameFlags::FIXED_POSITION) follows the header
+  POSITION_SCALE = 0x2,
+  // with POSITION_SCALE. CompactJointDefinition x jointCount instead of
+  // JointDefinition x jointCount
+  COMPACT_JOINTS = 0x4,
 };
+inline constexpr SkeletonFlags operator|(SkeletonFlags a, SkeletonFlags b) {
+  return static_cast<SkeletonFlags>(static_cast<uint32_t>(a) |
+                                    static_cast<uint32_t>(b));
+}
+inline constexpr bool HasFlag(SkeletonFlags flags, SkeletonFlags flag) {
+  return (static_cast<uint32_t>(flags) & static_cast<uint32_t>(flag)) != 0;
+}
 
 struct SkeletonHeader {
   char magic[8] = {'S', 'R', 'H', 'T', 'S', 'K', 'L', '1'};
@@ -270,14 +297,30 @@ struct SkeletonHeader {
   uint16_t jointCount = 0;
   SkeletonFlags flags = {};
 };
-// continue JointDefinition X jointCount
+// continue [float positionScale], JointDefinition X jointCount
+// (CompactJointDefinition with COMPACT_JOINTS)
 static_assert(sizeof(SkeletonHeader) == 16, "Skeleton");
 
 enum class FrameFlags : uint32_t {
   NONE = 0,
   // enableed rotation is Quat32: disabled rotation is float4(x, y, z, w)
   USE_QUAT32 = 0x1,
+  // with USE_QUAT32. DeltaHeader and only the joints that moved away from
+  // a keyframe follow, instead of PackQuat x jointCount
+  DELTA = 0x2,
+  // CompactFrameHeader with a root position of 3 half floats
+  HALF_POSITION = 0x4,
+  // CompactFrameHeader with a root position of 3 FixedFromFloat with the
+  // SkeletonFlags::POSITION_SCALE of the skeleton
+  FIXED_POSITION = 0x8,
 };
+inline constexpr FrameFlags operator|(FrameFlags a, FrameFlags b) {
+  return static_cast<FrameFlags>(static_cast<uint32_t>(a) |
+                                 static_cast<uint32_t>(b));
+}
+inline constexpr bool HasFlag(FrameFlags flags, FrameFlags flag) {
+  return (static_cast<uint32_t>(flags) & static_cast<uint32_t>(flag)) != 0;
+}
 
 struct FrameHeader {
   char magic[8] = {'S', 'R', 'H', 'T', 'F', 'R', 'M', '1'};
@@ -293,4 +336,188 @@ struct FrameHeader {
 // continue PackQuat x SkeletonHeader::JointCount
 static_assert(sizeof(FrameHeader) == 40, "FrameSize");
 
+// magic, time, flags and skeletonId. the same in both frame headers
+static constexpr size_t FRAME_PREFIX_SIZE = 22;
+static_assert(offsetof(FrameHeader, skeletonId) + 2 == FRAME_PREFIX_SIZE,
+              "FramePrefix");
+
+// FrameHeader with a 16 bit root position, for HALF_POSITION or
+// FIXED_POSITION. COMPACT_FRAME_SIZE bytes on the wire, without the tail
+// padding of the struct. an own magic: a receiver that only knows
+// FrameHeader drops it instead of reading rotations at the wrong offset
+struct CompactFrameHeader {
+  char magic[8] = {'S', 'R', 'H', 'T', 'F', 'R', 'C', '1'};
+  int64_t time;
+  FrameFlags flags = {};
+  uint16_t skeletonId = 0;
+  uint16_t x;
+  uint16_t y;
+  uint16_t z;
+};
+static constexpr size_t COMPACT_FRAME_SIZE = 28;
+static_assert(offsetof(CompactFrameHeader, z) + 2 == COMPACT_FRAME_SIZE,
+              "CompactFrameSize");
+
+//
+// 16 bit positions. round to nearest, error bounds:
+//   half: |error| <= |x| * 2^-11 for |x| >= 2^-14, 2^-25 below. |x| up to
+//         65504
+//   fixed: |error| <= scale / 2 (and the rounding of the float product).
+//          |x| up to 32767 * scale
+//
+inline uint16_t HalfFromFloat(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  uint32_t sign = (x >> 16) & 0x8000;
+  uint32_t abs = x & 0x7fffffff;
+  if (abs > 0x7f800000) {
+    // nan
+    return static_cast<uint16_t>(sign | 0x7e00);
+  }
+  if (abs >= 0x477ff000) {
+    // rounds past 65504
+    return static_cast<uint16_t>(sign | 0x7c00);
+  }
+  if (abs < 0x38800000) {
+    // subnormal: a multiple of 2^-24. exact before the rounding
+    return static_cast<uint16_t>(
+        sign | static_cast<uint32_t>(std::nearbyint(std::fabs(f) * 16777216.0f)));
+  }
+  // rebias 127 => 15 and round 23 => 10 mantissa bits to nearest even
+  uint32_t h = abs - 0x38000000;
+  h = (h + 0xfff + ((h >> 13) & 1)) >> 13;
+  return static_cast<uint16_t>(sign | h);
+}
+inline float FloatFromHalf(uint16_t h) {
+  uint32_t sign = uint32_t(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  uint32_t x;
+  if (exponent == 0) {
+    float f = mantissa * (1.0f / 16777216.0f);
+    memcpy(&x, &f, sizeof(x));
+    x |= sign;
+  } else if (exponent == 31) {
+    x = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+// false if out of range
+inline bool FixedFromFloat(float f, float scale, int16_t &fixed) {
+  auto q = std::nearbyint(f / scale);
+  if (!(q >= -32767.0f && q <= 32767.0f)) {
+    return false;
+  }
+  fixed = static_cast<int16_t>(q);
+  return true;
+}
+inline float FloatFromFixed(int16_t fixed, float scale) {
+  return fixed * scale;
+}
+
+// FrameHeader or CompactFrameHeader magic
+inline bool IsFramePacket(const uint8_t *p, size_t size) {
+  return size >= FRAME_PREFIX_SIZE &&
+         (memcmp(p, FrameHeader{}.magic, 8) == 0 ||
+          memcmp(p, CompactFrameHeader{}.magic, 8) == 0);
+}
+
+// header bytes of a frame packet by its flags
+inline constexpr size_t FrameHeaderSize(FrameFlags flags) {
+  return HasFlag(flags, FrameFlags::HALF_POSITION) ||
+                 HasFlag(flags, FrameFlags::FIXED_POSITION)
+             ? COMPACT_FRAME_SIZE
+             : sizeof(FrameHeader);
+}
+
+// the header of a frame packet with a float root position, whatever its
+// encoding. positionScale: of the skeleton, for FIXED_POSITION. returns
+// the header bytes, 0 if malformed
+inline size_t ReadFrameHeader(const uint8_t *p, size_t size,
+                              float positionScale, FrameHeader &header) {
+  if (size < FRAME_PREFIX_SIZE) {
+    return 0;
+  }
+  memcpy(static_cast<void *>(&header), p, FRAME_PREFIX_SIZE);
+  auto half = HasFlag(header.flags, FrameFlags::HALF_POSITION);
+  auto fixed = HasFlag(header.flags, FrameFlags::FIXED_POSITION);
+  auto headerSize = FrameHeaderSize(header.flags);
+  // the magic and the flags tell the same header
+  auto compactMagic = memcmp(p, CompactFrameHeader{}.magic, 8) == 0;
+  if (size < headerSize || (half && fixed) || compactMagic != (half || fixed) ||
+      (fixed && !(positionScale > 0))) {
+    return 0;
+  }
+  if (!half && !fixed) {
+    memcpy(&header, p, sizeof(header));
+    return headerSize;
+  }
+  CompactFrameHeader compact;
+  memcpy(static_cast<void *>(&compact), p, COMPACT_FRAME_SIZE);
+  if (half) {
+    header.x = FloatFromHalf(compact.x);
+    header.y = FloatFromHalf(compact.y);
+    header.z = FloatFromHalf(compact.z);
+  } else {
+    header.x = FloatFromFixed(static_cast<int16_t>(compact.x), positionScale);
+    header.y = FloatFromFixed(static_cast<int16_t>(compact.y), positionScale);
+    header.z = FloatFromFixed(static_cast<int16_t>(compact.z), positionScale);
+  }
+  return headerSize;
+}
+
+//
+// FrameFlags::DELTA
+//
+// continue a 2 bit code per joint ((jointCount + 3) / 4 bytes, joint 0 in
+// the lowest bits of the first byte), then the data of each joint by code:
+//   0: none. the keyframe rotation
+//   1: small. uint16_t of three 5 bit signed deltas dx0 | dx1 << 5 | dx2 << 10
+//   2: zigzag(dx0), zigzag(dx1), zigzag(dx2) as little endian base 128
+//      varints
+//   3: PackQuat
+// dxN: the 10 bit component minus the keyframe one, with the same drop.
+//
+struct DeltaHeader {
+  // FrameHeader::time of the keyframe: a USE_QUAT32 frame without DELTA
+  int64_t keyframeTime;
+};
+static_assert(sizeof(DeltaHeader) == 8, "DeltaSize");
+
+//
+// several packets (SkeletonHeader or FrameHeader) of a tick in one
+// datagram
+//
+struct BundleHeader {
+  char magic[8] = {'S', 'R', 'H', 'T', 'B', 'N', 'D', '1'};
+  uint16_t count = 0;
+  uint16_t reserved0 = 0;
+  uint32_t reserved1 = 0;
+};
+// continue (uint16_t size, packet) x count
+static_assert(sizeof(BundleHeader) == 16, "BundleSize");
+
+//
+// a packet larger than the datagram budget, split into count datagrams
+//
+static constexpr uint16_t MAX_FRAGMENTS = 64;
+struct FragmentHeader {
+  char magic[8] = {'S', 'R', 'H', 'T', 'F', 'R', 'G', '1'};
+  // same for every fragment of a packet. a counter of the sender
+  uint32_t messageId = 0;
+  uint16_t index = 0;
+  // 1 .. MAX_FRAGMENTS
+  uint16_t count = 0;
+  // the whole packet
+  uint32_t totalSize = 0;
+  // of this fragment in the packet
+  uint32_t offset = 0;
+};
+// continue bytes [offset, offset + datagram size - 24) of the packet
+static_assert(sizeof(FragmentHeader) == 24, "FragmentSize");
+
 } // namespace srht
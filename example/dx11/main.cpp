@@ -31,7 +31,10 @@ main(int argc, char** argv)
   BvhPanel bvhPanel;
 
   // load bvh
-  if (argc > 1) {
+  if (argc > 2 && std::string_view(argv[1]) == "--follow") {
+    // live capture file
+    bvhPanel.Follow(argv[2]);
+  } else if (argc > 1) {
     if (auto bvh = Bvh::ParseFile(argv[1])) {
       bvhPanel.SetBvh(bvh);
     }
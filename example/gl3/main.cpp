@@ -2,9 +2,11 @@
 
 #include <GL/glew.h>
 
+#include "BvhCrowd.h"
 #include "BvhPanel.h"
 #include "GlfwPlatform.h"
 #include "GuiApp.h"
+#include <cmath>
 #include <cuber/gl3/GlCubeRenderer.h>
 #include <cuber/gl3/GlLineRenderer.h>
 #include <grapho/gl3/texture.h>
@@ -95,7 +97,30 @@ main(int argc, char** argv)
   BvhPanel bvhPanel;
 
   // load bvh
-  if (argc > 1) {
+  std::unique_ptr<BvhCrowd> crowd;
+  if (argc > 2 && std::string_view(argv[1]) == "--follow") {
+    // live capture file
+    bvhPanel.Follow(argv[2]);
+  } else if (argc > 3 && std::string_view(argv[1]) == "--crowd") {
+    // --crowd N file.bvh: N copies on a grid with their own time offset
+    if (auto bvh = Bvh::ParseFile(argv[3])) {
+      bvh->BuildTracks();
+      crowd = std::make_unique<BvhCrowd>();
+      auto clip = crowd->AddClip(bvh);
+      auto count = std::max(1, atoi(argv[2]));
+      auto side = static_cast<int>(std::ceil(std::sqrt(count)));
+      auto duration = bvh->frame_time * bvh->FrameCount();
+      for (int i = 0; i < count; ++i) {
+        BvhCrowdCharacter character{
+          .clip = clip,
+          .offset = duration * i / count,
+        };
+        character.root.m[3][0] = float(i % side - side / 2);
+        character.root.m[3][2] = float(-(i / side));
+        crowd->AddCharacter(character);
+      }
+    }
+  } else if (argc > 1) {
     if (auto bvh = Bvh::ParseFile(argv[1])) {
       bvhPanel.SetBvh(bvh);
     }
@@ -153,7 +178,20 @@ main(int argc, char** argv)
     }
 
     // scene
-    {
+    if (crowd) {
+      // every character in one draw
+      auto cubes = crowd->Update(*time);
+      texture->Activate(TextureBind);
+      cubeRenderer.Render(&app.Camera.ProjectionMatrix._11,
+                          &app.Camera.ViewMatrix._11,
+                          cubes.data(),
+                          static_cast<uint32_t>(cubes.size()));
+      lineRenderer.Render(
+        &app.Camera.ProjectionMatrix._11, &app.Camera.ViewMatrix._11, lines);
+
+      auto data = app.RenderGui();
+      platform.EndFrame(data);
+    } else {
       auto cubes = bvhPanel.GetCubes();
       instances.resize(1 + cubes.size());
       std::copy(cubes.begin(), cubes.end(), instances.data() + 1);
@@ -0,0 +1,138 @@
+//
+// replay a .srhtlog recorded by UdpSender::SetRecorder.
+//
+// usage: srht_replay file.srhtlog [--speed N | --fast] [--seek seconds]
+//                    [--send host:port | --no-decode]
+//
+// --speed N: N times the recorded pace (default 1). --fast: no pacing.
+// --seek: start at that time of the log, through its index. the skeleton
+// packets sent before it go first.
+// --send: send the datagrams over UDP. without it they are pushed into a
+// local SrhtReceiver, whose clock follows the recorded times at any speed,
+// and every frame is decoded.
+// --no-decode: Push only, the intake of the receiver. the jitter buffer
+// overflows.
+//
+#include <DirectXMath.h>
+
+#include "SrhtLog.h"
+#include "SrhtReceiver.h"
+#include <iostream>
+#include <string>
+
+static void
+Usage()
+{
+  std::cerr << "usage: srht_replay file.srhtlog [--speed N | --fast] "
+               "[--seek seconds] [--send host:port | --no-decode]"
+            << std::endl;
+}
+
+int
+main(int argc, char** argv)
+{
+  std::string path;
+  double speed = 1;
+  double seek = 0;
+  std::string send;
+  bool decode = true;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--fast") {
+      speed = 0;
+    } else if (arg == "--speed" && i + 1 < argc) {
+      speed = std::stod(argv[++i]);
+    } else if (arg == "--seek" && i + 1 < argc) {
+      seek = std::stod(argv[++i]);
+    } else if (arg == "--no-decode") {
+      decode = false;
+    } else if (arg == "--send" && i + 1 < argc) {
+      send = argv[++i];
+    } else if (path.empty() && !arg.starts_with("--")) {
+      path = arg;
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (path.empty() || speed < 0 || (!send.empty() && !decode)) {
+    Usage();
+    return 1;
+  }
+
+  SrhtLogReader log;
+  if (!log.Open(path)) {
+    std::cerr << "not a .srhtlog: " << path << std::endl;
+    return 1;
+  }
+  std::cout << path << ": " << log.Count() << " datagrams, "
+            << std::chrono::duration<double>(log.Duration()).count() << "s"
+            << (log.Indexed() ? "" : " (not closed, scanned)") << std::endl;
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::duration<double>(seek));
+  log.Seek(time);
+  auto skeletons = log.Skeletons(time);
+
+  using Clock = SrhtReceiver::Clock;
+  auto start = Clock::now();
+  uint64_t played = 0;
+  uint64_t frames = 0;
+  asio::io_context io;
+  if (!send.empty()) {
+    auto colon = send.rfind(':');
+    asio::error_code ec;
+    auto address = asio::ip::make_address(send.substr(0, colon), ec);
+    if (colon == std::string::npos || ec) {
+      Usage();
+      return 1;
+    }
+    asio::ip::udp::endpoint ep(
+      address, static_cast<uint16_t>(std::stoi(send.substr(colon + 1))));
+    asio::ip::udp::socket socket(io, ep.protocol());
+    auto sendTo = [&socket, &ep](const SrhtLogEntry& entry) {
+      asio::error_code ec;
+      socket.send_to(asio::buffer(entry.bytes.data(), entry.bytes.size()),
+                     ep,
+                     0,
+                     ec);
+      return true;
+    };
+    for (auto& entry : skeletons) {
+      sendTo(entry);
+    }
+    played = log.Replay(speed, sendTo);
+  } else {
+    SrhtReceiver receiver;
+    for (auto& entry : skeletons) {
+      receiver.Push(entry.bytes, start);
+    }
+    played = log.Replay(speed, [&](const SrhtLogEntry& entry) {
+      auto now = start + std::chrono::duration_cast<Clock::duration>(
+                           entry.time);
+      receiver.Push(entry.bytes, now);
+      while (decode && receiver.Pop(now)) {
+        ++frames;
+      }
+      return true;
+    });
+    // the frames still in the jitter buffer
+    while (decode && receiver.Pop(Clock::time_point::max())) {
+      ++frames;
+    }
+    auto& stats = receiver.Stats();
+    std::cout << "skeletons: " << stats.skeletons
+              << ", malformed: " << stats.malformed
+              << ", late: " << stats.late << ", overflow: " << stats.overflow
+              << ", missingKeyframe: " << stats.missingKeyframe << std::endl;
+  }
+
+  auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << played << " datagrams in " << seconds << "s, "
+            << played / seconds << " datagrams/sec";
+  if (send.empty()) {
+    std::cout << ", " << frames << " frames decoded, " << frames / seconds
+              << " frames/sec";
+  }
+  std::cout << std::endl;
+  return 0;
+}
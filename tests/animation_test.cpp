@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+
+#include "../example/bvhutil/Animation.h"
+#include "../example/bvhutil/AnimationClock.h"
+#include "../example/bvhutil/Bvh.h"
+#include "../example/bvhutil/BvhCache.h"
+#include "../example/bvhutil/BvhLazyFrames.h"
+#include <asio.hpp>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+
+// Xposition is the frame index
+static std::string
+ClipSource(int frames = 1000, const char* frameTime = "0.005")
+{
+  std::string src = "HIERARCHY\n"
+                    "ROOT Hips\n"
+                    "{\n"
+                    "OFFSET 0 0 0\n"
+                    "CHANNELS 6 Xposition Yposition Zposition "
+                    "Zrotation Xrotation Yrotation\n"
+                    "End Site\n"
+                    "{\n"
+                    "OFFSET 0 1 0\n"
+                    "}\n"
+                    "}\n"
+                    "MOTION\n"
+                    "Frames: " +
+                    std::to_string(frames) +
+                    "\n"
+                    "Frame Time: " +
+                    frameTime + "\n";
+  for (int i = 0; i < frames; ++i) {
+    src += std::to_string(i) + " 0 0 0 0 0 \n";
+  }
+  return src;
+}
+
+static std::shared_ptr<Bvh>
+MakeClip(int frames = 1000, const char* frameTime = "0.005")
+{
+  auto bvh = std::make_shared<Bvh>();
+  if (!bvh->Parse(ClipSource(frames, frameTime))) {
+    return {};
+  }
+  return bvh;
+}
+
+TEST(Animation, deadlines)
+{
+  auto bvh = MakeClip();
+  ASSERT_TRUE(bvh);
+
+  asio::io_context io;
+  Animation animation(io);
+  std::vector<float> times;
+  animation.OnFrame([&times](const BvhFrame& frame) {
+    times.push_back(frame.time.count());
+    if (times.size() == 10) {
+      // stall for 6 ticks
+      std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    }
+  });
+  animation.SetBvh(bvh);
+  io.run_for(std::chrono::milliseconds(200));
+  animation.Stop();
+
+  auto stats = animation.GetStats();
+  ASSERT_EQ(stats.ticks, times.size());
+  ASSERT_GT(times.size(), 10);
+  // the first tick plays frame 0
+  EXPECT_EQ(times[0], 0);
+  // ticks play the clip on the 5ms grid, never at the wakeup time
+  for (auto t : times) {
+    EXPECT_NEAR(std::remainder(t, 0.005f), 0, 1e-4f) << t;
+  }
+  // the stall is caught up (4 back to back) or dropped, not drifted
+  EXPECT_GE(stats.caughtUp + stats.missed, 4);
+  for (size_t i = 1; i < times.size(); ++i) {
+    EXPECT_GT(times[i], times[i - 1]);
+  }
+  // 200ms / 5ms
+  EXPECT_LE(stats.ticks + stats.missed, 41);
+  uint64_t late = 0;
+  for (auto count : stats.late) {
+    late += count;
+  }
+  EXPECT_EQ(late, stats.ticks);
+  EXPECT_GE(stats.callbackMax, std::chrono::milliseconds(30));
+}
+
+TEST(Animation, every_frame)
+{
+  // ~3000fps: no whole number of ns, nor of float seconds
+  auto bvh = MakeClip(997, "0.00033333");
+  ASSERT_TRUE(bvh);
+
+  asio::io_context io;
+  Animation animation(io);
+  std::vector<int> indices;
+  std::vector<uint64_t> missed;
+  animation.OnFrame([&](const BvhFrame& frame) {
+    indices.push_back(frame.index);
+    missed.push_back(animation.GetStats().missed);
+    EXPECT_EQ(frame.values[0], frame.index);
+  });
+  animation.SetBvh(bvh);
+  io.run_for(std::chrono::seconds(2));
+  animation.Stop();
+
+  ASSERT_GT(indices.size(), 2000);
+  // the first tick is frame 0, unless the start took longer than the
+  // catch up
+  EXPECT_EQ(indices[0], missed[0]);
+  // then each frame once, in order, past the loop. dropped deadlines skip
+  // their frames
+  for (size_t i = 1; i < indices.size(); ++i) {
+    auto expected = (indices[i - 1] + 1 + (missed[i] - missed[i - 1])) % 997;
+    ASSERT_EQ(indices[i], expected) << i;
+  }
+}
+
+TEST(Animation, lazy)
+{
+  auto path =
+    (std::filesystem::temp_directory_path() / "animation_lazy_test.bvh")
+      .string();
+  {
+    std::ofstream os(path, std::ios::binary);
+    os << ClipSource();
+  }
+  // any size is large enough
+  auto bvh = Bvh::ParseFile(path, 0, 0);
+  ASSERT_TRUE(bvh);
+  ASSERT_TRUE(bvh->lazy_frames);
+  EXPECT_FALSE(std::filesystem::exists(BvhCachePath(path)));
+
+  asio::io_context io;
+  Animation animation(io);
+  // with an output rate too: no tracks, the frame at each tick
+  animation.SetOutputRate(400);
+  size_t count = 0;
+  animation.OnFrame([&count](const BvhFrame& frame) {
+    ++count;
+    ASSERT_EQ(frame.values.size(), 6);
+    EXPECT_EQ(frame.values[0], frame.index);
+  });
+  animation.SetBvh(bvh);
+  io.run_for(std::chrono::milliseconds(100));
+  animation.Stop();
+  EXPECT_GT(count, 10);
+  // the next ticks were decoded ahead. the cache stays bounded
+  EXPECT_GE(bvh->lazy_frames->CachedCount(), 33);
+  EXPECT_LE(bvh->lazy_frames->CachedCount(), 256);
+
+  bvh.reset();
+  std::filesystem::remove(path);
+}
+
+TEST(AnimationClock, cascade)
+{
+  asio::io_context io;
+  // levels of 6.4us, 409us, 26ms, 1.6s
+  AnimationClock clock(io, std::chrono::nanoseconds(100));
+  using Clock = AnimationClock::Clock;
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> dist(0, 100000);
+  auto start = Clock::now();
+  const size_t N = 300;
+  std::vector<Clock::time_point> deadlines(N);
+  std::vector<Clock::time_point> fired(N);
+  for (size_t i = 0; i < N; ++i) {
+    deadlines[i] = start + std::chrono::microseconds(dist(rng));
+    auto id = clock.Add([&fired, i]() { fired[i] = Clock::now(); });
+    EXPECT_EQ(id, i);
+    clock.Schedule(id, deadlines[i]);
+  }
+  // canceled and removed entries do not fire
+  auto canceled = clock.Add([]() { FAIL(); });
+  clock.Schedule(canceled, start + std::chrono::milliseconds(1));
+  clock.Cancel(canceled);
+  auto removed = clock.Add([]() { FAIL(); });
+  clock.Schedule(removed, start + std::chrono::milliseconds(2));
+  clock.Remove(removed);
+  EXPECT_EQ(clock.Add([]() {}), removed);
+
+  io.run_for(std::chrono::seconds(2));
+  for (size_t i = 0; i < N; ++i) {
+    ASSERT_NE(fired[i], Clock::time_point{}) << i;
+    EXPECT_GE(fired[i], deadlines[i]) << i;
+    EXPECT_LT(fired[i] - deadlines[i], std::chrono::milliseconds(50)) << i;
+  }
+  EXPECT_EQ(clock.GetStats().dispatched, N);
+}
+
+TEST(AnimationClock, coalesce)
+{
+  asio::io_context io;
+  AnimationClock clock(io);
+  auto deadline = AnimationClock::Clock::now() + std::chrono::milliseconds(20);
+  int count = 0;
+  for (int i = 0; i < 50; ++i) {
+    // same slot
+    auto id = clock.Add([&count]() { ++count; });
+    clock.Schedule(id, deadline + std::chrono::microseconds(i * 10));
+  }
+  io.run_for(std::chrono::seconds(1));
+  EXPECT_EQ(count, 50);
+  auto stats = clock.GetStats();
+  EXPECT_EQ(stats.batchMax, 50);
+  // plus at most one level 0 wrap
+  EXPECT_LE(stats.wakeups, 2);
+}
+
+TEST(AnimationClock, destroyed)
+{
+  asio::io_context io;
+  auto start = AnimationClock::Clock::now();
+  {
+    AnimationClock clock(io);
+    auto id = clock.Add([]() { FAIL(); });
+    clock.Schedule(id, start + std::chrono::milliseconds(50));
+    // the timer waits
+    io.poll();
+    // an earlier deadline posts a rearm
+    clock.Schedule(id, start + std::chrono::milliseconds(1));
+  }
+  // the posted rearm and the aborted wait run after the clock is gone
+  io.run_for(std::chrono::milliseconds(100));
+}
+
+TEST(Animation, destroyed)
+{
+  auto bvh = MakeClip();
+  ASSERT_TRUE(bvh);
+  asio::io_context io;
+  auto clock = std::make_shared<AnimationClock>(io);
+  {
+    Animation animation(io, clock);
+    animation.SetBvh(bvh);
+    // posted, run after the animation is gone
+    animation.SetOutputRate(100);
+    animation.PushFrame(bvh->GetFrame(0));
+  }
+  // the clock still holds a copy of the removed func
+  io.run_for(std::chrono::milliseconds(50));
+}
+
+TEST(Animation, shared_clock)
+{
+  auto bvh = MakeClip();
+  ASSERT_TRUE(bvh);
+
+  asio::io_context io;
+  auto clock = std::make_shared<AnimationClock>(io);
+  std::vector<std::unique_ptr<Animation>> animations;
+  std::vector<std::vector<float>> times(3);
+  for (size_t i = 0; i < times.size(); ++i) {
+    auto animation = std::make_unique<Animation>(io, clock);
+    animation->OnFrame([&times, i](const BvhFrame& frame) {
+      times[i].push_back(frame.time.count());
+    });
+    animations.push_back(std::move(animation));
+  }
+  for (auto& animation : animations) {
+    animation->SetBvh(bvh);
+  }
+  io.run_for(std::chrono::milliseconds(100));
+  for (auto& animation : animations) {
+    animation->Stop();
+  }
+
+  for (auto& list : times) {
+    ASSERT_GT(list.size(), 5);
+    for (auto t : list) {
+      EXPECT_NEAR(std::remainder(t, 0.005f), 0, 1e-4f) << t;
+    }
+  }
+  // one wakeup serves all three
+  auto stats = clock->GetStats();
+  EXPECT_EQ(stats.batchMax, 3);
+  EXPECT_GT(stats.dispatched, stats.wakeups * 2);
+}
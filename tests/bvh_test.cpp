@@ -0,0 +1,768 @@
+#include <gtest/gtest.h>
+
+#include "../example/bvhutil/Bvh.h"
+#include "../example/bvhutil/BvhCache.h"
+#include "../example/bvhutil/BvhFlatSolver.h"
+#include "../example/bvhutil/BvhLazyFrames.h"
+#include "../example/bvhutil/BvhMotion.h"
+#include "../example/bvhutil/BvhSolver.h"
+#include "../example/bvhutil/BvhStream.h"
+#include "../example/bvhutil/BvhTracks.h"
+#include "../example/bvhutil/BvhTokenizer.h"
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+static const char BVH_SRC[] = "HIERARCHY\n"
+                              "ROOT Hips\n"
+                              "{\n"
+                              "\tOFFSET 0.0 90.0 0.0\n"
+                              "\tCHANNELS 6 Xposition Yposition Zposition "
+                              "Zrotation Xrotation Yrotation\n"
+                              "\tJOINT Spine\n"
+                              "\t{\n"
+                              "\t\tOFFSET 0.0 10.0 0.0\n"
+                              "\t\tCHANNELS 3 Zrotation Xrotation Yrotation\n"
+                              "\t\tEnd Site\n"
+                              "\t\t{\n"
+                              "\t\t\tOFFSET 0.0 5.0 0.0\n"
+                              "\t\t}\n"
+                              "\t}\n"
+                              "}\n"
+                              "MOTION\n"
+                              "Frames: 2\n"
+                              "Frame Time: 0.5\n"
+                              "1 2 3 4 5 6 7 8 9 \n"
+                              "-1.5 -2.5 -3.5 -4.5 -5.5 -6.5 -7.5 -8.5 -9.5 \n";
+
+TEST(Bvh, parse)
+{
+  Bvh bvh;
+  ASSERT_TRUE(bvh.Parse(BVH_SRC));
+
+  ASSERT_EQ(bvh.joints.size(), 2);
+  EXPECT_EQ(bvh.joints[0].name, "Hips");
+  EXPECT_EQ(bvh.joints[0].parent, (uint16_t)-1);
+  EXPECT_EQ(bvh.joints[0].channels.size(), 6);
+  EXPECT_EQ(bvh.joints[1].name, "Spine");
+  EXPECT_EQ(bvh.joints[1].parent, 0);
+  EXPECT_EQ(bvh.joints[1].channels.startIndex, 6);
+  EXPECT_EQ(bvh.joints[1].worldOffset.y, 100.0f);
+
+  ASSERT_EQ(bvh.endsites.size(), 1);
+  EXPECT_EQ(bvh.endsites[0].parent, 1);
+  EXPECT_EQ(bvh.endsites[0].localOffset.y, 5.0f);
+
+  EXPECT_EQ(bvh.frame_time.count(), 0.5f);
+  EXPECT_EQ(bvh.frame_channel_count, 9);
+  ASSERT_EQ(bvh.FrameCount(), 2);
+  EXPECT_EQ(bvh.frames[0], 1.0f);
+  EXPECT_EQ(bvh.frames[8], 9.0f);
+  EXPECT_EQ(bvh.frames[9], -1.5f);
+  EXPECT_EQ(bvh.frames[17], -9.5f);
+}
+
+TEST(Bvh, scan)
+{
+  // every byte value at every offset of a buffer longer than a simd block
+  for (int c = 0; c < 256; ++c) {
+    for (size_t pos = 0; pos < 70; ++pos) {
+      std::string src(70, 'a');
+      src[pos] = (char)c;
+      auto begin = src.data();
+      auto end = src.data() + src.size();
+      auto expected = std::isspace(c) ? begin + pos : end;
+      ASSERT_EQ(bvh_scan::find_space(begin, end), expected) << c << ":" << pos;
+
+      std::string spaces(70, ' ');
+      spaces[pos] = (char)c;
+      auto sbegin = spaces.data();
+      auto send = spaces.data() + spaces.size();
+      auto sexpected = std::isspace(c) ? send : sbegin + pos;
+      ASSERT_EQ(bvh_scan::skip_space(sbegin, send), sexpected)
+        << c << ":" << pos;
+    }
+  }
+}
+
+static std::string
+MakeMotion(int frames, int channels)
+{
+  std::string src;
+  char buf[32];
+  for (int i = 0; i < frames; ++i) {
+    for (int j = 0; j < channels; ++j) {
+      snprintf(buf, sizeof(buf), j ? " %.4f" : "%.4f", i * 0.5f - j * 0.25f);
+      src += buf;
+    }
+    src += "\n";
+  }
+  return src;
+}
+
+TEST(BvhMotion, line)
+{
+  float values[3];
+  std::string_view ok = "1 2.5\t-3 \r";
+  EXPECT_TRUE(ParseFrameLine(ok.data(), ok.data() + ok.size(), values, 3));
+  EXPECT_EQ(values[2], -3.0f);
+
+  std::string_view few = "1 2.5";
+  EXPECT_FALSE(ParseFrameLine(few.data(), few.data() + few.size(), values, 3));
+  std::string_view many = "1 2 3 4";
+  EXPECT_FALSE(
+    ParseFrameLine(many.data(), many.data() + many.size(), values, 3));
+  std::string_view junk = "1 2x 3";
+  EXPECT_FALSE(
+    ParseFrameLine(junk.data(), junk.data() + junk.size(), values, 3));
+}
+
+TEST(BvhMotion, parallel)
+{
+  const int FRAMES = 20000;
+  const int CHANNELS = 60;
+  auto src = MakeMotion(FRAMES, CHANNELS);
+  ASSERT_GT(src.size(), 1024 * 1024);
+
+  std::vector<float> single(FRAMES * CHANNELS);
+  ASSERT_TRUE(ParseMotion(src, FRAMES, CHANNELS, single, 1));
+  for (auto threads : { 2, 3, 8, 16 }) {
+    std::vector<float> parallel(FRAMES * CHANNELS);
+    ASSERT_TRUE(ParseMotion(src, FRAMES, CHANNELS, parallel, threads));
+    EXPECT_EQ(single, parallel) << threads;
+  }
+
+  // missing lines
+  std::vector<float> out((FRAMES + 1) * CHANNELS);
+  EXPECT_FALSE(ParseMotion(src, FRAMES + 1, CHANNELS, out, 1));
+  EXPECT_FALSE(ParseMotion(src, FRAMES + 1, CHANNELS, out, 8));
+
+  // broken line in the middle
+  auto broken = src;
+  broken[broken.size() / 2] = 'x';
+  EXPECT_FALSE(ParseMotion(broken, FRAMES, CHANNELS, single, 8));
+}
+
+TEST(BvhCache, roundtrip)
+{
+  auto dir = std::filesystem::temp_directory_path();
+  auto path = (dir / "bvh_cache_test.bvh").string();
+  auto cache = BvhCachePath(path);
+  std::filesystem::remove(cache);
+  {
+    std::ofstream os(path, std::ios::binary);
+    os << BVH_SRC;
+  }
+
+  auto parsed = Bvh::ParseFile(path);
+  ASSERT_TRUE(parsed);
+  EXPECT_FALSE(parsed->frame_mapping);
+  ASSERT_TRUE(std::filesystem::exists(cache));
+
+  auto cached = Bvh::ParseFile(path);
+  ASSERT_TRUE(cached);
+  ASSERT_TRUE(cached->frame_mapping);
+  ASSERT_EQ(cached->joints.size(), parsed->joints.size());
+  for (size_t i = 0; i < parsed->joints.size(); ++i) {
+    EXPECT_EQ(cached->joints[i].name, parsed->joints[i].name);
+    EXPECT_EQ(cached->joints[i].parent, parsed->joints[i].parent);
+    EXPECT_EQ(cached->joints[i].channels.size(),
+              parsed->joints[i].channels.size());
+    EXPECT_EQ(cached->joints[i].channels.startIndex,
+              parsed->joints[i].channels.startIndex);
+    EXPECT_EQ(cached->joints[i].worldOffset.y,
+              parsed->joints[i].worldOffset.y);
+  }
+  ASSERT_EQ(cached->endsites.size(), parsed->endsites.size());
+  EXPECT_EQ(cached->frame_time, parsed->frame_time);
+  EXPECT_EQ(cached->frame_channel_count, parsed->frame_channel_count);
+  EXPECT_TRUE(std::equal(cached->frames.begin(),
+                         cached->frames.end(),
+                         parsed->frames.begin(),
+                         parsed->frames.end()));
+  EXPECT_EQ((uintptr_t)cached->frames.data() % 64, 0);
+
+  // source changed. parse again
+  {
+    std::ofstream os(path, std::ios::binary | std::ios::app);
+    os << "\n";
+  }
+  auto reparsed = Bvh::ParseFile(path);
+  ASSERT_TRUE(reparsed);
+  EXPECT_FALSE(reparsed->frame_mapping);
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(cache);
+}
+
+TEST(BvhCache, corrupt)
+{
+  auto dir = std::filesystem::temp_directory_path();
+  auto path = (dir / "bvh_cache_corrupt.bvhc").string();
+  Bvh bvh;
+  ASSERT_TRUE(bvh.Parse(BVH_SRC));
+  ASSERT_TRUE(WriteBvhCache(bvh, path, {}));
+  std::vector<char> bytes;
+  {
+    std::ifstream is(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(is), {});
+  }
+  ASSERT_TRUE(LoadBvhCache(path, nullptr));
+
+  auto load = [&](auto modify) {
+    auto copy = bytes;
+    BvhCacheHeader header;
+    memcpy(&header, copy.data(), sizeof(header));
+    std::vector<BvhCacheJoint> joints(header.joint_count +
+                                      header.endsite_count);
+    memcpy(joints.data(),
+           copy.data() + sizeof(header),
+           joints.size() * sizeof(BvhCacheJoint));
+    modify(header, joints);
+    memcpy(copy.data(), &header, sizeof(header));
+    memcpy(copy.data() + sizeof(header),
+           joints.data(),
+           joints.size() * sizeof(BvhCacheJoint));
+    {
+      std::ofstream os(path, std::ios::binary | std::ios::trunc);
+      os.write(copy.data(), copy.size());
+    }
+    return LoadBvhCache(path, nullptr);
+  };
+  using Joints = std::vector<BvhCacheJoint>;
+  EXPECT_TRUE(load([](BvhCacheHeader&, Joints&) {}));
+  EXPECT_FALSE(load([](BvhCacheHeader& h, Joints&) { h.joint_count = 0; }));
+  EXPECT_FALSE(load([](BvhCacheHeader& h, Joints&) {
+    h.joint_count = 0xffffffff;
+    h.endsite_count = 2;
+  }));
+  EXPECT_FALSE(load([](BvhCacheHeader& h, Joints&) {
+    h.frames_offset = 0xffffffffffffffc0;
+  }));
+  EXPECT_FALSE(
+    load([](BvhCacheHeader& h, Joints&) { h.names_size = 0xffffffffffff; }));
+  EXPECT_FALSE(load([](BvhCacheHeader&, Joints& j) { j[0].parent = 0; }));
+  EXPECT_FALSE(load([](BvhCacheHeader&, Joints& j) { j[1].parent = 1; }));
+  EXPECT_FALSE(load([](BvhCacheHeader&, Joints& j) { j[2].parent = 2; }));
+  EXPECT_FALSE(load([](BvhCacheHeader&, Joints& j) { j[1].start_index = 7; }));
+  EXPECT_FALSE(load([](BvhCacheHeader&, Joints& j) { j[1].types[0] = 7; }));
+
+  std::filesystem::remove(path);
+}
+
+TEST(BvhLazyFrames, matches_eager)
+{
+  auto path =
+    (std::filesystem::temp_directory_path() / "bvh_lazy_test.bvh").string();
+  std::string src = BVH_SRC;
+  // 2 frames in the header. append more
+  src.replace(src.find("Frames: 2"), 9, "Frames: 1000");
+  for (int i = 2; i < 1000; ++i) {
+    for (int j = 0; j < 9; ++j) {
+      src += std::to_string(i * 10 + j) + " ";
+    }
+    src += "\n";
+  }
+  {
+    std::ofstream os(path, std::ios::binary);
+    os << src;
+  }
+
+  Bvh eager;
+  ASSERT_TRUE(eager.Parse(src));
+  auto lazy = Bvh::ParseFileLazy(path, 16, 4);
+  ASSERT_TRUE(lazy);
+  ASSERT_TRUE(lazy->lazy_frames);
+  EXPECT_TRUE(lazy->frames.empty());
+  // tracks need decoded frames
+  EXPECT_FALSE(lazy->BuildTracks());
+  ASSERT_EQ(lazy->FrameCount(), eager.FrameCount());
+
+  // sequential, random and wrapped access
+  std::vector<int> order;
+  for (int i = 0; i < 1000; ++i) {
+    order.push_back(i);
+  }
+  for (int i = 0; i < 1000; ++i) {
+    order.push_back((i * 7919) % 1000);
+  }
+  for (auto i : order) {
+    auto expected = eager.GetFrame(i);
+    auto frame = lazy->GetFrame(i);
+    ASSERT_EQ(frame.values.size(), expected.values.size());
+    EXPECT_TRUE(std::equal(frame.values.begin(),
+                           frame.values.end(),
+                           expected.values.begin()))
+      << i;
+    EXPECT_LE(lazy->lazy_frames->CachedCount(), 16);
+  }
+
+  // a held frame survives eviction
+  auto held = lazy->GetFrame(1);
+  for (int i = 500; i < 600; ++i) {
+    lazy->GetFrame(i);
+  }
+  EXPECT_EQ(held.values[0], eager.GetFrame(1).values[0]);
+
+  // ReadAhead decodes the frame and the next readahead ones
+  lazy = Bvh::ParseFileLazy(path, 16, 4);
+  ASSERT_TRUE(lazy);
+  lazy->ReadAhead(10);
+  EXPECT_EQ(lazy->lazy_frames->CachedCount(), 5);
+  lazy->ReadAhead(11);
+  EXPECT_EQ(lazy->lazy_frames->CachedCount(), 6);
+  lazy->ReadAhead(998);
+  EXPECT_EQ(lazy->lazy_frames->CachedCount(), 8);
+  lazy->GetFrame(12);
+  EXPECT_EQ(lazy->lazy_frames->CachedCount(), 8);
+
+  // ParseFile loads a large source lazily and does not cache it
+  auto cache = BvhCachePath(path);
+  std::filesystem::remove(cache);
+  auto large = Bvh::ParseFile(path, 0, 1024);
+  ASSERT_TRUE(large);
+  EXPECT_TRUE(large->lazy_frames);
+  EXPECT_FALSE(std::filesystem::exists(cache));
+  auto small = Bvh::ParseFile(path, 0, UINT64_MAX);
+  ASSERT_TRUE(small);
+  EXPECT_FALSE(small->lazy_frames);
+  EXPECT_EQ(small->FrameCount(), 1000);
+
+  lazy.reset();
+  large.reset();
+  std::filesystem::remove(path);
+  std::filesystem::remove(cache);
+}
+
+TEST(BvhStream, chunks)
+{
+  Bvh eager;
+  ASSERT_TRUE(eager.Parse(BVH_SRC));
+
+  // every chunk size splits lines and tokens at a different place
+  std::string_view src = BVH_SRC;
+  for (size_t chunk = 1; chunk < src.size(); chunk += 7) {
+    BvhStreamParser parser;
+    std::shared_ptr<Bvh> hierarchy;
+    std::vector<float> values;
+    parser.OnHierarchy(
+      [&hierarchy](const std::shared_ptr<Bvh>& bvh) { hierarchy = bvh; });
+    parser.OnFrame([&values, &hierarchy](const BvhFrame& frame) {
+      ASSERT_TRUE(hierarchy);
+      EXPECT_EQ(frame.index, values.size() / 9);
+      values.insert(values.end(), frame.values.begin(), frame.values.end());
+    });
+    for (size_t pos = 0; pos < src.size(); pos += chunk) {
+      ASSERT_TRUE(parser.Feed(src.substr(pos, chunk))) << chunk;
+    }
+    ASSERT_TRUE(hierarchy);
+    EXPECT_EQ(hierarchy->joints.size(), eager.joints.size());
+    EXPECT_EQ(parser.FrameCount(), 2);
+    EXPECT_TRUE(std::equal(
+      values.begin(), values.end(), eager.frames.begin(), eager.frames.end()));
+  }
+
+  // malformed line stops the stream
+  BvhStreamParser parser;
+  EXPECT_TRUE(parser.Feed(BVH_SRC));
+  EXPECT_FALSE(parser.Feed("1 2 3\n"));
+  EXPECT_FALSE(parser.Feed("1 2 3 4 5 6 7 8 9\n"));
+}
+
+TEST(BvhStream, follow)
+{
+  auto path =
+    (std::filesystem::temp_directory_path() / "bvh_follow_test.bvh").string();
+  std::ofstream os(path, std::ios::binary);
+  std::string_view src = BVH_SRC;
+  auto motion = src.find("1 2 3");
+  os << src.substr(0, motion);
+  os.flush();
+
+  std::atomic<int> frames = 0;
+  BvhFileFollower follower;
+  follower.Parser().OnFrame([&frames](const BvhFrame&) { ++frames; });
+  ASSERT_TRUE(follower.Start(path));
+
+  // the writer appends while the follower runs
+  os << src.substr(motion);
+  os.flush();
+  for (int i = 0; i < 200 && frames < 2; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(frames, 2);
+  os << "0 0 0 0 0 0 0 0 0\n";
+  os.flush();
+  for (int i = 0; i < 200 && frames < 3; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(frames, 3);
+
+  follower.Stop();
+  std::filesystem::remove(path);
+}
+
+TEST(BvhFlatSolver, matches_tree)
+{
+  // branches at the hips. the middle child (smallest |x|) is the tail
+  static const char src[] = "HIERARCHY\n"
+                            "ROOT Hips\n"
+                            "{\n"
+                            "OFFSET 0 90 0\n"
+                            "CHANNELS 6 Xposition Yposition Zposition "
+                            "Zrotation Xrotation Yrotation\n"
+                            "JOINT LeftLeg\n"
+                            "{\n"
+                            "OFFSET 10 -5 0\n"
+                            "CHANNELS 3 Zrotation Xrotation Yrotation\n"
+                            "End Site\n"
+                            "{\n"
+                            "OFFSET 0 -40 0\n"
+                            "}\n"
+                            "}\n"
+                            "JOINT Spine\n"
+                            "{\n"
+                            "OFFSET 0 10 0\n"
+                            "CHANNELS 3 Xrotation Yrotation Zrotation\n"
+                            "JOINT Head\n"
+                            "{\n"
+                            "OFFSET 0 30 2\n"
+                            "CHANNELS 3 Yrotation Xrotation Zrotation\n"
+                            "End Site\n"
+                            "{\n"
+                            "OFFSET 0 10 0\n"
+                            "}\n"
+                            "}\n"
+                            "}\n"
+                            "JOINT RightLeg\n"
+                            "{\n"
+                            "OFFSET -10 -5 0\n"
+                            "CHANNELS 3 Zrotation Xrotation Yrotation\n"
+                            "End Site\n"
+                            "{\n"
+                            "OFFSET 0 -40 0\n"
+                            "}\n"
+                            "}\n"
+                            "}\n"
+                            "MOTION\n"
+                            "Frames: 2\n"
+                            "Frame Time: 0.5\n"
+                            "1 2 3 10 20 30 5 6 7 -8 9 10 45 -30 15 1 2 3 \n"
+                            "-1 0 2 -90 45 0 0 0 0 0 0 0 0 0 0 170 -80 5 \n";
+  auto bvh = std::make_shared<Bvh>();
+  ASSERT_TRUE(bvh->Parse(src));
+
+  BvhSolver tree;
+  tree.Initialize(bvh);
+  BvhFlatSolver flat;
+  flat.Initialize(bvh);
+  ASSERT_EQ(flat.JointCount(), bvh->joints.size());
+
+  for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+    auto frame = bvh->GetFrame(i);
+    std::vector<DirectX::XMFLOAT4X4> expected;
+    for (auto& m : tree.ResolveFrame(frame)) {
+      expected.push_back(m);
+    }
+    auto actual = flat.ResolveFrame(frame);
+    ASSERT_EQ(actual.size(), expected.size());
+    EXPECT_EQ(memcmp(actual.data(),
+                     expected.data(),
+                     expected.size() * sizeof(expected[0])),
+              0);
+  }
+}
+
+TEST(BvhFrame, kernels)
+{
+  auto ROT = { BvhChannelTypes::Xrotation,
+               BvhChannelTypes::Yrotation,
+               BvhChannelTypes::Zrotation };
+  std::vector<float> values = { 12.5f, -3.0f, 7.25f, 30.0f, -135.0f, 95.5f };
+  BvhFrame frame{ .values = values };
+
+  int count = 0;
+  for (auto a : ROT) {
+    for (auto b : ROT) {
+      for (auto c : ROT) {
+        if (a == b || b == c || a == c) {
+          continue;
+        }
+        for (bool position : { false, true }) {
+          BvhChannels channels{ .init = { 1, 2, 3 } };
+          int i = 0;
+          if (position) {
+            channels[i++] = BvhChannelTypes::Xposition;
+            channels[i++] = BvhChannelTypes::Yposition;
+            channels[i++] = BvhChannelTypes::Zposition;
+          }
+          channels[i++] = a;
+          channels[i++] = b;
+          channels[i++] = c;
+          channels.startIndex = position ? 0 : 3;
+
+          channels.kernel = BvhFindKernel(channels);
+          ASSERT_NE(channels.kernel, nullptr);
+          ++count;
+          auto [pos, rot] = frame.Resolve(channels);
+          channels.kernel = nullptr;
+          auto [expected_pos, expected_rot] = frame.Resolve(channels);
+
+          EXPECT_EQ(pos.x, expected_pos.x);
+          EXPECT_EQ(pos.y, expected_pos.y);
+          EXPECT_EQ(pos.z, expected_pos.z);
+          DirectX::XMFLOAT4X4 m, expected;
+          DirectX::XMStoreFloat4x4(&m, rot);
+          DirectX::XMStoreFloat4x4(&expected, expected_rot);
+          for (int r = 0; r < 4; ++r) {
+            for (int col = 0; col < 4; ++col) {
+              EXPECT_NEAR(m.m[r][col], expected.m[r][col], 1e-5f);
+            }
+          }
+        }
+      }
+    }
+  }
+  EXPECT_EQ(count, 12);
+
+  // generic path
+  BvhChannels rotation_first;
+  rotation_first[0] = BvhChannelTypes::Zrotation;
+  rotation_first[1] = BvhChannelTypes::Xrotation;
+  rotation_first[2] = BvhChannelTypes::Yrotation;
+  rotation_first[3] = BvhChannelTypes::Xposition;
+  rotation_first[4] = BvhChannelTypes::Yposition;
+  rotation_first[5] = BvhChannelTypes::Zposition;
+  EXPECT_EQ(BvhFindKernel(rotation_first), nullptr);
+  BvhChannels repeated;
+  repeated[0] = BvhChannelTypes::Zrotation;
+  repeated[1] = BvhChannelTypes::Xrotation;
+  repeated[2] = BvhChannelTypes::Zrotation;
+  EXPECT_EQ(BvhFindKernel(repeated), nullptr);
+
+  // detected at load
+  Bvh bvh;
+  ASSERT_TRUE(bvh.Parse(BVH_SRC));
+  for (auto& joint : bvh.joints) {
+    EXPECT_NE(joint.channels.kernel, nullptr);
+  }
+}
+
+TEST(BvhFlatSolver, bake)
+{
+  std::string src(BVH_SRC);
+  src = src.substr(0, src.find("MOTION"));
+  src += "MOTION\nFrames: 100\nFrame Time: 0.1\n";
+  for (int i = 0; i < 100; ++i) {
+    for (int c = 0; c < 9; ++c) {
+      src += std::to_string((i * 9 + c) % 37 * 10 - 180) + " ";
+    }
+    src += "\n";
+  }
+  auto bvh = std::make_shared<Bvh>();
+  ASSERT_TRUE(bvh->Parse(src));
+  BvhFlatSolver solver;
+  solver.Initialize(bvh);
+  auto joints = solver.JointCount();
+
+  std::vector<DirectX::XMFLOAT4X4> expected;
+  for (uint32_t i = 10; i < 90; ++i) {
+    for (auto& m : solver.ResolveFrame(bvh->GetFrame(i))) {
+      expected.push_back(m);
+    }
+  }
+
+  for (uint32_t threads : { 1, 3, 200 }) {
+    std::vector<DirectX::XMFLOAT4X4> instances(80 * joints);
+    ASSERT_TRUE(solver.Bake(*bvh, 10, 90, instances, true, threads));
+    EXPECT_EQ(memcmp(instances.data(),
+                     expected.data(),
+                     expected.size() * sizeof(expected[0])),
+              0);
+  }
+
+  std::vector<DirectX::XMFLOAT4X4> world(80 * joints);
+  ASSERT_TRUE(solver.Bake(*bvh, 10, 90, world, false, 3));
+  // instance = shape * world. the root shape is the default cube
+  auto shape = DirectX::XMMatrixScaling(0.04f, 0.04f, 0.04f);
+  DirectX::XMFLOAT4X4 root;
+  DirectX::XMStoreFloat4x4(&root,
+                           shape * DirectX::XMLoadFloat4x4(&world[joints]));
+  EXPECT_EQ(memcmp(&root, &expected[joints], sizeof(root)), 0);
+
+  // out of range or too small
+  EXPECT_FALSE(solver.Bake(*bvh, 10, 101, world));
+  EXPECT_FALSE(solver.Bake(*bvh, 0, 90, world));
+
+  // no joints
+  auto empty = std::make_shared<Bvh>();
+  solver.Initialize(empty);
+  EXPECT_EQ(solver.JointCount(), 0);
+}
+
+TEST(BvhTracks, matches_resolve)
+{
+  // consecutive frames far apart on the sphere
+  std::string src(BVH_SRC);
+  src = src.substr(0, src.find("MOTION"));
+  src += "MOTION\nFrames: 40\nFrame Time: 0.1\n";
+  for (int i = 0; i < 40; ++i) {
+    for (int c = 0; c < 9; ++c) {
+      src += std::to_string((i * 9 + c) * 47 % 720 - 360) + " ";
+    }
+    src += "\n";
+  }
+  auto bvh = std::make_shared<Bvh>();
+  ASSERT_TRUE(bvh->Parse(src));
+
+  std::vector<BvhFrame> plain;
+  for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+    plain.push_back(bvh->GetFrame(i));
+    EXPECT_TRUE(plain.back().rotations.empty());
+  }
+
+  ASSERT_TRUE(bvh->BuildTracks(3));
+  ASSERT_EQ(bvh->tracks->frame_count, 40);
+  ASSERT_EQ(bvh->tracks->joint_count, 2);
+  EXPECT_EQ(BvhTracks::Bytes(*bvh),
+            bvh->tracks->rotations.size() * sizeof(DirectX::XMFLOAT4) +
+              bvh->tracks->translations.size() * sizeof(DirectX::XMFLOAT3));
+  for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+    auto frame = bvh->GetFrame(i);
+    ASSERT_EQ(frame.rotations.size(), 2);
+    for (auto& joint : bvh->joints) {
+      auto [expected_pos, expected_rot] = plain[i].Resolve(joint.channels);
+      auto [pos, rot] = frame.Resolve(joint.index, joint.channels);
+      EXPECT_EQ(pos.x, expected_pos.x);
+      EXPECT_EQ(pos.y, expected_pos.y);
+      EXPECT_EQ(pos.z, expected_pos.z);
+      DirectX::XMFLOAT4X4 m, expected;
+      DirectX::XMStoreFloat4x4(&m, rot);
+      DirectX::XMStoreFloat4x4(&expected, expected_rot);
+      for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+          EXPECT_NEAR(m.m[r][c], expected.m[r][c], 1e-5f);
+        }
+      }
+
+      auto q = frame.rotations[joint.index];
+      EXPECT_NEAR(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w, 1, 1e-5f);
+      if (i > 0) {
+        // no sign flips along the track
+        auto p = bvh->GetFrame(i - 1).rotations[joint.index];
+        EXPECT_GE(p.x * q.x + p.y * q.y + p.z * q.z + p.w * q.w, 0);
+      }
+    }
+  }
+
+  // the tree and flat solvers read the tracks the same way
+  BvhSolver tree;
+  tree.Initialize(bvh);
+  BvhFlatSolver flat;
+  flat.Initialize(bvh);
+  auto frame = bvh->GetFrame(7);
+  std::vector<DirectX::XMFLOAT4X4> expected;
+  for (auto& m : tree.ResolveFrame(frame)) {
+    expected.push_back(m);
+  }
+  auto actual = flat.ResolveFrame(frame);
+  EXPECT_EQ(
+    memcmp(actual.data(), expected.data(), expected.size() * sizeof(expected[0])),
+    0);
+}
+
+TEST(BvhTracks, slerp)
+{
+  std::mt19937 rand(7);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  auto random_quat = [&]() {
+    DirectX::XMFLOAT4 q{ dist(rand), dist(rand), dist(rand), dist(rand) };
+    DirectX::XMStoreFloat4(
+      &q, DirectX::XMQuaternionNormalize(DirectX::XMLoadFloat4(&q)));
+    return q;
+  };
+  // 4 + tail. includes the same and opposite rotation
+  std::vector<DirectX::XMFLOAT4> a, b;
+  for (int i = 0; i < 7; ++i) {
+    a.push_back(random_quat());
+    b.push_back(random_quat());
+  }
+  b[1] = a[1];
+  b[2] = { -a[2].x, -a[2].y, -a[2].z, -a[2].w };
+
+  for (float t : { 0.0f, 0.25f, 0.5f, 0.9f, 1.0f }) {
+    std::vector<DirectX::XMFLOAT4> out(a.size());
+    BvhSlerp(a, b, t, out);
+    for (size_t i = 0; i < a.size(); ++i) {
+      DirectX::XMFLOAT4 expected;
+      DirectX::XMStoreFloat4(
+        &expected,
+        DirectX::XMQuaternionSlerp(
+          DirectX::XMLoadFloat4(&a[i]), DirectX::XMLoadFloat4(&b[i]), t));
+      EXPECT_NEAR(out[i].x, expected.x, 1e-4f) << i << " " << t;
+      EXPECT_NEAR(out[i].y, expected.y, 1e-4f) << i << " " << t;
+      EXPECT_NEAR(out[i].z, expected.z, 1e-4f) << i << " " << t;
+      EXPECT_NEAR(out[i].w, expected.w, 1e-4f) << i << " " << t;
+    }
+  }
+}
+
+TEST(Bvh, sample)
+{
+  auto bvh = std::make_shared<Bvh>();
+  ASSERT_TRUE(bvh->Parse(BVH_SRC));
+  std::shared_ptr<BvhPose> pose;
+
+  // no tracks: nearest frame
+  auto nearest = bvh->Sample(BvhTime(0.75f), pose);
+  EXPECT_EQ(nearest.index, 1);
+  EXPECT_TRUE(nearest.rotations.empty());
+
+  ASSERT_TRUE(bvh->BuildTracks());
+  auto frame0 = bvh->GetFrame(0);
+  auto frame1 = bvh->GetFrame(1);
+  {
+    auto sampled = bvh->Sample(BvhTime(0), pose);
+    EXPECT_EQ(sampled.translations[0].x, frame0.translations[0].x);
+    EXPECT_NEAR(sampled.rotations[1].w, frame0.rotations[1].w, 1e-6f);
+  }
+
+  // a quarter of the way from frame 0 to 1 (0.5s per frame)
+  auto sampled = bvh->Sample(BvhTime(0.125f), pose);
+  EXPECT_EQ(sampled.index, 0);
+  EXPECT_EQ(sampled.time.count(), 0.125f);
+  EXPECT_FLOAT_EQ(sampled.translations[0].x,
+                  frame0.translations[0].x * 0.75f +
+                    frame1.translations[0].x * 0.25f);
+  DirectX::XMFLOAT4 expected;
+  DirectX::XMStoreFloat4(
+    &expected,
+    DirectX::XMQuaternionSlerp(DirectX::XMLoadFloat4(&frame0.rotations[1]),
+                               DirectX::XMLoadFloat4(&frame1.rotations[1]),
+                               0.25f));
+  EXPECT_NEAR(sampled.rotations[1].x, expected.x, 1e-5f);
+  EXPECT_NEAR(sampled.rotations[1].w, expected.w, 1e-5f);
+
+  // the pose is still referenced by sampled. the next sample gets a new one
+  auto first = pose.get();
+  auto next = bvh->Sample(BvhTime(0.6f), pose);
+  EXPECT_NE(pose.get(), first);
+  EXPECT_EQ(next.index, 1);
+
+  // looped and negative time
+  EXPECT_EQ(bvh->Sample(BvhTime(1.1f), pose).index, 0);
+  EXPECT_EQ(bvh->Sample(BvhTime(-0.1f), pose).index, 1);
+
+  // after the last frame: held, or blended into frame 0 when looping
+  auto last = bvh->Sample(BvhTime(0.75f), pose);
+  EXPECT_EQ(last.index, 1);
+  EXPECT_EQ(last.translations[0].x, frame1.translations[0].x);
+  bvh->loop = true;
+  auto wrapped = bvh->Sample(BvhTime(0.75f), pose);
+  EXPECT_FLOAT_EQ(wrapped.translations[0].x,
+                  frame1.translations[0].x * 0.5f +
+                    frame0.translations[0].x * 0.5f);
+}
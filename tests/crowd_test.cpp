@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+
+#include <DirectXMath.h>
+
+#include "../example/bvhutil/BvhCrowd.h"
+#include "../example/bvhutil/WorkStealingPool.h"
+#include <atomic>
+#include <cstring>
+#include <string>
+
+TEST(WorkStealingPool, covers_all)
+{
+  WorkStealingPool pool(4);
+  ASSERT_EQ(pool.ThreadCount(), 4);
+  for (size_t count : { 0, 1, 7, 1000, 4097 }) {
+    std::vector<std::atomic<int>> hits(count);
+    std::atomic<int> bad_worker = 0;
+    pool.ParallelFor(
+      count, 16, [&](size_t begin, size_t end, uint32_t worker) {
+        if (worker >= 4) {
+          ++bad_worker;
+        }
+        for (auto i = begin; i < end; ++i) {
+          ++hits[i];
+        }
+      });
+    for (auto& hit : hits) {
+      EXPECT_EQ(hit, 1);
+    }
+    EXPECT_EQ(bad_worker, 0);
+  }
+}
+
+TEST(WorkStealingPool, ranges)
+{
+  std::vector<std::atomic<int>> hits(1000);
+  std::atomic<int> ranges = 0;
+  ParallelRanges(hits.size(), 3, [&](size_t begin, size_t end) {
+    ++ranges;
+    // nested: runs inline instead of waiting for the busy pool
+    ParallelRanges(end - begin, 0, [&](size_t first, size_t last) {
+      for (auto i = begin + first; i < begin + last; ++i) {
+        ++hits[i];
+      }
+    });
+  });
+  EXPECT_LE(ranges, 3);
+  for (auto& hit : hits) {
+    EXPECT_EQ(hit, 1);
+  }
+}
+
+static std::shared_ptr<Bvh>
+MakeClip(int frames, float step)
+{
+  std::string src = "HIERARCHY\n"
+                    "ROOT Hips\n"
+                    "{\n"
+                    "OFFSET 0 90 0\n"
+                    "CHANNELS 6 Xposition Yposition Zposition "
+                    "Zrotation Xrotation Yrotation\n"
+                    "JOINT Spine\n"
+                    "{\n"
+                    "OFFSET 0 10 0\n"
+                    "CHANNELS 3 Zrotation Xrotation Yrotation\n"
+                    "End Site\n"
+                    "{\n"
+                    "OFFSET 0 5 0\n"
+                    "}\n"
+                    "}\n"
+                    "}\n"
+                    "MOTION\n";
+  src += "Frames: " + std::to_string(frames) + "\n";
+  src += "Frame Time: 0.5\n";
+  for (int i = 0; i < frames; ++i) {
+    for (int c = 0; c < 9; ++c) {
+      src += std::to_string(i * step + c) + " ";
+    }
+    src += "\n";
+  }
+  auto bvh = std::make_shared<Bvh>();
+  if (!bvh->Parse(src)) {
+    return {};
+  }
+  return bvh;
+}
+
+TEST(BvhCrowd, matches_solver)
+{
+  auto a = MakeClip(4, 10);
+  auto b = MakeClip(3, -7);
+  ASSERT_TRUE(a && b);
+
+  BvhCrowd crowd(3);
+  crowd.grain_ = 2;
+  auto clip_a = crowd.AddClip(a);
+  auto clip_b = crowd.AddClip(b);
+  for (int i = 0; i < 50; ++i) {
+    crowd.AddCharacter({
+      .clip = i % 3 ? clip_a : clip_b,
+      .offset = BvhTime(i * 0.5f - 3.0f),
+    });
+  }
+  BvhCrowdCharacter moved{ .clip = clip_a, .scale = 2.0f };
+  moved.root.m[3][0] = 5;
+  crowd.AddCharacter(moved);
+
+  auto time = BvhTime(1.0f);
+  auto instances = crowd.Update(time);
+  ASSERT_EQ(instances.size(), 51 * 2);
+
+  BvhFlatSolver solver;
+  for (size_t i = 0; i < 50; ++i) {
+    auto& character = crowd.Character(i);
+    auto& bvh = character.clip == clip_a ? a : b;
+    solver.Initialize(bvh);
+    // 1.0 + i * 0.5 - 3.0 seconds, 0.5 per frame
+    auto frame = (int(i) - 4 + 2 * 100 * int(bvh->FrameCount())) %
+                 int(bvh->FrameCount());
+    auto expected = solver.ResolveFrame(bvh->GetFrame(frame));
+    for (size_t j = 0; j < 2; ++j) {
+      EXPECT_EQ(memcmp(&instances[i * 2 + j].Matrix,
+                       &expected[j],
+                       sizeof(expected[j])),
+                0)
+        << "character " << i << " joint " << j;
+    }
+  }
+
+  // scaled, then moved by root
+  solver.Initialize(a);
+  auto expected = solver.ResolveFrame(a->GetFrame(2));
+  auto& hips = instances[50 * 2].Matrix;
+  EXPECT_NEAR(hips.m[3][0], expected[0].m[3][0] * 2 + 5, 1e-5f);
+  EXPECT_NEAR(hips.m[3][1], expected[0].m[3][1] * 2, 1e-5f);
+  EXPECT_NEAR(hips.m[0][0], expected[0].m[0][0] * 2, 1e-5f);
+  // face flags are kept
+  EXPECT_EQ(instances[0].PositiveFaceFlag.x, 1);
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include "../example/bvhutil/BvhNumber.h"
+#include "../example/bvhutil/BvhTokenizer.h"
+#include <random>
+#include <string>
+
+static void
+ExpectSameAsStrtod(const std::string& src)
+{
+  char* end = nullptr;
+  double expected = strtod(src.c_str(), &end);
+
+  double d;
+  auto p = bvh_number::parse(src.data(), src.data() + src.size(), d);
+  ASSERT_NE(p, nullptr) << src;
+  EXPECT_EQ(p, end) << src;
+  EXPECT_EQ(std::bit_cast<uint64_t>(d), std::bit_cast<uint64_t>(expected))
+    << src;
+
+  float f = 0;
+  bvh_number::parse(src.data(), src.data() + src.size(), f);
+  EXPECT_EQ(std::bit_cast<uint32_t>(f),
+            std::bit_cast<uint32_t>(static_cast<float>(expected)))
+    << src;
+}
+
+TEST(BvhNumber, fixed)
+{
+  for (auto src : {
+         "0",
+         "-0",
+         "+1",
+         "0.0",
+         "-0.000000",
+         "1.5",
+         ".5",
+         "5.",
+         "-123.456789",
+         "90.000000",
+         "1e3",
+         "1E-3",
+         "-2.5e+2",
+         "1e",
+         "0.1",
+         "0.3",
+         "123456789012345678",
+         "12345678901234567890123",
+         "1e300",
+         "1e-300",
+         "4.9406564584124654e-324",
+         "inf",
+         "-nan",
+       }) {
+    ExpectSameAsStrtod(src);
+  }
+}
+
+TEST(BvhNumber, token)
+{
+  EXPECT_EQ(to_num<float>("1.5"), 1.5f);
+  EXPECT_EQ(to_num<float>("+1"), 1.0f);
+  EXPECT_EQ(to_num<int>("12"), 12);
+  // the whole token
+  EXPECT_FALSE(to_num<float>("1.5x"));
+  EXPECT_FALSE(to_num<float>("1e3e"));
+  EXPECT_FALSE(to_num<int>("12x"));
+  EXPECT_FALSE(to_num<float>(""));
+  // one sign
+  EXPECT_FALSE(to_num<float>("+-1"));
+  EXPECT_FALSE(to_num<float>("-+1"));
+  EXPECT_FALSE(to_num<float>("++1"));
+  double d;
+  const char src[] = "+-1 ";
+  EXPECT_EQ(bvh_number::parse(src, src + 3, d), nullptr);
+}
+
+TEST(BvhNumber, random)
+{
+  std::mt19937_64 rand(42);
+  char buf[64];
+  for (int i = 0; i < 200000; ++i) {
+    // fixed precision like mocap exporters
+    std::uniform_real_distribution<double> dist(-1000.0, 1000.0);
+    snprintf(buf, sizeof(buf), "%.*f", int(rand() % 10), dist(rand));
+    ExpectSameAsStrtod(buf);
+
+    // random digits and exponent
+    std::string src;
+    if (rand() % 2) {
+      src += '-';
+    }
+    auto n = 1 + rand() % 22;
+    auto dot = rand() % (n + 1);
+    for (size_t j = 0; j < n; ++j) {
+      if (j == dot) {
+        src += '.';
+      }
+      src += char('0' + rand() % 10);
+    }
+    if (rand() % 3 == 0) {
+      src += 'e';
+      src += std::to_string(int(rand() % 80) - 40);
+    }
+    ExpectSameAsStrtod(src);
+  }
+}
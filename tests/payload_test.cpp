@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+
+#include <DirectXMath.h>
+
+#include "../example/bvhutil/Payload.h"
+#include "../example/bvhutil/UdpSender.h"
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <set>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+
+// heap allocations of the whole test binary
+std::atomic<uint64_t> g_allocations = 0;
+
+void*
+operator new(size_t size)
+{
+  ++g_allocations;
+  if (auto p = malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void
+operator delete(void* p) noexcept
+{
+  free(p);
+}
+
+void
+operator delete(void* p, size_t) noexcept
+{
+  free(p);
+}
+
+TEST(PayloadPool, exhaust)
+{
+  PayloadPool pool(3, 100);
+  EXPECT_EQ(pool.Count(), 4);
+  EXPECT_EQ(pool.Bytes(), 128);
+
+  std::set<Payload*> payloads;
+  while (auto payload = pool.Acquire()) {
+    EXPECT_EQ((uintptr_t)payload->data % 64, 0);
+    EXPECT_EQ(payload->size, 0);
+    EXPECT_TRUE(payload->Fits(128));
+    EXPECT_FALSE(payload->Fits(129));
+    payload->Push(uint32_t(1));
+    payloads.insert(payload);
+  }
+  EXPECT_EQ(payloads.size(), 4);
+
+  auto first = *payloads.begin();
+  pool.Release(first);
+  auto again = pool.Acquire();
+  EXPECT_EQ(again, first);
+  EXPECT_EQ(again->size, 0);
+  EXPECT_EQ(pool.Acquire(), nullptr);
+}
+
+TEST(PayloadPool, threads)
+{
+  PayloadPool pool(8, 64);
+  std::vector<Payload*> all;
+  while (auto payload = pool.Acquire()) {
+    all.push_back(payload);
+  }
+  for (auto payload : all) {
+    pool.Release(payload);
+  }
+
+  // a payload is never handed to two threads at once
+  std::atomic<int> owners[8] = {};
+  auto worker = [&pool, &all, &owners]() {
+    for (int i = 0; i < 50000; ++i) {
+      auto payload = pool.Acquire();
+      if (!payload) {
+        continue;
+      }
+      auto index = std::find(all.begin(), all.end(), payload) - all.begin();
+      ASSERT_EQ(owners[index].fetch_add(1), 0);
+      payload->Push(uint32_t(i));
+      owners[index].fetch_sub(1);
+      pool.Release(payload);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  size_t count = 0;
+  while (pool.Acquire()) {
+    ++count;
+  }
+  EXPECT_EQ(count, 8);
+}
+
+static std::shared_ptr<Bvh>
+MakeSkeleton(int jointCount)
+{
+  std::string src = "HIERARCHY\nROOT Hips\n{\nOFFSET 0 90 0\n"
+                    "CHANNELS 6 Xposition Yposition Zposition "
+                    "Zrotation Xrotation Yrotation\n";
+  for (int i = 1; i < jointCount; ++i) {
+    src += "JOINT J" + std::to_string(i) +
+           "\n{\nOFFSET 0 5 0\nCHANNELS 3 Zrotation Xrotation Yrotation\n";
+  }
+  src += "End Site\n{\nOFFSET 0 5 0\n}\n";
+  for (int i = 0; i < jointCount; ++i) {
+    src += "}\n";
+  }
+  src += "MOTION\nFrames: 2\nFrame Time: 0.033333\n";
+  for (int f = 0; f < 2; ++f) {
+    src += "1 2 3 10 20 30";
+    for (int i = 1; i < jointCount; ++i) {
+      src += " 5 -5 15";
+    }
+    src += "\n";
+  }
+  auto bvh = std::make_shared<Bvh>();
+  if (!bvh->Parse(src)) {
+    return {};
+  }
+  return bvh;
+}
+
+TEST(UdpSender, no_allocation)
+{
+  auto bvh = MakeSkeleton(30);
+  ASSERT_TRUE(bvh);
+  ASSERT_TRUE(bvh->BuildTracks());
+  auto frame = bvh->GetFrame(1);
+
+  asio::io_context io;
+  asio::ip::udp::socket receiver(
+    io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  auto ep = receiver.local_endpoint();
+  UdpSender sender(io);
+
+  std::vector<uint8_t> buffer(65536);
+  auto receive = [&receiver, &buffer]() {
+    return receiver.receive(asio::buffer(buffer));
+  };
+
+  sender.SendSkeleton(ep, bvh);
+  io.poll();
+  io.restart();
+  ASSERT_EQ(receive(), sizeof(srht::SkeletonHeader) + 16 * 30);
+  EXPECT_EQ(((srht::SkeletonHeader*)buffer.data())->jointCount, 30);
+
+  // SendFrame runs on the io_context (Animation::OnFrame), where asio
+  // recycles the handler memory
+  uint64_t allocations = 0;
+  auto send = [&](bool pack) {
+    asio::post(io, [&, pack]() {
+      auto before = g_allocations.load();
+      sender.SendFrame(ep, bvh, frame, pack);
+      allocations += g_allocations.load() - before;
+    });
+    io.poll();
+    io.restart();
+  };
+  // warm up
+  for (int i = 0; i < 4; ++i) {
+    send(i % 2);
+    receive();
+  }
+
+  for (bool pack : { false, true }) {
+    allocations = 0;
+    for (int i = 0; i < 100; ++i) {
+      send(pack);
+    }
+    EXPECT_EQ(allocations, 0) << "pack: " << pack;
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_EQ(receive(),
+                sizeof(srht::FrameHeader) + (pack ? 4 : 16) * 30);
+    }
+  }
+  EXPECT_EQ(sender.Dropped(), 0);
+}
+
+TEST(UdpSender, batch)
+{
+  auto bvh = MakeSkeleton(10);
+  ASSERT_TRUE(bvh);
+  auto frame = bvh->GetFrame(0);
+
+  asio::io_context io;
+  std::vector<std::unique_ptr<asio::ip::udp::socket>> receivers;
+  UdpSender sender(io);
+  for (int i = 0; i < 3; ++i) {
+    receivers.push_back(std::make_unique<asio::ip::udp::socket>(
+      io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0)));
+    EXPECT_TRUE(sender.AddEndpoint(receivers.back()->local_endpoint()));
+  }
+  EXPECT_FALSE(sender.AddEndpoint(receivers[0]->local_endpoint()));
+  EXPECT_TRUE(sender.RemoveEndpoint(receivers[2]->local_endpoint()));
+  EXPECT_FALSE(sender.RemoveEndpoint(receivers[2]->local_endpoint()));
+  EXPECT_EQ(sender.Endpoints().size(), 2);
+
+  std::vector<uint8_t> buffer(65536);
+  for (bool batch : { true, false }) {
+    sender.SetBatchSend(batch);
+    auto before = sender.Stats();
+    sender.QueueSkeleton(*bvh);
+    sender.QueueFrame(*bvh, frame, false, 0);
+    sender.QueueFrame(*bvh, frame, true, 1);
+    EXPECT_EQ(sender.Flush(), 6);
+    EXPECT_EQ(sender.Flush(), 0);
+    auto stats = sender.Stats();
+    EXPECT_EQ(stats.datagrams - before.datagrams, 6);
+    EXPECT_EQ(stats.flushes - before.flushes, 1);
+#ifdef __linux__
+    EXPECT_EQ(stats.syscalls - before.syscalls, batch ? 1 : 6);
+#endif
+
+    // every endpoint gets the tick in order
+    for (int i = 0; i < 2; ++i) {
+      auto& receiver = *receivers[i];
+      ASSERT_EQ(receiver.receive(asio::buffer(buffer)),
+                sizeof(srht::SkeletonHeader) + 16 * 10);
+      EXPECT_EQ(std::string_view((const char*)buffer.data(), 8), "SRHTSKL1");
+      ASSERT_EQ(receiver.receive(asio::buffer(buffer)),
+                sizeof(srht::FrameHeader) + 16 * 10);
+      EXPECT_EQ(((srht::FrameHeader*)buffer.data())->skeletonId, 0);
+      ASSERT_EQ(receiver.receive(asio::buffer(buffer)),
+                sizeof(srht::FrameHeader) + 4 * 10);
+      EXPECT_EQ(((srht::FrameHeader*)buffer.data())->skeletonId, 1);
+    }
+    receivers[2]->non_blocking(true);
+    asio::error_code ec;
+    receivers[2]->receive(asio::buffer(buffer), 0, ec);
+    EXPECT_EQ(ec, asio::error::would_block);
+  }
+
+  // payloads went back to the pool and the batch path does not allocate
+  auto before = g_allocations.load();
+  for (int i = 0; i < 100; ++i) {
+    sender.QueueFrame(*bvh, frame, true);
+    sender.Flush();
+  }
+  EXPECT_EQ(g_allocations.load() - before, 0);
+  EXPECT_EQ(sender.Dropped(), 0);
+}
+
+TEST(UdpSender, endpoint_error)
+{
+  auto bvh = MakeSkeleton(10);
+  ASSERT_TRUE(bvh);
+  auto frame = bvh->GetFrame(0);
+
+  asio::io_context io;
+  UdpSender sender(io);
+  // the socket is v4
+  EXPECT_FALSE(sender.AddEndpoint({ asio::ip::address_v6::loopback(), 9 }));
+  asio::ip::udp::socket first(
+    io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  asio::ip::udp::socket last(
+    io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  EXPECT_TRUE(sender.AddEndpoint(first.local_endpoint()));
+  // port 0: EINVAL for its datagrams alone
+  EXPECT_TRUE(sender.AddEndpoint({ asio::ip::address_v4::loopback(), 0 }));
+  EXPECT_TRUE(sender.AddEndpoint(last.local_endpoint()));
+
+  std::vector<uint8_t> buffer(65536);
+  for (bool batch : { true, false }) {
+    sender.SetBatchSend(batch);
+    auto dropped = sender.Dropped();
+    sender.QueueFrame(*bvh, frame, false, 0);
+    sender.QueueFrame(*bvh, frame, true, 1);
+    EXPECT_EQ(sender.Flush(), 4);
+    EXPECT_EQ(sender.Dropped() - dropped, 2);
+    for (auto receiver : { &first, &last }) {
+      EXPECT_EQ(receiver->receive(asio::buffer(buffer)),
+                sizeof(srht::FrameHeader) + 16 * 10);
+      EXPECT_EQ(receiver->receive(asio::buffer(buffer)),
+                sizeof(srht::FrameHeader) + 4 * 10);
+    }
+  }
+}
@@ -1,7 +1,12 @@
 #include <gtest/gtest.h>
 
+#include "../example/bvhutil/Quat32Batch.h"
 #include "../example/bvhutil/srht.h"
+#include <algorithm>
+#include <cmath>
 #include <muQuat32.h>
+#include <random>
+#include <vector>
 
 TEST(quat32, packunpack) {
   mu::quatf identity{0, 0, 0, 1};
@@ -77,3 +82,70 @@ TEST(quat32, bitfield) {
     ASSERT_EQ(packed.value, 0x3fffffff);
   }
 }
+
+// normalized, with ties and signed zeros among them
+static std::vector<float> MakeQuats(size_t count) {
+  std::vector<float> xyzw;
+  const float edges[][4] = {
+      {0, 0, 0, 1},       {0, 0, 0, -1},     {-0.0f, 0, 0, 1},
+      {0.5f, 0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, -0.5f, 0.5f},
+      {0.7071068f, 0.7071068f, 0, 0}, {0, -0.7071068f, 0.7071068f, 0},
+      {1, 0, 0, 0},       {0, -1, 0, 0},     {0, 0, -1, 0},
+  };
+  for (auto &q : edges) {
+    xyzw.insert(xyzw.end(), q, q + 4);
+  }
+  std::mt19937 rand(1);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  while (xyzw.size() < count * 4) {
+    float q[4] = {dist(rand), dist(rand), dist(rand), dist(rand)};
+    auto len = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (auto &v : q) {
+      v /= len;
+    }
+    xyzw.insert(xyzw.end(), q, q + 4);
+  }
+  xyzw.resize(count * 4);
+  return xyzw;
+}
+
+TEST(quat32, pack_batch) {
+  auto xyzw = MakeQuats(1000);
+  // every tail length of the 8 / 4 steps
+  for (size_t count : {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 55, 1000}) {
+    std::vector<uint32_t> packed(count);
+    quat_packer::PackBatch({xyzw.data(), count * 4}, packed);
+    for (size_t i = 0; i < count; ++i) {
+      auto q = &xyzw[i * 4];
+      ASSERT_EQ(packed[i], quat_packer::Pack(q[0], q[1], q[2], q[3]))
+          << count << ": " << i;
+    }
+
+    // in place
+    auto inplace = xyzw;
+    auto dst = (uint32_t *)inplace.data();
+    quat_packer::PackBatch({inplace.data(), count * 4}, {dst, count});
+    ASSERT_TRUE(std::equal(packed.begin(), packed.end(), dst)) << count;
+  }
+}
+
+TEST(quat32, unpack_batch) {
+  // a spread over every bit pattern, the invalid ones (sqrt of a negative)
+  // included
+  std::vector<uint32_t> packed;
+  for (uint64_t v = 0; v <= 0xffffffff; v += 4093) {
+    packed.push_back(static_cast<uint32_t>(v));
+  }
+  packed.push_back(quat_packer::Pack(0, 0, 0, 1));
+  std::vector<float> xyzw(packed.size() * 4);
+  for (size_t count : {(size_t)0, (size_t)1, (size_t)7, (size_t)13,
+                       packed.size()}) {
+    quat_packer::UnpackBatch({packed.data(), count}, {xyzw.data(), count * 4});
+    for (size_t i = 0; i < count; ++i) {
+      float expected[4];
+      quat_packer::Unpack(packed[i], expected);
+      ASSERT_EQ(memcmp(expected, &xyzw[i * 4], sizeof(expected)), 0)
+          << std::hex << packed[i];
+    }
+  }
+}
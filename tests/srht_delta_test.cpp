@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "../example/bvhutil/SrhtDelta.h"
+#include <random>
+#include <vector>
+
+static uint32_t
+MakePacked(uint32_t x0, uint32_t x1, uint32_t x2, uint32_t drop)
+{
+  return x0 | x1 << 10 | x2 << 20 | drop << 30;
+}
+
+static std::vector<uint32_t>
+MakeKeyframe(size_t count)
+{
+  std::mt19937 rand(0);
+  std::uniform_int_distribution<uint32_t> component(0, 0x3ff);
+  std::uniform_int_distribution<uint32_t> drop(0, 3);
+  std::vector<uint32_t> keyframe(count);
+  for (auto& packed : keyframe) {
+    packed = MakePacked(component(rand), component(rand), component(rand),
+                        drop(rand));
+  }
+  return keyframe;
+}
+
+TEST(SrhtDelta, lossless)
+{
+  auto keyframe = MakeKeyframe(55);
+  auto current = keyframe;
+  // the ends of the range (PackQuat), a small move, a varint move, a new
+  // drop (PackQuat)
+  keyframe[0] = MakePacked(0x3ff, 0, 511, 1);
+  current[0] = MakePacked(0, 0x3ff, 512, 1);
+  keyframe[3] = MakePacked(20, 500, 1000, 0);
+  current[3] = MakePacked(4, 515, 1000, 0);
+  keyframe[10] = MakePacked(100, 100, 100, 2);
+  current[10] = MakePacked(100, 140, 99, 2);
+  current[54] = (current[54] & 0x3fffffff) | ((~current[54] >> 30) << 30);
+
+  std::vector<uint8_t> body(srht::DeltaBound(current.size()));
+  auto size = srht::EncodeDelta(1234, keyframe, current, 0, body.data());
+  ASSERT_LE(size, body.size());
+  // codes, 4 + 2 + 3 + 4 bytes
+  EXPECT_EQ(size, sizeof(srht::DeltaHeader) + 14 + 13);
+  body.resize(size);
+
+  srht::DeltaHeader header;
+  memcpy(&header, body.data(), sizeof(header));
+  EXPECT_EQ(header.keyframeTime, 1234);
+  std::vector<uint32_t> decoded(current.size());
+  ASSERT_TRUE(srht::DecodeDelta(body, keyframe, decoded));
+  EXPECT_EQ(decoded, current);
+
+  // unchanged: the codes only
+  size = srht::EncodeDelta(0, keyframe, keyframe, 0, body.data());
+  EXPECT_EQ(size, sizeof(srht::DeltaHeader) + 14);
+}
+
+TEST(SrhtDelta, threshold)
+{
+  auto keyframe = MakeKeyframe(16);
+  auto current = keyframe;
+  for (size_t i = 0; i < current.size(); ++i) {
+    auto x0 = current[i] & 0x3ff;
+    // i steps
+    auto moved = x0 + i <= 0x3ff ? x0 + i : x0 - i;
+    current[i] = (current[i] & ~0x3ffu) | static_cast<uint32_t>(moved);
+  }
+
+  std::vector<uint8_t> body(srht::DeltaBound(current.size()));
+  body.resize(srht::EncodeDelta(0, keyframe, current, 4, body.data()));
+  std::vector<uint32_t> decoded(current.size());
+  ASSERT_TRUE(srht::DecodeDelta(body, keyframe, decoded));
+  for (size_t i = 0; i < current.size(); ++i) {
+    // up to 4 steps stay at the keyframe
+    EXPECT_EQ(decoded[i], i <= 4 ? keyframe[i] : current[i]) << i;
+  }
+}
+
+TEST(SrhtDelta, malformed)
+{
+  auto keyframe = MakeKeyframe(9);
+  auto current = keyframe;
+  current[8] ^= 0x40000000;
+  current[1] = (current[1] & ~0x3ffu) | ((current[1] & 0x3ff) ^ 0x200);
+  std::vector<uint8_t> body(srht::DeltaBound(current.size()));
+  body.resize(srht::EncodeDelta(0, keyframe, current, 0, body.data()));
+  std::vector<uint32_t> decoded(current.size());
+  ASSERT_TRUE(srht::DecodeDelta(body, keyframe, decoded));
+
+  // truncated
+  for (size_t size = 0; size < body.size(); ++size) {
+    EXPECT_FALSE(srht::DecodeDelta({ body.data(), size }, keyframe, decoded))
+      << size;
+  }
+  // trailing byte
+  auto longer = body;
+  longer.push_back(0);
+  EXPECT_FALSE(srht::DecodeDelta(longer, keyframe, decoded));
+  // another skeleton
+  std::vector<uint32_t> smaller(8);
+  EXPECT_FALSE(srht::DecodeDelta(body, smaller, smaller));
+
+  // a component out of 0 .. 0x3ff
+  uint32_t zero = MakePacked(0, 0, 0, 0);
+  // small, dx0 = -1
+  uint8_t under[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0x1, 0x1f, 0 };
+  EXPECT_FALSE(srht::DecodeDelta(under, { &zero, 1 }, { &zero, 1 }));
+}
@@ -0,0 +1,272 @@
+#include <gtest/gtest.h>
+
+#include <DirectXMath.h>
+
+#include "../example/bvhutil/SrhtLog.h"
+#include "../example/bvhutil/SrhtReceiver.h"
+#include "../example/bvhutil/UdpSender.h"
+#include <filesystem>
+#include <fstream>
+
+static std::string
+TempPath(const char* name)
+{
+  return (std::filesystem::temp_directory_path() /
+          (std::string("srht_log_test_") + name + ".srhtlog"))
+    .string();
+}
+
+// datagram i: i % 100 + 1 bytes of i
+static std::vector<uint8_t>
+Datagram(int i)
+{
+  return std::vector<uint8_t>(i % 100 + 1, static_cast<uint8_t>(i));
+}
+
+static void
+WriteLog(const std::string& path, int count)
+{
+  SrhtRecorder recorder;
+  ASSERT_TRUE(recorder.Open(path));
+  auto start = SrhtRecorder::Clock::now();
+  for (int i = 0; i < count; ++i) {
+    // 10ms apart. two datagrams per tick
+    ASSERT_TRUE(
+      recorder.Record(Datagram(i),
+                      start + std::chrono::milliseconds(i / 2 * 10)));
+  }
+  EXPECT_EQ(recorder.Count(), count);
+  ASSERT_TRUE(recorder.Close());
+}
+
+TEST(SrhtLog, roundtrip)
+{
+  auto path = TempPath("roundtrip");
+  const int COUNT = 2000;
+  WriteLog(path, COUNT);
+
+  SrhtLogReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  EXPECT_TRUE(reader.Indexed());
+  EXPECT_EQ(reader.Count(), COUNT);
+  SrhtLogEntry entry;
+  std::chrono::nanoseconds last = {};
+  for (int i = 0; i < COUNT; ++i) {
+    ASSERT_TRUE(reader.Next(entry)) << i;
+    auto expected = Datagram(i);
+    ASSERT_TRUE(std::equal(entry.bytes.begin(), entry.bytes.end(),
+                           expected.begin(), expected.end()))
+      << i;
+    EXPECT_GE(entry.time, last);
+    last = entry.time;
+  }
+  EXPECT_FALSE(reader.Next(entry));
+  EXPECT_EQ(reader.Duration(), last);
+
+  // the first datagram of tick 700, several index entries in
+  auto tick = [&reader](int i) {
+    reader.Rewind();
+    SrhtLogEntry entry;
+    for (int j = 0; j <= i; ++j) {
+      reader.Next(entry);
+    }
+    return entry.time;
+  };
+  auto time = tick(1400);
+  reader.Seek(time);
+  ASSERT_TRUE(reader.Next(entry));
+  EXPECT_EQ(entry.bytes[0], static_cast<uint8_t>(1400));
+  EXPECT_EQ(entry.time, time);
+  // between two ticks: the next one
+  reader.Seek(time - std::chrono::nanoseconds(1));
+  ASSERT_TRUE(reader.Next(entry));
+  EXPECT_EQ(entry.bytes[0], static_cast<uint8_t>(1400));
+  reader.Seek(reader.Duration() + std::chrono::seconds(1));
+  EXPECT_FALSE(reader.Next(entry));
+
+  reader.Close();
+  std::filesystem::remove(path);
+}
+
+TEST(SrhtLog, unfinished)
+{
+  auto path = TempPath("unfinished");
+  WriteLog(path, 600);
+
+  // as if the recorder died in the middle of record 500: no index, a
+  // partial record
+  size_t offset = sizeof(srht::LogHeader);
+  for (int i = 0; i < 500; ++i) {
+    offset += (sizeof(srht::LogRecord) + Datagram(i).size() + 7) / 8 * 8;
+  }
+  auto cut = TempPath("cut");
+  {
+    std::ifstream is(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(is)), {});
+    std::ofstream os(cut, std::ios::binary);
+    os.write(bytes.data(), offset + sizeof(srht::LogRecord) / 2);
+  }
+
+  SrhtLogReader reader;
+  ASSERT_TRUE(reader.Open(cut));
+  EXPECT_FALSE(reader.Indexed());
+  EXPECT_EQ(reader.Count(), 500);
+  SrhtLogEntry entry;
+  size_t count = 0;
+  while (reader.Next(entry)) {
+    ++count;
+  }
+  EXPECT_EQ(count, 500);
+  EXPECT_EQ(entry.bytes[0], static_cast<uint8_t>(499));
+  // the scanned index seeks as well
+  reader.Seek(reader.Duration());
+  ASSERT_TRUE(reader.Next(entry));
+  EXPECT_EQ(entry.bytes[0], static_cast<uint8_t>(498));
+
+  reader.Close();
+  std::filesystem::remove(path);
+  std::filesystem::remove(cut);
+}
+
+TEST(SrhtLog, corrupt)
+{
+  auto path = TempPath("corrupt");
+  WriteLog(path, 600);
+  std::vector<char> bytes;
+  {
+    std::ifstream is(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(is), {});
+  }
+  std::filesystem::remove(path);
+  srht::LogFooter footer;
+  ASSERT_GE(bytes.size(), sizeof(footer));
+  memcpy(&footer, bytes.data() + bytes.size() - sizeof(footer), sizeof(footer));
+  auto write = [&bytes](const std::string& path, const srht::LogFooter& f) {
+    auto copy = bytes;
+    memcpy(copy.data() + copy.size() - sizeof(f), &f, sizeof(f));
+    std::ofstream os(path, std::ios::binary);
+    os.write(copy.data(), copy.size());
+  };
+  auto cut = TempPath("corrupt_footer");
+
+  // table sizes that wrap the offset back to the footer
+  auto bad = footer;
+  bad.indexCount = bytes.size() / sizeof(srht::LogIndexEntry);
+  bad.skeletonCount = bytes.size() / sizeof(uint64_t);
+  bad.indexOffset = bytes.size() - sizeof(bad) -
+                    bad.indexCount * sizeof(srht::LogIndexEntry) -
+                    bad.skeletonCount * sizeof(uint64_t);
+  write(cut, bad);
+  SrhtLogReader reader;
+  ASSERT_TRUE(reader.Open(cut));
+  EXPECT_FALSE(reader.Indexed());
+  SrhtLogEntry entry;
+  ASSERT_TRUE(reader.Next(entry));
+  EXPECT_EQ(entry.bytes.size(), Datagram(0).size());
+  reader.Close();
+
+  // index entries past the records
+  ASSERT_GE(footer.indexCount, 2);
+  for (uint64_t i = 0; i < footer.indexCount; ++i) {
+    auto p = bytes.data() + footer.indexOffset + i * sizeof(srht::LogIndexEntry);
+    uint64_t offset = UINT64_MAX - 7;
+    memcpy(p + offsetof(srht::LogIndexEntry, offset), &offset, sizeof(offset));
+  }
+  write(cut, footer);
+  ASSERT_TRUE(reader.Open(cut));
+  EXPECT_TRUE(reader.Indexed());
+  reader.Seek(reader.Duration());
+  EXPECT_FALSE(reader.Next(entry));
+  reader.Close();
+  std::filesystem::remove(cut);
+}
+
+TEST(SrhtLog, sender)
+{
+  auto path = TempPath("sender");
+  // a chain of 6 joints. the skeleton packet is larger than MIN_MTU
+  const int JOINTS = 6;
+  std::string src = "HIERARCHY\nROOT Hips\n{\nOFFSET 0 90 0\n"
+                    "CHANNELS 6 Xposition Yposition Zposition "
+                    "Zrotation Xrotation Yrotation\n";
+  for (int i = 1; i < JOINTS; ++i) {
+    src += "JOINT J" + std::to_string(i) +
+           "\n{\nOFFSET 0 10 0\nCHANNELS 3 Zrotation Xrotation Yrotation\n";
+  }
+  src += "End Site\n{\nOFFSET 0 10 0\n}\n";
+  for (int i = 0; i < JOINTS; ++i) {
+    src += "}\n";
+  }
+  src += "MOTION\nFrames: 3\nFrame Time: 0.033333\n";
+  for (int frame = 0; frame < 3; ++frame) {
+    src += "0 90 0";
+    for (int i = 0; i < JOINTS; ++i) {
+      src += " 0 " + std::to_string(frame * 10) + " 0";
+    }
+    src += "\n";
+  }
+  Bvh bvh;
+  ASSERT_TRUE(bvh.Parse(src));
+
+  auto recorder = std::make_shared<SrhtRecorder>();
+  ASSERT_TRUE(recorder->Open(path));
+  asio::io_context io;
+  UdpSender sender(io);
+  sender.SetRecorder(recorder);
+  // the skeleton in fragments
+  sender.SetMtu(UdpSender::MIN_MTU);
+  sender.QueueSkeleton(bvh);
+  sender.Flush();
+  for (uint32_t i = 0; i < bvh.FrameCount(); ++i) {
+    sender.QueueFrame(bvh, bvh.GetFrame(i), true);
+    sender.Flush();
+  }
+  auto datagrams = sender.Stats().recorded;
+  EXPECT_GT(datagrams, 1 + bvh.FrameCount());
+  ASSERT_TRUE(recorder->Close());
+
+  SrhtLogReader reader;
+  ASSERT_TRUE(reader.Open(path));
+  SrhtReceiver receiver;
+  auto start = SrhtReceiver::Clock::now();
+  size_t frames = 0;
+  EXPECT_EQ(reader.Replay(0,
+                          [&](const SrhtLogEntry& entry) {
+                            EXPECT_TRUE(receiver.Push(entry.bytes,
+                                                      start + entry.time));
+                            return true;
+                          }),
+            datagrams);
+  while (receiver.Pop(SrhtReceiver::Clock::time_point::max())) {
+    ++frames;
+  }
+  EXPECT_EQ(frames, bvh.FrameCount());
+
+  // from the last frame: the skeleton fragments go first
+  SrhtLogEntry last;
+  reader.Rewind();
+  while (reader.Next(last)) {
+  }
+  reader.Seek(last.time);
+  auto skeletons = reader.Skeletons(last.time);
+  EXPECT_EQ(skeletons.size(), datagrams - bvh.FrameCount());
+  SrhtReceiver seeked;
+  for (auto& entry : skeletons) {
+    seeked.Push(entry.bytes, start);
+  }
+  EXPECT_TRUE(seeked.Skeleton(0));
+  EXPECT_EQ(reader.Replay(0,
+                          [&](const SrhtLogEntry& entry) {
+                            return seeked.Push(entry.bytes, start + entry.time);
+                          }),
+            1);
+  EXPECT_EQ(seeked.Pop(SrhtReceiver::Clock::time_point::max()),
+            seeked.Skeleton(0));
+
+  // stop early
+  reader.Rewind();
+  EXPECT_EQ(reader.Replay(0, [](const SrhtLogEntry&) { return false; }), 1);
+
+  reader.Close();
+  std::filesystem::remove(path);
+}
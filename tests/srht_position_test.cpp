@@ -0,0 +1,260 @@
+#include <gtest/gtest.h>
+
+#include <DirectXMath.h>
+
+#include "../example/bvhutil/SrhtLog.h"
+#include "../example/bvhutil/SrhtReceiver.h"
+#include "../example/bvhutil/UdpSender.h"
+#include <filesystem>
+#include <random>
+
+TEST(SrhtPosition, half)
+{
+  EXPECT_EQ(srht::HalfFromFloat(0.0f), 0x0000);
+  EXPECT_EQ(srht::HalfFromFloat(-0.0f), 0x8000);
+  EXPECT_EQ(srht::HalfFromFloat(1.0f), 0x3c00);
+  EXPECT_EQ(srht::HalfFromFloat(-2.0f), 0xc000);
+  EXPECT_EQ(srht::HalfFromFloat(0.1f), 0x2e66);
+  EXPECT_EQ(srht::HalfFromFloat(65504.0f), 0x7bff);
+  // halfway to 65536 rounds to even: inf
+  EXPECT_EQ(srht::HalfFromFloat(65519.0f), 0x7bff);
+  EXPECT_EQ(srht::HalfFromFloat(65520.0f), 0x7c00);
+  EXPECT_EQ(srht::HalfFromFloat(std::ldexp(1.0f, -24)), 0x0001);
+  EXPECT_EQ(srht::HalfFromFloat(std::ldexp(1.0f, -26)), 0x0000);
+  EXPECT_TRUE(std::isnan(srht::FloatFromHalf(srht::HalfFromFloat(NAN))));
+
+  // every half survives the round trip
+  for (uint32_t h = 0; h < 0x10000; ++h) {
+    auto f = srht::FloatFromHalf(static_cast<uint16_t>(h));
+    if (std::isnan(f)) {
+      continue;
+    }
+    ASSERT_EQ(srht::HalfFromFloat(f), h) << std::hex << h;
+  }
+}
+
+TEST(SrhtPosition, half_error)
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> mantissa(1.0f, 2.0f);
+  std::uniform_int_distribution<int> exponent(-30, 15);
+  for (int i = 0; i < 200000; ++i) {
+    auto f = std::ldexp(mantissa(rng), exponent(rng)) * (i & 1 ? 1 : -1);
+    if (std::abs(f) > 65504.0f) {
+      // out of range: inf
+      continue;
+    }
+    auto back = srht::FloatFromHalf(srht::HalfFromFloat(f));
+    auto bound =
+      std::abs(f) >= std::ldexp(1.0f, -14) ? std::abs(f) * std::ldexp(1.0f, -11)
+                                           : std::ldexp(1.0f, -25);
+    ASSERT_LE(std::abs(back - f), bound) << f;
+  }
+}
+
+TEST(SrhtPosition, fixed)
+{
+  const float scale = 0.001f;
+  int16_t fixed;
+  ASSERT_TRUE(srht::FixedFromFloat(1.2344f, scale, fixed));
+  EXPECT_EQ(fixed, 1234);
+  ASSERT_TRUE(srht::FixedFromFloat(-32.767f, scale, fixed));
+  EXPECT_EQ(fixed, -32767);
+  EXPECT_FALSE(srht::FixedFromFloat(32.768f, scale, fixed));
+  EXPECT_FALSE(srht::FixedFromFloat(NAN, scale, fixed));
+
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> range(-32.767f, 32.767f);
+  for (int i = 0; i < 200000; ++i) {
+    auto f = range(rng);
+    ASSERT_TRUE(srht::FixedFromFloat(f, scale, fixed)) << f;
+    // the half step and the float rounding of the product
+    ASSERT_LE(std::abs(srht::FloatFromFixed(fixed, scale) - f),
+              scale / 2 + 4e-6f)
+      << f;
+  }
+}
+
+// a chain of joints. the root walks from x to x + frameCount
+static std::shared_ptr<Bvh>
+MakeClip(int jointCount, int frameCount, float x)
+{
+  std::string src = "HIERARCHY\nROOT Hips\n{\nOFFSET 0 90 0\n"
+                    "CHANNELS 6 Xposition Yposition Zposition "
+                    "Zrotation Xrotation Yrotation\n";
+  for (int i = 1; i < jointCount; ++i) {
+    src += "JOINT J" + std::to_string(i) + "\n{\nOFFSET " +
+           std::to_string(i % 3) + ".37 5.11 0\n" +
+           "CHANNELS 3 Zrotation Xrotation Yrotation\n";
+  }
+  src += "End Site\n{\nOFFSET 0 5 0\n}\n";
+  for (int i = 0; i < jointCount; ++i) {
+    src += "}\n";
+  }
+  src += "MOTION\nFrames: " + std::to_string(frameCount) +
+         "\nFrame Time: 0.033333\n";
+  for (int frame = 0; frame < frameCount; ++frame) {
+    src += std::to_string(x + frame * 1.013f) + " 90.3 -7.7";
+    for (int i = 0; i < jointCount; ++i) {
+      src += " " + std::to_string((frame * 7 + i * 13) % 90) + " 10 20";
+    }
+    src += "\n";
+  }
+  auto bvh = std::make_shared<Bvh>();
+  if (!bvh->Parse(src)) {
+    return {};
+  }
+  return bvh;
+}
+
+// the datagrams of QueueSkeleton and QueueFrame x frameCount
+static std::vector<std::vector<uint8_t>>
+Capture(const Bvh& bvh,
+        PositionEncoding encoding,
+        float scale = UdpSender::POSITION_SCALE,
+        UdpSendStats* stats = nullptr)
+{
+  auto path =
+    (std::filesystem::temp_directory_path() / "srht_position_test.srhtlog")
+      .string();
+  auto recorder = std::make_shared<SrhtRecorder>();
+  if (!recorder->Open(path)) {
+    return {};
+  }
+  asio::io_context io;
+  UdpSender sender(io);
+  sender.SetRecorder(recorder);
+  sender.SetPositionEncoding(encoding, scale);
+  sender.QueueSkeleton(bvh);
+  for (uint32_t i = 0; i < bvh.FrameCount(); ++i) {
+    sender.QueueFrame(bvh, bvh.GetFrame(i), true);
+  }
+  sender.Flush();
+  if (stats) {
+    *stats = sender.Stats();
+  }
+  recorder->Close();
+
+  std::vector<std::vector<uint8_t>> datagrams;
+  SrhtLogReader reader;
+  if (reader.Open(path)) {
+    SrhtLogEntry entry;
+    while (reader.Next(entry)) {
+      datagrams.emplace_back(entry.bytes.begin(), entry.bytes.end());
+    }
+  }
+  reader.Close();
+  std::filesystem::remove(path);
+  return datagrams;
+}
+
+// world matrices of every frame
+static std::vector<std::vector<DirectX::XMFLOAT4X4>>
+Receive(const std::vector<std::vector<uint8_t>>& datagrams,
+        SrhtReceiverStats* stats = nullptr)
+{
+  SrhtReceiver receiver(64);
+  for (auto& datagram : datagrams) {
+    receiver.Push(datagram);
+  }
+  std::vector<std::vector<DirectX::XMFLOAT4X4>> frames;
+  while (auto skeleton =
+           receiver.Pop(SrhtReceiver::Clock::now() + std::chrono::hours(1))) {
+    frames.push_back(skeleton->world);
+  }
+  if (stats) {
+    *stats = receiver.Stats();
+  }
+  return frames;
+}
+
+TEST(SrhtPosition, sender)
+{
+  const int JOINTS = 12;
+  auto bvh = MakeClip(JOINTS, 8, 3.3f);
+  ASSERT_TRUE(bvh);
+
+  auto full = Capture(*bvh, PositionEncoding::FLOAT);
+  ASSERT_EQ(full.size(), 1 + bvh->FrameCount());
+  auto expected = Receive(full);
+  ASSERT_EQ(expected.size(), bvh->FrameCount());
+
+  for (auto encoding : { PositionEncoding::HALF, PositionEncoding::FIXED }) {
+    UdpSendStats sendStats;
+    auto compact =
+      Capture(*bvh, encoding, UdpSender::POSITION_SCALE, &sendStats);
+    ASSERT_EQ(compact.size(), full.size());
+    EXPECT_EQ(sendStats.compactPositions, bvh->FrameCount());
+    // 20 + 8 x joints instead of 16 + 16 x joints
+    EXPECT_EQ(compact[0].size(), 20 + 8 * JOINTS);
+    for (size_t i = 1; i < full.size(); ++i) {
+      EXPECT_EQ(full[i].size() - compact[i].size(),
+                sizeof(srht::FrameHeader) - srht::COMPACT_FRAME_SIZE);
+    }
+
+    SrhtReceiverStats stats;
+    auto frames = Receive(compact, &stats);
+    EXPECT_EQ(stats.malformed, 0);
+    ASSERT_EQ(frames.size(), expected.size());
+    // the root: 2^-11 of ~10m for half, 0.5mm fixed. joints add the error
+    // of their fixed point offsets
+    for (size_t f = 0; f < frames.size(); ++f) {
+      for (int j = 0; j < JOINTS; ++j) {
+        auto& a = frames[f][j];
+        auto& b = expected[f][j];
+        auto tolerance = 6e-3f + j * 1e-3f;
+        EXPECT_NEAR(a.m[3][0], b.m[3][0], tolerance) << f << "," << j;
+        EXPECT_NEAR(a.m[3][1], b.m[3][1], tolerance) << f << "," << j;
+        EXPECT_NEAR(a.m[3][2], b.m[3][2], tolerance) << f << "," << j;
+      }
+    }
+  }
+}
+
+TEST(SrhtPosition, fixed_fallback)
+{
+  auto bvh = MakeClip(4, 4, 0);
+  ASSERT_TRUE(bvh);
+  auto expected = Receive(Capture(*bvh, PositionEncoding::FLOAT));
+
+  // +-0.33m: the joint offsets fit, the root height does not
+  UdpSendStats sendStats;
+  auto datagrams = Capture(*bvh, PositionEncoding::FIXED, 1e-5f, &sendStats);
+  EXPECT_EQ(sendStats.compactPositions, 0);
+  SrhtReceiverStats stats;
+  auto frames = Receive(datagrams, &stats);
+  EXPECT_EQ(stats.malformed, 0);
+  ASSERT_EQ(frames.size(), expected.size());
+  EXPECT_NEAR(frames[0][0].m[3][1], expected[0][0].m[3][1], 1e-6f);
+
+  // a FIXED_POSITION frame of a skeleton without a scale
+  datagrams = Capture(*bvh, PositionEncoding::FIXED);
+  auto full = Capture(*bvh, PositionEncoding::FLOAT);
+  datagrams[0] = full[0];
+  frames = Receive(datagrams, &stats);
+  EXPECT_TRUE(frames.empty());
+  EXPECT_EQ(stats.malformed, bvh->FrameCount());
+}
+
+TEST(SrhtPosition, magic)
+{
+  auto bvh = MakeClip(4, 2, 0);
+  ASSERT_TRUE(bvh);
+  auto datagrams = Capture(*bvh, PositionEncoding::HALF);
+  ASSERT_EQ(datagrams.size(), 3);
+  // a receiver that only knows FrameHeader does not take compact frames
+  EXPECT_NE(memcmp(datagrams[1].data(), srht::FrameHeader{}.magic, 8), 0);
+  EXPECT_EQ(memcmp(datagrams[1].data(), srht::CompactFrameHeader{}.magic, 8),
+            0);
+  SrhtReceiverStats stats;
+  EXPECT_EQ(Receive(datagrams, &stats).size(), 2);
+  EXPECT_EQ(stats.malformed, 0);
+
+  // the magic and the flags disagree
+  memcpy(datagrams[1].data(), srht::FrameHeader{}.magic, 8);
+  auto full = Capture(*bvh, PositionEncoding::FLOAT);
+  memcpy(full[1].data(), srht::CompactFrameHeader{}.magic, 8);
+  datagrams[2] = full[1];
+  EXPECT_TRUE(Receive(datagrams, &stats).empty());
+  EXPECT_EQ(stats.malformed, 2);
+}
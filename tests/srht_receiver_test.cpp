@@ -0,0 +1,438 @@
+#include <gtest/gtest.h>
+
+#include <DirectXMath.h>
+
+#include "../example/bvhutil/BvhFlatSolver.h"
+#include "../example/bvhutil/SrhtReceiver.h"
+#include "../example/bvhutil/UdpSender.h"
+#include <atomic>
+#include <climits>
+#include <string>
+
+// payload_test.cpp
+extern std::atomic<uint64_t> g_allocations;
+
+// chain of joints with different angles per frame. joints from moving on
+// keep the angles of frame 0
+static std::shared_ptr<Bvh>
+MakeClip(int jointCount, int frameCount, int moving = INT_MAX)
+{
+  std::string src = "HIERARCHY\nROOT Hips\n{\nOFFSET 0 90 0\n"
+                    "CHANNELS 6 Xposition Yposition Zposition "
+                    "Zrotation Xrotation Yrotation\n";
+  for (int i = 1; i < jointCount; ++i) {
+    src += "JOINT J" + std::to_string(i) + "\n{\nOFFSET " +
+           std::to_string(i % 3) + " 5 0\n" +
+           "CHANNELS 3 Zrotation Xrotation Yrotation\n";
+  }
+  src += "End Site\n{\nOFFSET 0 5 0\n}\n";
+  for (int i = 0; i < jointCount; ++i) {
+    src += "}\n";
+  }
+  src += "MOTION\nFrames: " + std::to_string(frameCount) +
+         "\nFrame Time: 0.033333\n";
+  for (int frame = 0; frame < frameCount; ++frame) {
+    src += std::to_string(frame) + " 90 " + std::to_string(-frame) +
+           " 10 20 30";
+    for (int i = 1; i < jointCount; ++i) {
+      auto f = i < moving ? frame : 0;
+      src += " " + std::to_string((f * 7 + i * 13) % 90) + " " +
+             std::to_string((f * 3 + i * 5) % 60 - 30) + " " +
+             std::to_string((f + i) % 45);
+    }
+    src += "\n";
+  }
+  auto bvh = std::make_shared<Bvh>();
+  if (!bvh->Parse(src)) {
+    return {};
+  }
+  return bvh;
+}
+
+static void
+ExpectNear(const DirectX::XMFLOAT4X4& a,
+           const DirectX::XMFLOAT4X4& b,
+           float tolerance)
+{
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      EXPECT_NEAR(a.m[r][c], b.m[r][c], tolerance) << r << "," << c;
+    }
+  }
+}
+
+TEST(SrhtReceiver, loopback)
+{
+  auto bvh = MakeClip(12, 8);
+  ASSERT_TRUE(bvh);
+  BvhFlatSolver solver;
+  solver.Initialize(bvh);
+  std::vector<DirectX::XMFLOAT4X4> world(solver.JointCount());
+  std::vector<DirectX::XMFLOAT4X4> instances(solver.JointCount());
+
+  asio::io_context io;
+  SrhtUdpReceiver udp(
+    io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  SrhtReceiver receiver(16);
+  UdpSender sender(io);
+  sender.AddEndpoint(udp.LocalEndpoint());
+
+  for (bool pack : { false, true }) {
+    sender.QueueSkeleton(*bvh, 3);
+    for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+      sender.QueueFrame(*bvh, bvh->GetFrame(i), pack, 3);
+    }
+    ASSERT_EQ(sender.Flush(), 1 + bvh->FrameCount());
+
+    size_t received = 0;
+    for (int retry = 0; retry < 100 && received < 1 + bvh->FrameCount();
+         ++retry) {
+      received += udp.Poll(receiver);
+    }
+    ASSERT_EQ(received, 1 + bvh->FrameCount());
+    auto skeleton = receiver.Skeleton(3);
+    ASSERT_TRUE(skeleton);
+    ASSERT_EQ(skeleton->joints.size(), bvh->joints.size());
+
+    auto later = SrhtReceiver::Clock::now() + std::chrono::seconds(1);
+    for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+      auto frame = bvh->GetFrame(i);
+      ASSERT_EQ(receiver.Pop(later), skeleton) << i;
+      EXPECT_EQ(skeleton->time, frame.time);
+
+      solver.Solve(
+        frame, DirectX::XMMatrixIdentity(), world.data(), instances.data());
+      // quat32 keeps 10 bits per component. the error adds up along the
+      // chain of 12 joints
+      auto tolerance = pack ? 4e-2f : 1e-4f;
+      for (size_t j = 0; j < world.size(); ++j) {
+        ExpectNear(skeleton->world[j], world[j], tolerance);
+        ExpectNear(skeleton->instances[j].Matrix, instances[j], tolerance);
+      }
+    }
+    EXPECT_EQ(receiver.Pop(later), nullptr);
+    // the clip starts over: a new timeline, not late frames
+    EXPECT_EQ(receiver.Stats().late, 0);
+  }
+  EXPECT_EQ(receiver.Stats().played, 2 * bvh->FrameCount());
+  EXPECT_EQ(receiver.Stats().resync, 1);
+}
+
+// the skeleton and every frame as UdpSender sends them
+static std::vector<std::vector<uint8_t>>
+Capture(const Bvh& bvh, uint32_t keyframeInterval = 0)
+{
+  asio::io_context io;
+  asio::ip::udp::socket socket(
+    io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  UdpSender sender(io);
+  sender.AddEndpoint(socket.local_endpoint());
+  sender.SetDelta(keyframeInterval);
+  sender.QueueSkeleton(bvh);
+  for (uint32_t i = 0; i < bvh.FrameCount(); ++i) {
+    sender.QueueFrame(bvh, bvh.GetFrame(i), true);
+  }
+  sender.Flush();
+
+  std::vector<std::vector<uint8_t>> datagrams;
+  std::vector<uint8_t> buffer(65536);
+  for (uint32_t i = 0; i <= bvh.FrameCount(); ++i) {
+    auto size = socket.receive(asio::buffer(buffer));
+    datagrams.emplace_back(buffer.begin(), buffer.begin() + size);
+  }
+  return datagrams;
+}
+
+TEST(SrhtReceiver, jitter)
+{
+  auto bvh = MakeClip(4, 8);
+  ASSERT_TRUE(bvh);
+  auto datagrams = Capture(*bvh);
+  auto time = [&bvh](int i) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      bvh->frame_time * i);
+  };
+  auto frame = [&datagrams](int i) {
+    return std::span<const uint8_t>(datagrams[1 + i]);
+  };
+
+  using namespace std::chrono_literals;
+  auto delay = 50ms;
+  SrhtReceiver receiver(4, delay);
+  auto t0 = SrhtReceiver::Clock::now();
+  ASSERT_TRUE(receiver.Push(datagrams[0], t0));
+  auto skeleton = receiver.Skeleton(0);
+  ASSERT_TRUE(skeleton);
+
+  // 2 arrives before 1
+  ASSERT_TRUE(receiver.Push(frame(2), t0 + time(2)));
+  ASSERT_TRUE(receiver.Push(frame(1), t0 + time(2) + 1ms));
+  EXPECT_EQ(receiver.Stats().reordered, 1);
+  EXPECT_EQ(receiver.Pop(t0 + time(1)), nullptr);
+  // played delay after it was sent
+  ASSERT_EQ(receiver.Pop(t0 + time(1) + delay), skeleton);
+  EXPECT_EQ(skeleton->time, time(1));
+  EXPECT_EQ(receiver.Pop(t0 + time(1) + delay), nullptr);
+  ASSERT_EQ(receiver.Pop(t0 + time(2) + delay), skeleton);
+  EXPECT_EQ(skeleton->time, time(2));
+
+  // already played. older by less than the delay, so not a clip loop
+  ASSERT_TRUE(receiver.Push(frame(1), t0 + time(3)));
+  EXPECT_EQ(receiver.Stats().late, 1);
+
+  // 4 slots. 3 is pushed out
+  for (int i = 3; i < 8; ++i) {
+    ASSERT_TRUE(receiver.Push(frame(i), t0 + time(i)));
+  }
+  EXPECT_EQ(receiver.Stats().overflow, 1);
+  EXPECT_EQ(receiver.Buffered(), 4);
+
+  // Push and Pop of frames do not allocate
+  auto before = g_allocations.load();
+  for (int i = 4; i < 8; ++i) {
+    ASSERT_EQ(receiver.Pop(t0 + 1s), skeleton);
+    EXPECT_EQ(skeleton->time, time(i));
+  }
+  EXPECT_EQ(receiver.Pop(t0 + 1s), nullptr);
+  // the clip looped
+  ASSERT_TRUE(receiver.Push(frame(0), t0 + 2s));
+  EXPECT_EQ(g_allocations.load() - before, 0);
+  EXPECT_EQ(receiver.Stats().resync, 1);
+  ASSERT_EQ(receiver.Pop(t0 + 3s), skeleton);
+  EXPECT_EQ(skeleton->time, time(0));
+  EXPECT_EQ(receiver.Stats().played, 7);
+
+  // not SRHT, truncated, unknown skeleton
+  uint8_t noise[16] = {};
+  EXPECT_FALSE(receiver.Push(noise, t0));
+  EXPECT_FALSE(receiver.Push(frame(0).subspan(0, 20), t0));
+  EXPECT_EQ(receiver.Stats().malformed, 2);
+  auto other = datagrams[1];
+  ((srht::FrameHeader*)other.data())->skeletonId = 9;
+  EXPECT_FALSE(receiver.Push(other, t0));
+  EXPECT_EQ(receiver.Stats().unknownSkeleton, 1);
+  // a frame that does not match its skeleton is dropped at Pop
+  auto cut = datagrams[2];
+  cut.resize(cut.size() - 4);
+  EXPECT_TRUE(receiver.Push(cut, t0 + 3s));
+  EXPECT_EQ(receiver.Pop(t0 + 4s), nullptr);
+  EXPECT_EQ(receiver.Stats().malformed, 3);
+}
+
+TEST(SrhtReceiver, delta)
+{
+  // joints 1 and 2 of 12 move
+  auto bvh = MakeClip(12, 16, 3);
+  ASSERT_TRUE(bvh);
+  auto full = Capture(*bvh);
+  auto delta = Capture(*bvh, 8);
+  ASSERT_EQ(delta.size(), full.size());
+  // skeleton, keyframe, 7 deltas, keyframe, 7 deltas
+  for (size_t i = 1; i < delta.size(); ++i) {
+    if (i == 1 || i == 9) {
+      EXPECT_EQ(delta[i].size(), full[i].size());
+    } else {
+      EXPECT_LT(delta[i].size(), full[i].size()) << i;
+    }
+  }
+
+  auto later = SrhtReceiver::Clock::now() + std::chrono::seconds(1);
+  auto play = [later](const std::vector<std::vector<uint8_t>>& datagrams,
+                      SrhtReceiver& receiver) {
+    std::vector<std::vector<DirectX::XMFLOAT4>> poses;
+    for (auto& datagram : datagrams) {
+      receiver.Push(datagram);
+    }
+    while (auto skeleton = receiver.Pop(later)) {
+      poses.push_back(skeleton->rotations);
+    }
+    return poses;
+  };
+
+  // threshold 0: the same rotations as full quat32 frames
+  SrhtReceiver fullReceiver(16);
+  SrhtReceiver deltaReceiver(16);
+  auto expected = play(full, fullReceiver);
+  auto poses = play(delta, deltaReceiver);
+  ASSERT_EQ(poses.size(), 16);
+  EXPECT_EQ(deltaReceiver.Stats().deltas, 14);
+  for (size_t i = 0; i < poses.size(); ++i) {
+    EXPECT_EQ(memcmp(poses[i].data(),
+                     expected[i].data(),
+                     sizeof(DirectX::XMFLOAT4) * poses[i].size()),
+              0)
+      << i;
+  }
+
+  // the first keyframe is lost. deltas wait for the second one
+  auto lost = delta;
+  lost.erase(lost.begin() + 1);
+  SrhtReceiver lostReceiver(16);
+  poses = play(lost, lostReceiver);
+  EXPECT_EQ(lostReceiver.Stats().missingKeyframe, 7);
+  ASSERT_EQ(poses.size(), 8);
+  EXPECT_EQ(memcmp(poses[0].data(),
+                   expected[8].data(),
+                   sizeof(DirectX::XMFLOAT4) * poses[0].size()),
+            0);
+}
+
+TEST(SrhtReceiver, bundle)
+{
+  auto small = MakeClip(3, 2);
+  auto large = MakeClip(200, 2);
+  ASSERT_TRUE(small && large);
+
+  asio::io_context io;
+  asio::ip::udp::socket socket(
+    io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  UdpSender sender(io);
+  sender.AddEndpoint(socket.local_endpoint());
+  const size_t MTU = 1200;
+  sender.SetMtu(MTU);
+  for (uint16_t id = 0; id < 4; ++id) {
+    sender.QueueSkeleton(*small, id);
+  }
+  sender.QueueSkeleton(*large, 4);
+  for (uint32_t f = 0; f < 2; ++f) {
+    for (uint16_t id = 0; id < 4; ++id) {
+      sender.QueueFrame(*small, small->GetFrame(f), false, id);
+    }
+    sender.QueueFrame(*large, large->GetFrame(f), false, 4);
+  }
+  // 4 skeletons | 3 fragments | (4 frames | 3 fragments) x 2
+  ASSERT_EQ(sender.Flush(), 12);
+  EXPECT_EQ(sender.Stats().bundles, 3);
+  EXPECT_EQ(sender.Stats().bundled, 12);
+  EXPECT_EQ(sender.Stats().fragments, 9);
+
+  std::vector<std::vector<uint8_t>> datagrams;
+  std::vector<uint8_t> buffer(65536);
+  for (int i = 0; i < 12; ++i) {
+    auto size = socket.receive(asio::buffer(buffer));
+    EXPECT_LE(size, MTU);
+    datagrams.emplace_back(buffer.begin(), buffer.begin() + size);
+  }
+
+  auto later = SrhtReceiver::Clock::now() + std::chrono::seconds(1);
+  {
+    SrhtReceiver receiver(16);
+    for (auto& datagram : datagrams) {
+      EXPECT_TRUE(receiver.Push(datagram));
+    }
+    EXPECT_EQ(receiver.Stats().bundles, 3);
+    EXPECT_EQ(receiver.Stats().fragments, 9);
+    EXPECT_EQ(receiver.Stats().reassembled, 3);
+    EXPECT_EQ(receiver.Stats().skeletons, 5);
+    ASSERT_TRUE(receiver.Skeleton(4));
+    EXPECT_EQ(receiver.Skeleton(4)->joints.size(), 200);
+    int played = 0;
+    while (receiver.Pop(later)) {
+      ++played;
+    }
+    EXPECT_EQ(played, 10);
+    EXPECT_EQ(receiver.Stats().malformed, 0);
+  }
+
+  {
+    // fragments out of order
+    SrhtReceiver receiver(16);
+    for (int i : { 0, 3, 2, 1, 4, 7, 5, 6 }) {
+      EXPECT_TRUE(receiver.Push(datagrams[i]));
+    }
+    EXPECT_EQ(receiver.Stats().reassembled, 2);
+
+    // one fragment of the next frame is lost. 4 newer packets push it out
+    EXPECT_TRUE(receiver.Push(datagrams[8]));
+    EXPECT_TRUE(receiver.Push(datagrams[9]));
+    EXPECT_TRUE(receiver.Push(datagrams[10]));
+    for (uint32_t messageId = 100; messageId < 104; ++messageId) {
+      auto fragment = datagrams[9];
+      ((srht::FragmentHeader*)fragment.data())->messageId = messageId;
+      EXPECT_TRUE(receiver.Push(fragment));
+    }
+    EXPECT_EQ(receiver.Stats().incomplete, 1);
+    EXPECT_EQ(receiver.Stats().reassembled, 2);
+
+    int played = 0;
+    while (receiver.Pop(later)) {
+      ++played;
+    }
+    // 4 + 1 + 4
+    EXPECT_EQ(played, 9);
+  }
+}
+
+TEST(SrhtReceiver, many_skeletons)
+{
+  auto clip = MakeClip(3, 1);
+  ASSERT_TRUE(clip);
+
+  asio::io_context io;
+  asio::ip::udp::socket socket(
+    io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  UdpSender sender(io);
+  sender.AddEndpoint(socket.local_endpoint());
+  sender.SetMtu(1200);
+  // more packets in one tick than the first pool holds
+  const uint16_t COUNT = 100;
+  for (uint16_t id = 0; id < COUNT; ++id) {
+    sender.QueueSkeleton(*clip, id);
+    sender.QueueFrame(*clip, clip->GetFrame(0), false, id);
+  }
+  auto sent = sender.Flush();
+  EXPECT_EQ(sender.Dropped(), 0);
+  EXPECT_EQ(sender.Stats().bundled, COUNT * 2);
+
+  SrhtReceiver receiver(COUNT * 2);
+  std::vector<uint8_t> buffer(65536);
+  for (size_t i = 0; i < sent; ++i) {
+    auto size = socket.receive(asio::buffer(buffer));
+    EXPECT_TRUE(receiver.Push({ buffer.data(), size }));
+  }
+  EXPECT_EQ(receiver.Stats().skeletons, COUNT);
+  int played = 0;
+  while (receiver.Pop(SrhtReceiver::Clock::now() + std::chrono::seconds(1))) {
+    ++played;
+  }
+  EXPECT_EQ(played, COUNT);
+}
+
+TEST(SrhtReceiver, many_fragments)
+{
+  // 16 + 16 x 680 and 40 + 16 x 680 bytes in 176 byte chunks: 62 and 63
+  // fragments, near MAX_FRAGMENTS
+  auto clip = MakeClip(680, 1);
+  ASSERT_TRUE(clip);
+
+  asio::io_context io;
+  asio::ip::udp::socket socket(
+    io, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0));
+  UdpSender sender(io);
+  sender.AddEndpoint(socket.local_endpoint());
+  sender.SetMtu(200);
+  sender.QueueSkeleton(*clip);
+  sender.QueueFrame(*clip, clip->GetFrame(0), false);
+  ASSERT_EQ(sender.Flush(), 125);
+  EXPECT_EQ(sender.Dropped(), 0);
+  EXPECT_EQ(sender.Stats().fragments, 125);
+
+  SrhtReceiver receiver(4);
+  std::vector<uint8_t> buffer(65536);
+  for (int i = 0; i < 125; ++i) {
+    auto size = socket.receive(asio::buffer(buffer));
+    EXPECT_LE(size, 200);
+    EXPECT_TRUE(receiver.Push({ buffer.data(), size }));
+  }
+  EXPECT_EQ(receiver.Stats().reassembled, 2);
+  ASSERT_TRUE(receiver.Skeleton(0));
+  EXPECT_EQ(receiver.Skeleton(0)->joints.size(), 680);
+  EXPECT_TRUE(
+    receiver.Pop(SrhtReceiver::Clock::now() + std::chrono::seconds(1)));
+
+  // SetMtu stays within a UDP datagram: a 16 bit bundle entry size
+  sender.SetMtu(70000);
+  sender.QueueFrame(*clip, clip->GetFrame(0), false);
+  EXPECT_EQ(sender.Flush(), 1);
+  EXPECT_EQ(socket.receive(asio::buffer(buffer)), 40 + 16 * 680);
+}
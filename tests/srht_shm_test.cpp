@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+
+#include <DirectXMath.h>
+
+#include "../example/bvhutil/SrhtShm.h"
+#include "../example/bvhutil/UdpSender.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+// one name per test process: ctest may run the binaries side by side
+static std::string
+ShmName(const char* test)
+{
+  return std::string("srht_test_") + test + "_" + std::to_string(getpid());
+}
+
+static std::shared_ptr<Bvh>
+MakeClip(int frameCount)
+{
+  std::string src = "HIERARCHY\nROOT Hips\n{\nOFFSET 0 90 0\n"
+                    "CHANNELS 6 Xposition Yposition Zposition "
+                    "Zrotation Xrotation Yrotation\n"
+                    "JOINT Spine\n{\nOFFSET 0 10 0\n"
+                    "CHANNELS 3 Zrotation Xrotation Yrotation\n"
+                    "End Site\n{\nOFFSET 0 10 0\n}\n}\n}\n";
+  src += "MOTION\nFrames: " + std::to_string(frameCount) +
+         "\nFrame Time: 0.033333\n";
+  for (int frame = 0; frame < frameCount; ++frame) {
+    src += std::to_string(frame) + " 90 0 0 0 " + std::to_string(frame) +
+           " 10 20 30\n";
+  }
+  auto bvh = std::make_shared<Bvh>();
+  if (!bvh->Parse(src)) {
+    return {};
+  }
+  return bvh;
+}
+
+TEST(SrhtShm, open)
+{
+  auto name = ShmName("open");
+  SrhtShmReader reader;
+  EXPECT_FALSE(reader.Open(name));
+  {
+    SrhtShmWriter writer;
+    ASSERT_TRUE(writer.Create(name));
+    EXPECT_TRUE(reader.Open(name));
+  }
+  // the writer removed the name. an open reader keeps its mapping
+  EXPECT_TRUE(reader.IsOpen());
+  SrhtShmReader late;
+  EXPECT_FALSE(late.Open(name));
+}
+
+TEST(SrhtShm, stale)
+{
+  auto name = ShmName("stale");
+  // a region left by a writer that crashed: not ours, all 0xff
+  auto fd = shm_open(("/" + name).c_str(), O_CREAT | O_RDWR, 0600);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(ftruncate(fd, 1 << 20), 0);
+  auto p = mmap(nullptr, 1 << 20, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ASSERT_NE(p, MAP_FAILED);
+  memset(p, 0xff, 1 << 20);
+  memcpy(p, srht::ShmHeader{}.magic, 8);
+  munmap(p, 1 << 20);
+  close(fd);
+
+  SrhtShmWriter writer;
+  ASSERT_TRUE(writer.Create(name, 4, 256, 2));
+  SrhtShmReader reader;
+  ASSERT_TRUE(reader.Open(name));
+  SrhtReceiver receiver(4);
+  EXPECT_EQ(reader.Poll(receiver), 0);
+  EXPECT_EQ(reader.Lost(), 0);
+  EXPECT_FALSE(reader.ReadLatest(0, [](std::span<const uint8_t>) {}));
+}
+
+TEST(SrhtShm, sender)
+{
+  auto bvh = MakeClip(10);
+  ASSERT_TRUE(bvh);
+  auto name = ShmName("sender");
+  auto shm = std::make_shared<SrhtShmWriter>();
+  ASSERT_TRUE(shm->Create(name));
+  SrhtShmReader reader;
+  ASSERT_TRUE(reader.Open(name));
+
+  // no endpoints: shared memory only
+  asio::io_context io;
+  UdpSender sender(io);
+  sender.SetShm(shm);
+  sender.QueueSkeleton(*bvh, 2);
+  for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+    sender.QueueFrame(*bvh, bvh->GetFrame(i), true, 2);
+  }
+  sender.Flush();
+  EXPECT_EQ(sender.Stats().shm, 1 + bvh->FrameCount());
+
+  SrhtReceiver receiver(16);
+  // skeleton table, then the ring
+  EXPECT_EQ(reader.Poll(receiver), 2 + bvh->FrameCount());
+  EXPECT_EQ(reader.Poll(receiver), 0);
+  EXPECT_EQ(reader.Lost(), 0);
+  auto skeleton = receiver.Skeleton(2);
+  ASSERT_TRUE(skeleton);
+  auto later = SrhtReceiver::Clock::now() + std::chrono::seconds(1);
+  for (uint32_t i = 0; i < bvh->FrameCount(); ++i) {
+    ASSERT_EQ(receiver.Pop(later), skeleton) << i;
+    EXPECT_EQ(skeleton->time, bvh->GetFrame(i).time);
+  }
+
+  // a reader that attaches after the skeleton was sent still gets it
+  SrhtShmReader late;
+  ASSERT_TRUE(late.Open(name));
+  SrhtReceiver lateReceiver(16);
+  EXPECT_EQ(late.Poll(lateReceiver), 1);
+  EXPECT_TRUE(lateReceiver.Skeleton(2));
+
+  srht::FrameHeader latest;
+  EXPECT_TRUE(late.ReadLatest(2, [&latest](std::span<const uint8_t> packet) {
+    ASSERT_GE(packet.size(), sizeof(latest));
+    memcpy(&latest, packet.data(), sizeof(latest));
+  }));
+  EXPECT_EQ(latest.time,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+              bvh->GetFrame(bvh->FrameCount() - 1).time)
+              .count());
+  EXPECT_FALSE(late.ReadLatest(3, [](auto) {}));
+}
+
+TEST(SrhtShm, lost)
+{
+  auto name = ShmName("lost");
+  SrhtShmWriter writer;
+  ASSERT_TRUE(writer.Create(name, 8, 64, 1));
+  SrhtShmReader reader;
+  ASSERT_TRUE(reader.Open(name));
+
+  std::vector<uint8_t> packet(64);
+  EXPECT_FALSE(writer.Write(std::vector<uint8_t>(65)));
+  EXPECT_EQ(writer.Dropped(), 1);
+  for (int i = 0; i < 20; ++i) {
+    ASSERT_TRUE(writer.Write(packet));
+  }
+  // not srht packets: the receiver drops them, the reader counts them
+  SrhtReceiver receiver(16);
+  EXPECT_EQ(reader.Poll(receiver), 8);
+  EXPECT_EQ(reader.Lost(), 12);
+}
+
+// packets of a single repeated byte: a torn read shows two bytes
+TEST(SrhtShm, concurrent)
+{
+  auto name = ShmName("concurrent");
+  SrhtShmWriter writer;
+  ASSERT_TRUE(writer.Create(name, 4, 4096, 1));
+  SrhtShmReader reader;
+  ASSERT_TRUE(reader.Open(name));
+
+  srht::FrameHeader header;
+  header.skeletonId = 0;
+  std::vector<uint8_t> packet(4096);
+  std::atomic<bool> done = false;
+  std::thread thread([&]() {
+    for (int i = 0; i < 20000; ++i) {
+      memset(packet.data(), i & 0xff, packet.size());
+      memcpy(packet.data(), &header, sizeof(header));
+      writer.Write(packet);
+    }
+    done = true;
+  });
+
+  auto whole = [](const std::vector<uint8_t>& copy) {
+    auto body = std::span(copy).subspan(sizeof(srht::FrameHeader));
+    return std::count(body.begin(), body.end(), body[0]) ==
+           (ptrdiff_t)body.size();
+  };
+  // f may see a torn packet, ReadLatest must not accept it
+  std::vector<uint8_t> copy;
+  size_t bad = 0;
+  while (!done) {
+    if (reader.ReadLatest(0, [&copy](std::span<const uint8_t> bytes) {
+          copy.assign(bytes.begin(), bytes.end());
+        })) {
+      if (!whole(copy)) {
+        ++bad;
+      }
+    }
+  }
+  thread.join();
+  ASSERT_TRUE(reader.ReadLatest(0, [&copy](std::span<const uint8_t> bytes) {
+    copy.assign(bytes.begin(), bytes.end());
+  }));
+  EXPECT_TRUE(whole(copy));
+  EXPECT_EQ(copy.back(), 19999 & 0xff);
+  EXPECT_EQ(bad, 0);
+}
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include "../example/bvhutil/TripleBuffer.h"
+#include <thread>
+#include <vector>
+
+TEST(TripleBuffer, latest)
+{
+  TripleBuffer<int> buffer;
+  EXPECT_FALSE(buffer.Update());
+
+  buffer.Back() = 1;
+  buffer.Publish();
+  buffer.Back() = 2;
+  buffer.Publish();
+  EXPECT_TRUE(buffer.Update());
+  EXPECT_EQ(buffer.Front(), 2);
+  EXPECT_FALSE(buffer.Update());
+  EXPECT_EQ(buffer.Front(), 2);
+
+  buffer.Back() = 3;
+  buffer.Publish();
+  EXPECT_EQ(buffer.Front(), 2);
+  EXPECT_TRUE(buffer.Update());
+  EXPECT_EQ(buffer.Front(), 3);
+}
+
+TEST(TripleBuffer, no_tear)
+{
+  TripleBuffer<std::vector<uint32_t>> buffer;
+  const uint32_t N = 200000;
+  std::thread writer([&buffer]() {
+    for (uint32_t i = 1; i <= N; ++i) {
+      auto& back = buffer.Back();
+      back.resize(64 + i % 64);
+      std::fill(back.begin(), back.end(), i);
+      buffer.Publish();
+    }
+  });
+
+  uint32_t last = 0;
+  while (last < N) {
+    if (!buffer.Update()) {
+      std::this_thread::yield();
+      continue;
+    }
+    auto& front = buffer.Front();
+    ASSERT_EQ(front.size(), 64 + front[0] % 64);
+    for (auto value : front) {
+      ASSERT_EQ(value, front[0]);
+    }
+    ASSERT_GT(front[0], last);
+    last = front[0];
+  }
+  writer.join();
+}